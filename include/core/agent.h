@@ -1,8 +1,10 @@
 #pragma once
 #include "core/agent_mode.h"
 #include "utils/config.h" // For LLAMAWARE_API
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 // Forward declarations for our own types
@@ -12,9 +14,12 @@ class MemoryManager;
 }
 namespace Services {
 class AIService;
+struct SummaryResult;
 }
 
 namespace Core {
+class ToolScheduler;
+
 class LLAMAWARE_API Agent {
 public:
   using Mode = AgentMode; // Type alias for backward compatibility
@@ -28,6 +33,26 @@ private:
   std::unique_ptr<Services::AIService> ai_service_;
   int command_count_{0};
   long long token_usage_{0};
+  // Background provider warm-up started after mode selection
+  std::thread warm_up_thread_;
+  std::shared_ptr<std::atomic<bool>> warm_up_cancelled_;
+  // Interactions saved outside a chat turn since the model last saw the
+  // memory context; a running session gets them with the next prompt
+  std::string unsent_interactions_;
+
+  // Saves to memory and queues the interaction for the running session
+  void record_interaction(const std::string &input,
+                          const std::string &result);
+
+  // One model request; tools named in the reply are submitted to `tools`
+  std::string request_ai_response(const std::string &prompt,
+                                  ToolScheduler &tools);
+  // Map-reduce summary of `text` for display or injection into a prompt
+  Services::SummaryResult summarize_content(const std::string &label,
+                                            const std::string &text,
+                                            const std::string &focus);
+  // Asks before the model's write:/replace:/cmd: requests run
+  bool confirm_side_effects(const std::vector<std::string> &commands);
 
 public:
   // Move operations
@@ -39,6 +64,7 @@ public:
   Agent &operator=(const Agent &) = delete;
 
   void initialize_mode();
+  void start_warm_up();
   int get_user_choice(const std::string &prompt,
                       const std::vector<int> &valid_choices,
                       int default_choice);
@@ -0,0 +1,102 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Core {
+
+struct ToolResult {
+  std::string invocation{}; // e.g. "read:src/main.cpp"
+  std::string output{};
+};
+
+// Tool commands the system prompt teaches the model ("read:", "grep:", ...)
+class ToolExecutor {
+public:
+  ToolExecutor() = delete;
+
+  // Normalized invocation if `line` is a tool command, ignoring list
+  // markers and code-span backticks around it
+  static std::optional<std::string> parse_invocation(std::string_view line);
+  // Tools that only inspect state and can run concurrently and speculatively.
+  // Reads of paths outside the current directory are not, so they are
+  // confirmed like side effects before their output reaches a provider.
+  static bool is_read_only(const std::string &invocation);
+  // Runs a read-only tool without touching agent state; thread-safe
+  static std::string run_read_only(const std::string &invocation);
+  // Runs write:, replace:, cmd:, github:sync: or a read outside the current
+  // directory without asking; callers confirm first
+  static std::string run_side_effect(const std::string &invocation);
+};
+
+// Runs the tool invocations of one agent step. Read-only tools run
+// concurrently on the shared worker pool from the moment they are
+// submitted; side-effecting ones run one at a time in submission order, each
+// after every tool submitted before it has finished, and tools submitted
+// after a side effect wait for it. Results come back in submission order.
+class ToolScheduler {
+private:
+  struct Entry {
+    std::string invocation;
+    bool read_only{true};
+    std::optional<std::future<std::string>> output; // Set once started
+    std::chrono::steady_clock::time_point deadline{};
+  };
+
+  std::vector<Entry> entries_;
+  // Reads reported as timed out by an earlier collect() but still running
+  std::vector<std::future<std::string>> abandoned_;
+  std::size_t max_tools_;
+  bool has_side_effects_{false};
+
+  static void start(Entry &entry);
+  static std::string wait(Entry &entry);
+  // Like wait, but a side effect past its timeout is still waited for, so
+  // the next one never starts while it is changing things
+  static std::string finish(Entry &entry);
+  // Waits for timed-out reads still running, so none of them sees a side
+  // effect half-applied; they also keep their worker pool slot until then
+  void settle_abandoned_reads();
+
+public:
+  explicit ToolScheduler(std::size_t max_tools = 8);
+
+  // Queues `invocation`; false if it is a duplicate or over the limit
+  bool submit(const std::string &invocation);
+  [[nodiscard]] bool empty() const { return entries_.empty(); }
+  // Side-effecting invocations in submission order
+  [[nodiscard]] std::vector<std::string> side_effects() const;
+  // Waits for every tool; side effects are reported as skipped unless
+  // `run_side_effects`. A read still running at its timeout reports that,
+  // but the next side effect, here or in a later step, waits for it to end;
+  // a side effect that overruns is reported once it has finished.
+  std::vector<ToolResult> collect(bool run_side_effects);
+
+  // How long a tool may take before its result is given up on
+  static std::chrono::milliseconds timeout_for(const std::string &invocation);
+};
+
+// Watches streamed model output and submits each tool invocation as soon as
+// its line is complete, while the rest of the response is still being
+// generated.
+class SpeculativeToolRunner {
+private:
+  ToolScheduler &scheduler_;
+  std::string line_;
+
+  void on_line(std::string_view line);
+
+public:
+  explicit SpeculativeToolRunner(ToolScheduler &scheduler)
+      : scheduler_(scheduler) {}
+
+  void feed(std::string_view chunk);
+  // Handles a final line without a trailing newline
+  void finish();
+};
+
+} // namespace Core
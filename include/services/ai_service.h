@@ -1,6 +1,12 @@
 #pragma once
+#include "services/telemetry_service.h"
+#include "utils/json_stream.h"
+#include <atomic>
+#include <functional>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <string_view>
+#include <vector>
 
 // Forward declarations
 namespace Core {
@@ -8,24 +14,77 @@ enum class AgentMode : std::uint8_t;
 }
 
 namespace Services {
+// Append-only conversation kept for local Ollama models: each request
+// repeats the previous one's messages unchanged, so the server can reuse
+// its KV cache for the whole prefix instead of re-evaluating it.
+struct ChatSession {
+  bool active{false};
+  std::size_t key{0};                // Identifies the context it was built on
+  std::string context;               // Frozen into the system message
+  std::vector<std::string> messages; // Alternating user/assistant turns
+  long long cached_tokens{0};        // Tokens the server holds for it
+};
+
 class AIService {
 private:
   Core::AgentMode mode_;
   std::string api_key_;
+  TokenUsage last_usage_{};
+  long long last_eval_duration_ns_{0}; // Reported by Ollama, 0 otherwise
+  ChatSession session_;
+  std::function<void(std::string_view)> content_observer_;
 
   [[nodiscard]] bool is_online_mode() const;
-  nlohmann::json create_standard_payload(const std::string &model,
-                                         const std::string &user_input,
-                                         const std::string &context);
-  nlohmann::json create_payload(const std::string &user_input,
-                                const std::string &context);
+  // Request body referencing the caller's strings; they must outlive it
+  [[nodiscard]] Utils::JsonRope
+  create_payload(const std::string &user_input,
+                 const std::vector<std::string_view> &context) const;
+  [[nodiscard]] Utils::JsonRope
+  create_session_payload(const std::string &user_input) const;
+  [[nodiscard]] std::string_view get_local_model() const;
   std::string get_api_url();
-  std::string parse_cerebras_stream(const std::string &response);
+  // Sends the request and decodes the reply; fills `turn_metrics` on success
+  std::string complete(Utils::JsonRope &payload,
+                       TurnMetrics *turn_metrics = nullptr);
+  // JSON paths pulled out of the (possibly streamed) response body
+  [[nodiscard]] std::vector<std::string> get_response_fields() const;
+  bool record_usage_field(std::string_view path, std::string_view value);
 
 public:
   AIService(Core::AgentMode mode, const std::string &api_key = "");
 
   std::string chat(const std::string &user_input, const std::string &context);
+  // Same as above with the context given as pieces that are sent in order,
+  // so callers need not concatenate large context strings first
+  std::string chat(const std::string &user_input,
+                   const std::vector<std::string_view> &context);
   bool is_available();
+
+  // Local models only: continue the running session while `session_key`
+  // (a digest of the long-lived context) is unchanged, sending just the new
+  // prompt after the cached prefix; otherwise start over from `context`.
+  // `recent` holds interactions the context gained since the last turn;
+  // a continued session gets them ahead of the prompt. Other modes fall
+  // back to chat().
+  std::string chat_in_session(const std::string &user_input,
+                              const std::vector<std::string_view> &context,
+                              std::size_t session_key,
+                              std::string_view recent = {});
+  [[nodiscard]] bool supports_session() const;
+  void reset_session();
+
+  // Opens the provider connection ahead of the first chat and, for Ollama,
+  // loads the model into memory. Blocking; meant for a background thread.
+  bool warm_up(const std::atomic<bool> &cancelled);
+
+  // Called with each piece of response text as it is decoded, before the
+  // reply is complete; pass nullptr to stop observing
+  void set_content_observer(std::function<void(std::string_view)> observer) {
+    content_observer_ = std::move(observer);
+  }
+
+  // Usage reported by the provider for the most recent chat() call
+  [[nodiscard]] const TokenUsage &get_last_usage() const { return last_usage_; }
+  [[nodiscard]] std::string get_provider_name() const;
 };
 } // namespace Services
@@ -1,7 +1,9 @@
 #pragma once
+#include "services/rate_limiter.h"
 #include <array>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -27,6 +29,8 @@ private:
   static constexpr size_t ITERATIONS = 100000; // Key derivation iterations
 
   static std::map<std::string, AuthProvider> providers;
+  // Held while `providers` changes; worker threads copy it under this lock
+  static std::mutex providers_mutex;
   static std::string active_provider;
   static std::vector<unsigned char> encryption_key;
   static std::string key_file_path;
@@ -37,6 +41,8 @@ private:
   static std::string
   decrypt_credential(const std::string &encrypted_credential);
   static void initialize_default_providers();
+  // The built-in providers, without touching `providers`
+  static std::map<std::string, AuthProvider> default_providers();
 
   // Secure key management
   static bool initialize_encryption_key();
@@ -72,6 +78,10 @@ public:
   static bool
   update_provider_config(const std::string &provider_name,
                          const std::map<std::string, std::string> &config);
+  // Per-host request/token budgets from each provider's additional_config,
+  // keyed by the host of its base_url. Reads the saved configuration
+  // without decrypting credentials, so it works before initialize().
+  static std::map<std::string, RateLimitConfig> load_rate_limits();
 
   // Health checks
   static bool test_provider_connection(const std::string &provider_name);
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Services {
+
+// Trigram index of the text files under a directory, in the style of
+// codesearch: every three-byte sequence (ASCII case folded) maps to the
+// files containing it, so a search only has to read the files holding all
+// trigrams of the pattern's required literals. Kept in one binary file and
+// brought up to date by comparing sizes and mtimes: changed files get a new
+// id and their old postings are skipped until the index is compacted.
+class CodeIndex {
+public:
+  CodeIndex(std::string root, std::string index_path);
+
+  // Reads the stored index; false if there is none for this root
+  bool load();
+  // Indexes new and changed files (in parallel) and forgets deleted ones,
+  // only under `subtree` (relative to the root) when given; true if
+  // anything changed
+  bool refresh(const std::string &subtree = "");
+  bool save() const;
+
+  // Files that may hold a match of the ECMAScript `pattern`, as paths
+  // relative to the root; nullopt unless can_narrow(pattern). Files too
+  // large to index are always included.
+  [[nodiscard]] std::optional<std::vector<std::string>>
+  candidates(const std::string &pattern) const;
+  [[nodiscard]] std::size_t size() const { return by_path_.size(); }
+
+  // Whether every match of `pattern` needs a literal of three or more
+  // bytes, so that trigrams can rule files out
+  static bool can_narrow(const std::string &pattern);
+
+private:
+  struct File {
+    std::string path; // Relative to the root, generic format
+    std::int64_t modified{0};
+    std::uint64_t size{0};
+    bool live{true};
+    bool indexed{true}; // False for files over the size limit
+  };
+
+  std::string root_;
+  std::string index_path_;
+  std::vector<File> files_; // By id
+  std::unordered_map<std::string, std::uint32_t> by_path_; // Live files
+  std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> postings_;
+  std::size_t dead_files_{0};
+
+  void compact();
+};
+
+} // namespace Services
@@ -1,4 +1,13 @@
 #pragma once
+#include "services/code_index.h"
+#include "utils/line_index.h"
+#include "utils/mapped_file.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -16,30 +25,131 @@ struct FileEditResult {
   int replacements_made{0};
 };
 
+struct ReplaceOptions {
+  // Report what would change without writing anything
+  bool dry_run{false};
+  // Occurrences every matching file must have, 0 for any number
+  int expected_per_file{0};
+  // Exact counts for particular files, keyed by path as reported in the
+  // results; a listed file must be among the matches unless its count is 0
+  std::map<std::string, int> expected_counts{};
+};
+
+struct FileReplacement {
+  std::string file_path{};
+  int replacements{0};
+  std::string preview{}; // Changed lines, in a dry run
+};
+
+struct BatchEditResult {
+  bool success{};
+  std::string message{};
+  int replacements_made{0};
+  std::vector<FileReplacement> files{}; // Sorted by path
+};
+
 class FileService {
+private:
+  struct CachedLineIndex {
+    Utils::MappedFile::Identity identity{};
+    Utils::LineIndex index;
+    std::uint64_t last_used{0};
+  };
+
+  static std::map<std::string, CachedLineIndex> line_indexes;
+  static std::uint64_t line_index_clock;
+  static std::mutex line_index_mutex;
+
+  // Index of the file at `path`, rebuilt when the file has changed;
+  // requires line_index_mutex
+  static Utils::LineIndex &
+  line_index_for(const std::string &path,
+                 const Utils::MappedFile::Identity &identity);
+
+  struct CodeIndexEntry {
+    std::unique_ptr<CodeIndex> index;
+    std::mutex mutex; // Held while the index is refreshed and queried
+    bool loaded{false};
+    std::uint64_t last_used{0};
+  };
+
+  // By index file; shared so that an evicted index can finish a search
+  static std::map<std::string, std::shared_ptr<CodeIndexEntry>> code_indexes;
+  static std::uint64_t code_index_clock;
+  static std::string code_index_directory; // Empty when indexing is off
+  static bool code_index_configured;
+  static std::mutex code_index_mutex;
+
+  // Files under `directory` (relative paths) that may match `pattern`,
+  // from the index of the nearest enclosing directory that has one (or a
+  // new one of its own), brought up to date first; nullopt when the index
+  // is off or the pattern has no literal to narrow by
+  static std::optional<std::vector<std::string>>
+  indexed_candidates(const std::string &directory,
+                     const std::string &pattern);
+
 public:
   // Basic file operations
   static std::string read_file(const std::string &filename);
+  // Lines [start_line, start_line + line_count) of any size of file,
+  // through a memory mapping and a line index kept per file
   static std::string read_file_range(const std::string &filename,
                                      int start_line = 0, int line_count = -1);
+  // Writes to a temporary file, flushes it to disk and renames it over
+  // `filename`, so the file is either unchanged or entirely new
   static std::string write_file(const std::string &filename,
                                 const std::string &content);
   static bool file_exists(const std::string &filename);
   static std::string get_file_extension(const std::string &filename);
 
   // Advanced file operations
+  // Replaces every occurrence in one pass over a mapping of the file, so
+  // there is no size limit, and commits like write_file; nothing is
+  // written unless the count matches a positive `expected_replacements`
   static FileEditResult replace_text_in_file(const std::string &filename,
                                              const std::string &old_text,
                                              const std::string &new_text,
                                              int expected_replacements = 1);
+  // Replaces `old_text` in every text file matching `glob`, where `*` and
+  // `?` stay within a path component and `**/` spans directories (a plain
+  // directory means all of its files). Files are scanned and staged as
+  // temporary files in parallel and only renamed into place once every one
+  // has been written and meets its expected count; otherwise nothing
+  // changes.
+  static BatchEditResult replace_in_files(const std::string &glob,
+                                          const std::string &old_text,
+                                          const std::string &new_text,
+                                          const ReplaceOptions &options = {});
   static std::vector<FileSearchResult>
   search_in_file(const std::string &filename, const std::string &pattern,
                  bool case_sensitive = false);
+  // Matches sorted by file and line
   static std::vector<FileSearchResult>
   search_in_directory(const std::string &directory, const std::string &pattern,
                       const std::string &file_filter = "*",
                       bool case_sensitive = false);
 
+  // Receives each match as soon as it is found, one call at a time but from
+  // any thread and in no particular file order; returning false stops the
+  // search
+  using SearchCallback = std::function<bool(const FileSearchResult &)>;
+  // Searches the tree on several threads that steal directories and files
+  // from each other, or only the files the trigram index leaves. Lines are
+  // only handed to the regex when they contain a literal every match
+  // needs; false if the pattern is invalid.
+  static bool search_in_directory(const std::string &directory,
+                                  const std::string &pattern,
+                                  const std::string &file_filter,
+                                  bool case_sensitive,
+                                  const SearchCallback &on_match);
+
+  // Where directory searches keep their trigram indexes, one file per
+  // searched tree; files unused for a month, or beyond the newest 32, are
+  // deleted here. Configured on first use otherwise:
+  // LLAMAWARE_CODE_INDEX=directory|off (default data/index).
+  static void configure_code_index(const std::string &directory,
+                                   bool enable = true);
+
   // Utility functions
   [[nodiscard]] static bool is_text_file(const std::string &filename);
   static std::string get_relative_path(const std::string &filepath,
@@ -1,12 +1,17 @@
 #pragma once
 
 #include "services/web_service.h"
+#include <chrono>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace Services {
 
+class IssueMirror;
+
 struct GitHubIssue {
   int number{0};
   std::string title{};
@@ -15,6 +20,8 @@ struct GitHubIssue {
   std::vector<std::string> labels{};
   std::vector<std::string> assignees{};
   int milestone{0};
+  std::string updated_at{}; // ISO 8601, so it sorts as text
+  bool pull_request{false}; // The issues API lists pull requests too
 };
 
 struct GitHubPR {
@@ -34,6 +41,24 @@ private:
   static WebResponse make_github_request(const std::string &endpoint,
                                          const std::string &method = "GET",
                                          const std::string &body = "");
+  // Every page of a list endpoint, 100 items each: the first page's Link
+  // header names the last page, and the others are then fetched
+  // concurrently. Pages come back in order, cut after the first failure.
+  static std::vector<WebResponse> fetch_pages(const std::string &endpoint,
+                                              int max_pages);
+
+  struct MirrorState {
+    std::unique_ptr<IssueMirror> mirror;
+    std::chrono::steady_clock::time_point synced_at{};
+  };
+  // Loaded issue mirrors by "owner/repo"; mirror_mutex also serializes syncs
+  static std::map<std::string, MirrorState> mirrors;
+  static std::mutex mirror_mutex;
+  // Callers hold mirror_mutex
+  static MirrorState &mirror_for(const std::string &owner,
+                                 const std::string &repo);
+  static std::string sync_mirror(const std::string &owner,
+                                 const std::string &repo, MirrorState &state);
 
 public:
   GitHubService() = delete;
@@ -76,10 +101,18 @@ public:
                              const std::vector<std::string> &events);
   static std::string run_health_check(const std::string &owner,
                                       const std::string &repo);
+  // Fetches issues and pull requests updated since the last sync into the
+  // local mirror (data/github/<owner>/<repo>); the first sync fetches all
+  static std::string sync_issue_mirror(const std::string &owner,
+                                       const std::string &repo);
+  // Ranked lookup in the local mirror, synced first if it is not current
   static std::string find_related_issues(const std::string &owner,
                                          const std::string &repo,
                                          const std::string &text);
   static bool is_available();
+
+  // Page number of the rel="last" link in a Link header; 1 if there is none
+  static int last_page(const std::string &link_header);
 };
 
 } // namespace Services
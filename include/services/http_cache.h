@@ -0,0 +1,62 @@
+#pragma once
+#include "services/web_service.h"
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace Services {
+
+// Private HTTP cache for GETs in the spirit of RFC 9111. Responses are kept
+// on disk (metadata as JSON, body as a raw file) and served while fresh per
+// Cache-Control max-age, Expires or the Last-Modified heuristic; stale ones
+// are revalidated with If-None-Match / If-Modified-Since, and a 304 renews
+// the stored copy. "no-store" responses and Vary: * are never kept.
+// Served responses are marked from_cache and carry "X-Cache: HIT" or
+// "X-Cache: REVALIDATED".
+// Configured on first use: LLAMAWARE_HTTP_CACHE=directory|off (default
+// data/http_cache). Bypassed while an HTTP cassette is active, so that
+// recordings capture every request.
+class HttpCache {
+private:
+  struct Entry {
+    std::string url;
+    WebResponse response{};
+    long long stored_at{0};    // Unix seconds
+    long long initial_age{0};  // Age header when stored
+    long long lifetime{0};     // Freshness lifetime in seconds
+  };
+
+  static std::string directory;
+  static bool enabled;
+  static bool configured;
+  static std::mutex cache_mutex;
+
+  static void ensure_configured();
+  static std::string path_for(const std::string &key);
+  static std::optional<Entry> load(const std::string &key);
+  static void store(const std::string &key, const Entry &entry);
+  static void remove_expired();
+
+public:
+  using Perform = std::function<WebResponse(const HeaderMap &headers)>;
+
+  HttpCache() = delete;
+
+  // `directory` is created on demand; stale entries older than a week are
+  // dropped here
+  static void configure(const std::string &new_directory, bool enable = true);
+  [[nodiscard]] static bool is_enabled();
+
+  // Serves `url` from the cache or through `perform`, which receives
+  // `headers` plus any conditional headers and performs the actual GET
+  static WebResponse fetch(const std::string &url, const HeaderMap &headers,
+                           const Perform &perform);
+
+  // Freshness lifetime in seconds of a response stored at `now` (Unix
+  // seconds); 0 when it must be revalidated before every use
+  static long long freshness_lifetime(const HeaderMap &headers,
+                                      long long now);
+};
+
+} // namespace Services
@@ -0,0 +1,85 @@
+#pragma once
+#include "services/web_service.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Services {
+
+enum class CassetteMode : std::uint8_t { Off, Record, Replay };
+enum class ReplayLatency : std::uint8_t { Original, Zero };
+
+// VCR-style record/replay of every HTTP exchange WebService makes, so agent
+// runs can be benchmarked reproducibly and offline. A cassette is a JSON
+// Lines file with one response per line, keyed by method, URL (credentials
+// in the query string redacted) and a hash of the request body. Responses
+// to the same request replay in recorded order, the last one repeating.
+// Configured from the environment on first use:
+//   LLAMAWARE_CASSETTE=path  LLAMAWARE_CASSETTE_MODE=record|replay
+//   LLAMAWARE_CASSETTE_LATENCY=original|zero
+class HttpCassette {
+private:
+  struct Chunk {
+    long long offset_ms{0}; // Since the request started
+    std::size_t length{0};
+  };
+  struct Interaction {
+    WebResponse response{};
+    long long elapsed_ms{0};
+    std::vector<Chunk> chunks; // Streamed responses only
+  };
+
+  static CassetteMode mode;
+  static ReplayLatency latency;
+  static std::map<std::string, std::deque<Interaction>> recorded;
+  static std::ofstream recording;
+  static std::mutex cassette_mutex;
+  static bool configured;
+
+  // Callers hold cassette_mutex
+  static void ensure_configured();
+  static bool configure_locked(CassetteMode new_mode, const std::string &path,
+                               ReplayLatency new_latency);
+  static std::string key_for(const std::string &method,
+                             const std::string &url, const std::string &body);
+  static bool next_interaction(const std::string &key, Interaction &out);
+  static void save(const std::string &key, const Interaction &interaction);
+  static void wait_until(std::chrono::steady_clock::time_point start,
+                         long long offset_ms);
+
+public:
+  using Perform = std::function<WebResponse()>;
+  using PerformStream = std::function<WebResponse(const StreamCallback &)>;
+
+  HttpCassette() = delete;
+
+  // Loads `path` for replay or truncates it for recording
+  static bool configure(CassetteMode new_mode, const std::string &path,
+                        ReplayLatency new_latency = ReplayLatency::Original);
+  [[nodiscard]] static bool active();
+  [[nodiscard]] static bool is_replaying();
+  // Replaying without the recorded delays; retry waits are skipped too
+  [[nodiscard]] static bool is_instant();
+
+  // Runs `perform` (recording its result) or replays the recorded result
+  static WebResponse exchange(const std::string &method,
+                              const std::string &url, const std::string &body,
+                              const Perform &perform);
+  // Same for streamed bodies; chunks are replayed at their recorded times
+  static WebResponse exchange_stream(const std::string &method,
+                                     const std::string &url,
+                                     const std::string &body,
+                                     const StreamCallback &on_chunk,
+                                     const PerformStream &perform);
+
+  // "api_key=sk-1" becomes "api_key=REDACTED" (also key, token, ...)
+  static std::string redact_url(const std::string &url);
+};
+
+} // namespace Services
@@ -0,0 +1,49 @@
+#pragma once
+#include "services/github_service.h"
+#include "utils/text_index.h"
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Services {
+
+// Local copy of a repository's issues and pull requests, stored as JSON
+// Lines under <root>/<owner>/<repo>/issues.jsonl and searchable through an
+// inverted index. Updates are appended (the last line for a number wins)
+// and the file is compacted once most of it is superseded.
+class IssueMirror {
+public:
+  IssueMirror(const std::string &owner, const std::string &repo,
+              const std::string &root = "data/github");
+
+  // Reads the stored issues and indexes them; false if nothing is stored
+  bool load();
+  // Records issues fetched from GitHub, new or updated, and persists them
+  void apply(const std::vector<GitHubIssue> &issues);
+
+  // Issues most similar to `text` (title weighted over body), best first
+  [[nodiscard]] std::vector<const GitHubIssue *>
+  related(const std::string &text, std::size_t limit) const;
+
+  // Newest updated_at mirrored so far; the `since` of the next sync
+  [[nodiscard]] const std::string &last_updated() const {
+    return last_updated_;
+  }
+  [[nodiscard]] std::size_t size() const { return issues_.size(); }
+
+  // Owner and repository names that are safe to use as directory names
+  static bool is_valid_name(const std::string &name);
+
+private:
+  std::string directory_;
+  std::map<int, GitHubIssue> issues_;
+  Utils::TextIndex index_;
+  std::string last_updated_;
+  std::size_t stored_lines_{0};
+
+  void index_issue(const GitHubIssue &issue);
+  void compact();
+};
+
+} // namespace Services
@@ -0,0 +1,85 @@
+#pragma once
+#include "services/web_service.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace Services {
+
+// Budgets for one host; 0 means unlimited. Key budgets apply separately to
+// every credential (Authorization / X-API-Key value) used against the host.
+struct RateLimitConfig {
+  double host_requests_per_minute{0.0};
+  double requests_per_minute{0.0}; // Per API key
+  double tokens_per_minute{0.0};   // Per API key
+  // Replaces requests_per_minute for requests without a credential, for
+  // hosts that meter those by the hour (GitHub)
+  double anonymous_requests_per_hour{0.0};
+};
+
+// Client-side token buckets that make callers queue locally instead of
+// tripping provider or GitHub rate limits. Limits come from each
+// AuthProvider's additional_config in data/auth_config.json:
+//   "host_requests_per_minute", "requests_per_minute", "tokens_per_minute"
+class RateLimiter {
+private:
+  struct Bucket {
+    double capacity{0.0};
+    double available{0.0};
+    double refill_per_second{0.0};
+    std::chrono::steady_clock::time_point updated{};
+  };
+
+  static std::map<std::string, RateLimitConfig> host_limits;
+  static std::map<std::string, Bucket> buckets;
+  static std::mutex limiter_mutex;
+  static std::once_flag configured;
+
+  // Loads the limits exactly once, however many threads arrive at once
+  static void ensure_configured();
+  static std::string credential_of(const HeaderMap &headers);
+  // A bucket holding one `window_seconds` worth of requests or tokens
+  static Bucket &bucket_for(const std::string &key, double per_window,
+                            double window_seconds = 60.0);
+  // The per-key request bucket, or nullptr when requests are unlimited
+  static Bucket *request_bucket(const std::string &host,
+                                const RateLimitConfig &limits,
+                                const HeaderMap &headers);
+  static void refill(Bucket &bucket,
+                     std::chrono::steady_clock::time_point now);
+
+public:
+  RateLimiter() = delete;
+
+  // Blocks until a request to `url` with `headers`, costing an estimated
+  // `tokens`, fits the host and API-key budgets. If that would take longer
+  // than `max_wait`, nothing is charged and a 429 response with Retry-After
+  // is returned for the caller to report instead.
+  [[nodiscard]] static std::optional<WebResponse>
+  acquire(const std::string &url, const HeaderMap &headers,
+          double tokens = 0.0,
+          std::chrono::milliseconds max_wait = std::chrono::seconds(30));
+  // Charges tokens learned after the fact (e.g. actual usage minus the
+  // estimate); may drive the bucket negative so later requests wait
+  static void consume_tokens(const std::string &url, const HeaderMap &headers,
+                             double tokens);
+
+  // Gives back the per-key request charged by acquire() for a request the
+  // provider did not bill, such as a conditional GET answered with 304
+  static void refund_request(const std::string &url,
+                             const HeaderMap &headers);
+
+  // Rough prompt size for a request body before the provider reports usage
+  static double estimate_tokens(std::size_t body_bytes) {
+    return static_cast<double>(body_bytes) / 4.0;
+  }
+
+  static void configure_host(const std::string &host,
+                             const RateLimitConfig &config);
+  // Re-reads limits from the auth configuration and resets all buckets
+  static void reload();
+};
+
+} // namespace Services
@@ -0,0 +1,58 @@
+#pragma once
+#include "services/web_service.h"
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace Services {
+
+struct RetryPolicy {
+  int max_attempts{4};
+  std::chrono::milliseconds base_delay{500};
+  // Longest single wait; a server asking for more is treated as final
+  std::chrono::milliseconds max_delay{30000};
+};
+
+// Retries transient HTTP failures (429, 502-504, connection errors) with
+// decorrelated-jitter backoff. State is shared by every caller: a host that
+// asked us to back off holds all requests to it until the deadline, and a
+// process-wide retry budget stops retries once most requests are failing.
+class RetryScheduler {
+private:
+  struct HostState {
+    std::chrono::steady_clock::time_point blocked_until{};
+  };
+
+  static std::map<std::string, HostState> hosts;
+  static double retry_tokens;
+  static std::mutex retry_mutex;
+
+  static bool acquire_retry_token();
+  static void record_success();
+
+public:
+  RetryScheduler() = delete;
+
+  // Runs `attempt` until it returns a non-retryable response or the policy
+  // or shared budget is exhausted; the last response is returned as is.
+  static WebResponse execute(const std::string &url,
+                             const std::function<WebResponse()> &attempt,
+                             const RetryPolicy &policy = {});
+
+  static bool is_retryable(const WebResponse &response);
+  // Wait requested via Retry-After, or else on a 429/403 via the
+  // x-ratelimit-reset[-*] headers of limits whose matching
+  // x-ratelimit-remaining[-*] is 0
+  static std::optional<std::chrono::milliseconds>
+  server_delay(const WebResponse &response);
+  // Decorrelated jitter: uniform in [base, previous * 3], capped
+  static std::chrono::milliseconds
+  next_backoff(std::chrono::milliseconds previous, const RetryPolicy &policy);
+
+  static void reset();
+};
+
+} // namespace Services
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Forward declarations
+namespace Core {
+enum class AgentMode : std::uint8_t;
+}
+
+namespace Services {
+
+struct SummaryOptions {
+  std::size_t chunk_tokens{0}; // 0 picks a size suited to the provider
+  std::size_t max_parallel{0}; // Concurrent model calls; 0 as above
+  std::size_t max_chunks{48};  // Text beyond this many chunks is dropped
+  // Appended to each request, e.g. the question the summary should serve
+  std::string focus;
+};
+
+struct SummaryResult {
+  std::string summary;
+  std::size_t chunks{0};
+  // Chunks whose summary failed; a successful summary then covers only
+  // the others and says so
+  std::size_t failed_chunks{0};
+  long long total_tokens{0};
+  bool success{false};
+};
+
+// Map-reduce summarization for inputs larger than one prompt: the text is
+// split into chunks that are summarized concurrently, one model call each,
+// and the partial summaries are combined (again in chunks if they are still
+// too long) into a single summary.
+class SummaryService {
+public:
+  SummaryService() = delete;
+
+  // Splits at paragraph, then line, then word boundaries; the pieces view
+  // `text` and together cover it exactly
+  static std::vector<std::string_view> split_chunks(std::string_view text,
+                                                    std::size_t max_chars);
+
+  static SummaryResult summarize(Core::AgentMode mode,
+                                 const std::string &api_key,
+                                 const std::string &label,
+                                 std::string_view text,
+                                 const SummaryOptions &options = {});
+};
+
+} // namespace Services
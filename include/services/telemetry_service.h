@@ -0,0 +1,59 @@
+#pragma once
+#include "utils/histogram.h"
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace Services {
+
+struct TokenUsage {
+  long long prompt_tokens{0};
+  long long completion_tokens{0};
+
+  [[nodiscard]] long long total_tokens() const {
+    return prompt_tokens + completion_tokens;
+  }
+};
+
+struct TurnMetrics {
+  std::string provider{};
+  TokenUsage usage{};
+  double ttft_ms{0.0};  // Time until the first content token arrived
+  double total_ms{0.0}; // Wall time for the whole request
+  double tokens_per_second{0.0};
+  bool success{false};
+};
+
+struct ProviderTelemetry {
+  long long requests{0};
+  long long failures{0};
+  long long prompt_cache_hits{0}; // Turns that reused a cached prompt prefix
+  TokenUsage usage{};
+  Utils::Histogram ttft_ms{1000.0};
+  Utils::Histogram total_ms{1000.0};
+  Utils::Histogram tokens_per_second{100.0};
+};
+
+class TelemetryService {
+private:
+  static std::map<std::string, ProviderTelemetry> providers;
+  static std::mutex telemetry_mutex;
+
+  static std::string get_telemetry_path();
+
+public:
+  TelemetryService() = delete;
+
+  static void record_turn(const TurnMetrics &metrics);
+  static void record_prompt_cache_hit(const std::string &provider);
+  static TokenUsage get_total_usage();
+  static void reset();
+
+  // Human-readable summary for /stats
+  static std::string format_summary();
+  // Machine-readable dump (JSON) of all counters and percentiles
+  static std::string to_json_string();
+  static bool export_json(const std::string &export_path = "");
+};
+
+} // namespace Services
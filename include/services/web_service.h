@@ -1,7 +1,15 @@
 #pragma once
+#include "utils/json_stream.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
 #include <map>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
 
 // Local case-insensitive comparison function for headers
 struct CaseInsensitiveCompare {
@@ -19,19 +27,67 @@ using HeaderMap = std::map<std::string, std::string, CaseInsensitiveCompare>;
 
 namespace Services {
 struct WebResponse {
-  int status_code;
+  int status_code{0};
   std::string content;
   std::string content_type;
   HeaderMap headers;
-  bool success;
+  bool success{false};
   std::string error_message;
+  // Body deliberately cut short (fetch_url_stream); such responses are not
+  // cached
+  bool partial{false};
+  // Served by HttpCache from its stored copy rather than by the origin,
+  // which may send an X-Cache header of its own
+  bool from_cache{false};
+};
+
+// Receives response body bytes as they arrive off the wire
+using StreamCallback = std::function<void(std::string_view chunk)>;
+// Same for GETs; returning false ends the download early. `content_type` is
+// the response's Content-Type, empty if the server (or a cassette) gave none
+using FetchCallback = std::function<bool(std::string_view chunk,
+                                         const std::string &content_type)>;
+
+struct FetchManyOptions {
+  std::size_t max_per_host{6};   // Connections per host; HTTP/2 multiplexes
+  std::size_t max_connections{16};
+  // For the whole batch; unfinished transfers fail with "Deadline exceeded"
+  std::chrono::milliseconds deadline{30000};
 };
 
 class WebService {
 private:
   static std::string get_api_key();
-  static std::string extract_text_content(const std::string &html);
-  static std::string sanitize_content(const std::string &content);
+  // Single attempts; the public versions retry through RetryScheduler
+  static WebResponse fetch_with_headers_once(const std::string &url,
+                                             const HeaderMap &headers);
+  static WebResponse post_json_once(const std::string &url,
+                                    const std::string &json_body,
+                                    const HeaderMap &headers);
+  // Network paths behind the record/replay layer (HttpCassette)
+  static WebResponse fetch_url_live(const std::string &url,
+                                    const HeaderMap &headers);
+  static WebResponse post_json_stream_live(const std::string &url,
+                                           Utils::JsonRope &body,
+                                           const HeaderMap &headers,
+                                           const StreamCallback &on_chunk);
+  // Identical GETs in flight share one transfer (single-flight): callers
+  // arriving while `key` is being fetched wait for that response
+  static std::map<std::string, std::shared_future<WebResponse>> in_flight;
+  static std::mutex in_flight_mutex;
+  static WebResponse single_flight(const std::string &key,
+                                   const std::function<WebResponse()> &perform);
+  // `variant` names the calling path: paths differ in timeouts, retries
+  // and what they make of the body, so they never share a transfer
+  static std::string request_key(std::string_view variant,
+                                 const std::string &url,
+                                 const HeaderMap &headers);
+  static WebResponse fetch_url_stream_live(const std::string &url,
+                                           const HeaderMap &headers,
+                                           const StreamCallback &on_chunk,
+                                           const bool &enough,
+                                           std::size_t max_bytes,
+                                           std::string &content_type);
 
 public:
   // Existing search functionality
@@ -40,13 +96,58 @@ public:
 
   // New web fetch capabilities
   static WebResponse fetch_url(const std::string &url);
-  static std::string fetch_text(const std::string &url);
+  // GET that hands body chunks to `on_chunk` instead of buffering them and
+  // stops once it returns false or `max_bytes` have arrived; stopping early
+  // still counts as success. The WebResponse carries the body only when it
+  // was read to the end, and is marked `partial` otherwise.
+  static WebResponse fetch_url_stream(const std::string &url,
+                                      const FetchCallback &on_chunk,
+                                      std::size_t max_bytes,
+                                      const HeaderMap &headers = {});
+  // GETs all `urls` concurrently on one event loop (HTTP/2 where offered,
+  // compressed transfers decoded); responses come back in `urls` order
+  static std::vector<WebResponse>
+  fetch_many(const std::vector<std::string> &urls,
+             const FetchManyOptions &options = {});
+  // Readable text of a fetched response, as fetch_text produces it
+  static std::string response_text(const WebResponse &response,
+                                   std::size_t max_length = 8000,
+                                   bool main_content_only = true);
+  // Readable text of the page, cut off after `max_length` characters. For
+  // HTML only the main content is kept unless `main_content_only` is false.
+  // The page is extracted while it downloads, which stops once enough text
+  // is in hand. Goes through HttpCache, RetryScheduler and single-flight
+  // like fetch_with_headers; a cached page is extracted from the stored body.
+  static std::string fetch_text(const std::string &url,
+                                std::size_t max_length = 8000,
+                                bool main_content_only = true);
   static std::string fetch_json(const std::string &url);
   static WebResponse fetch_with_headers(const std::string &url,
                                         const HeaderMap &headers);
   static WebResponse post_json(const std::string &url,
                                const std::string &json_body,
                                const HeaderMap &headers);
+  // POST that hands body chunks to `on_chunk` instead of buffering them;
+  // the returned WebResponse carries status and headers but no content.
+  // The request body is serialized from `body` while it is being sent.
+  // There is no overall time limit, only one on stalls; a transfer cut off
+  // after the status line keeps its status but is not a success.
+  static WebResponse post_json_stream(const std::string &url,
+                                      Utils::JsonRope &body,
+                                      const HeaderMap &headers,
+                                      const StreamCallback &on_chunk);
   static bool is_valid_url(const std::string &url);
+  // "host[:port]" part of a URL
+  static std::string get_host(const std::string &url);
+
+  // Sets up the connection pool shared by chat requests; libcurl's global
+  // init is not thread-safe, so call this before starting warm_up() threads
+  static void initialize_connection_pool();
+  // Resolves and connects to `url`'s host into the shared pool, sending
+  // `json_body` as a POST when given (HEAD otherwise). Aborts as soon as
+  // `cancelled` is set; success means the connection was established.
+  static WebResponse warm_up(const std::string &url,
+                             const std::string &json_body,
+                             const std::atomic<bool> &cancelled);
 };
 } // namespace Services
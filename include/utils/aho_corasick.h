@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Utils {
+
+// Finds any of a set of literal strings in a single pass over the text,
+// however many there are (Aho-Corasick over a dense transition table with
+// bytes grouped into classes). Can ignore ASCII case and can require word
+// boundaries around a match, meaning the same as \b on both sides of the
+// literal in a regex. While no pattern is under way, bytes that cannot
+// start one are skipped 16 at a time with SSE2.
+class AhoCorasick {
+public:
+  struct Match {
+    std::size_t position;
+    std::size_t length;
+    std::size_t pattern; // Index into the constructor's patterns
+  };
+
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  // Empty patterns are ignored
+  explicit AhoCorasick(const std::vector<std::string> &patterns,
+                       bool case_sensitive = true, bool whole_words = false);
+
+  // The match that ends first at or after `from`, the longest of those
+  // ending at the same byte; position npos if there is none
+  [[nodiscard]] Match find(std::string_view text, std::size_t from = 0) const;
+  [[nodiscard]] bool contains(std::string_view text) const {
+    return find(text).position != npos;
+  }
+
+private:
+  std::array<std::uint8_t, 256> classes_{}; // Byte to class; 0 is "other"
+  std::size_t class_count_{1};
+  std::vector<std::uint32_t> transitions_;   // State * class_count_ + class
+  std::vector<std::int32_t> output_;         // Longest pattern ending here
+  std::vector<std::uint32_t> dictionary_link_; // Next state with an output
+  std::vector<std::size_t> lengths_;           // By pattern
+  std::vector<char> start_bytes_; // Bytes leaving the root, if few of them
+  bool whole_words_;
+
+  [[nodiscard]] std::size_t skip_to_start(std::string_view text,
+                                          std::size_t from) const;
+};
+
+} // namespace Utils
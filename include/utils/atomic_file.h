@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Utils {
+
+// A file written under a temporary name next to its target and renamed over
+// it once complete and on disk, so a reader or a crash only ever sees the
+// old contents or all of the new ones. Discarded unless committed.
+class AtomicFile {
+public:
+  AtomicFile() = default;
+  ~AtomicFile();
+  AtomicFile(AtomicFile &&other) noexcept;
+  AtomicFile &operator=(AtomicFile &&other) noexcept;
+  AtomicFile(const AtomicFile &) = delete;
+  AtomicFile &operator=(const AtomicFile &) = delete;
+
+  // Creates the temporary file for `target` (through a symlink, for the
+  // file it points to), with the target's permissions if it exists
+  bool open(const std::string &target);
+  // Appends the spans in order, many per system call
+  bool write(const std::vector<std::string_view> &spans);
+  bool write(std::string_view data);
+  // Flushes the contents to disk and closes the temporary file
+  bool sync();
+  // Syncs if needed and renames over the target, then flushes the
+  // directory unless the caller does so itself for a batch of files
+  bool commit(bool flush_directory = true);
+  void discard();
+
+  [[nodiscard]] const std::string &target() const { return target_; }
+
+  // Makes renames into `directory` durable (a no-op on Windows, where
+  // MoveFileEx writes through)
+  static void flush_directory(const std::string &directory);
+
+  // Why the last call failed
+  [[nodiscard]] const std::string &error() const { return error_; }
+
+private:
+  std::string target_;
+  std::string temp_path_;
+  std::string error_;
+  bool synced_{false};
+#ifdef _WIN32
+  void *handle_{nullptr}; // HANDLE of the temporary file
+#else
+  int fd_{-1};
+#endif
+
+  bool fail(const std::string &what);
+};
+
+} // namespace Utils
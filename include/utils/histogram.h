@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Utils {
+
+// HDR-style log-linear histogram. Values are scaled to integers and bucketed
+// with a fixed number of precision bits per power of two, so the relative
+// error of any reported percentile is bounded (about 1% with 7 bits) while
+// memory stays proportional to the value range's magnitude, not its size.
+class Histogram {
+private:
+  static constexpr unsigned precision_bits = 7;
+  static constexpr std::uint64_t sub_bucket_count = 1ULL << precision_bits;
+  static constexpr std::uint64_t half_bucket_count = sub_bucket_count / 2;
+
+  double scale_;
+  std::vector<std::uint64_t> counts_;
+  std::uint64_t total_count_{0};
+  std::uint64_t min_{0};
+  std::uint64_t max_{0};
+  double sum_{0.0};
+
+  static std::size_t bucket_index(std::uint64_t value);
+  static std::uint64_t bucket_midpoint(std::size_t index);
+
+public:
+  // `scale` converts recorded values into integer units, e.g. 1000.0 to keep
+  // microsecond resolution for values recorded in milliseconds.
+  explicit Histogram(double scale = 1.0) : scale_(scale) {}
+
+  void record(double value);
+  void reset();
+
+  [[nodiscard]] std::uint64_t count() const { return total_count_; }
+  [[nodiscard]] double min() const;
+  [[nodiscard]] double max() const;
+  [[nodiscard]] double mean() const;
+  [[nodiscard]] double percentile(double p) const;
+};
+
+} // namespace Utils
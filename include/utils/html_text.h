@@ -0,0 +1,134 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Utils {
+
+// One block-level element's worth of text (a paragraph, heading, list
+// item, table row, preformatted block, ...), whitespace already collapsed
+struct HtmlBlock {
+  std::string text;
+  std::size_t link_chars{0}; // Part of `text` that sits inside <a>
+  int heading{0};            // 1-6 for <h1>..<h6>, otherwise 0
+  bool preformatted{false};  // <pre>; whitespace kept as is
+  bool list_item{false};
+  // Inside navigation, header/footer, forms, or a container whose class or
+  // id marks it as menu, sidebar, cookie banner, comments, sharing, ...
+  bool boilerplate{false};
+  // Ids of the enclosing container elements (div, section, article, ...),
+  // outermost first; unique within one document
+  std::vector<std::size_t> containers;
+};
+
+// Appends `block` in the rendering described at HtmlTextExtractor;
+// `last_list_item` tracks whether the previous block was a list item
+void render_block(const HtmlBlock &block, std::string &out,
+                  bool &last_list_item);
+
+// Single-pass HTML tokenizer that turns markup into readable text without
+// building a DOM. Input may be split at arbitrary byte boundaries across
+// feed() calls, so it can run directly on download chunks. Script, style,
+// noscript, svg and template contents are skipped; comments and
+// declarations are dropped; character references are decoded.
+class HtmlTextExtractor {
+public:
+  using BlockCallback = std::function<void(HtmlBlock &&block)>;
+
+  // Without a callback, blocks are rendered into text(): headings as
+  // "# Title", <pre> as fenced code, list items as "- item"
+  explicit HtmlTextExtractor(BlockCallback on_block = {});
+
+  void feed(std::string_view chunk);
+  // Flushes the last block; call once the input is complete
+  void finish();
+
+  [[nodiscard]] const std::string &text() const { return text_; }
+  // Characters of text emitted so far, rendered or not
+  [[nodiscard]] std::size_t emitted_chars() const { return emitted_; }
+
+  // Whole-document convenience wrapper
+  static std::string extract(std::string_view html);
+  // Decodes "&amp;", "&eacute;", "&#233;", "&#xE9;" ...; unknown or
+  // unterminated references are kept verbatim
+  static std::string decode_entities(std::string_view text);
+  // Appends the UTF-8 for a named or numeric reference body ("amp",
+  // "#233", "#xE9"); false if it is not a known reference
+  static bool append_entity(std::string_view name, std::string &out);
+
+private:
+  enum class State : std::uint8_t {
+    Text,
+    Entity,
+    TagOpen,  // After '<'
+    Tag,      // Name and attributes, up to '>'
+    TagQuote, // Inside a quoted attribute value
+    Comment,  // <!-- ... -->
+    Declaration, // <!DOCTYPE ...>, <?xml ...?>
+    RawText   // Skipped element body, up to its end tag
+  };
+
+  BlockCallback on_block_;
+  State state_{State::Text};
+  std::string text_;
+  std::size_t emitted_{0};
+
+  HtmlBlock block_;
+  bool pending_space_{false};
+  bool last_list_item_{false};
+  std::string tag_;       // Current tag's name and attributes
+  char quote_{0};
+  std::string entity_;    // Reference body after '&'
+  std::string raw_end_;   // "</script" etc. while in RawText
+  std::size_t raw_match_{0};
+  std::size_t comment_dashes_{0};
+  int link_depth_{0};
+  int pre_depth_{0};
+
+  struct Container {
+    std::string name;
+    std::size_t id{0};
+    bool boilerplate{false}; // Including inherited
+    bool content{false};     // <article>/<main> or a content-like class
+  };
+  std::vector<Container> containers_;
+  std::size_t next_container_id_{0};
+
+  void text_run(std::string_view run);
+  void append_char(char c);
+  void flush_block();
+  void handle_tag();
+  void open_container(const std::string &name, std::string_view attributes);
+  void close_container(const std::string &name);
+};
+
+// Readability-style main-content extraction over the block stream: each
+// container is scored by the text density of the blocks directly inside it
+// (long, comma-rich, few links), the best one and its strong siblings are
+// kept, and boilerplate and link lists are dropped. Headings and code
+// blocks are preserved.
+class MainContentExtractor {
+public:
+  MainContentExtractor();
+
+  void feed(std::string_view chunk) { extractor_.feed(chunk); }
+  // Runs the selection; text() is empty until then
+  void finish();
+
+  [[nodiscard]] const std::string &text() const { return text_; }
+  [[nodiscard]] std::size_t emitted_chars() const {
+    return extractor_.emitted_chars();
+  }
+
+  static std::string extract(std::string_view html);
+
+private:
+  std::vector<HtmlBlock> blocks_;
+  HtmlTextExtractor extractor_;
+  std::string text_;
+};
+
+} // namespace Utils
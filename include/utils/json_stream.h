@@ -0,0 +1,138 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Utils {
+
+// Incremental JSON scanner that reports only the scalar values found at a
+// fixed set of paths, without building a document tree. Input may be split
+// at arbitrary byte boundaries across feed() calls.
+//
+// Paths are dot-separated object keys and array indices, e.g.
+// "choices.0.delta.content" or "usage.prompt_tokens". String values are
+// delivered unescaped (UTF-8); numbers and literals as their raw text.
+class JsonFieldExtractor {
+public:
+  using ValueCallback =
+      std::function<void(std::string_view path, std::string_view value)>;
+
+  enum class Framing : std::uint8_t {
+    Json,            // One or more concatenated documents (covers NDJSON)
+    ServerSentEvents // "data: {...}" lines; non-JSON payloads are skipped
+  };
+
+  JsonFieldExtractor(std::vector<std::string> paths, ValueCallback on_value,
+                     Framing framing = Framing::Json);
+
+  void feed(std::string_view chunk);
+
+  // Number of documents abandoned because they were malformed
+  [[nodiscard]] std::size_t malformed_documents() const { return malformed_; }
+  // True when no document is partially consumed
+  [[nodiscard]] bool at_document_boundary() const { return stack_.empty(); }
+
+private:
+  enum class State : std::uint8_t {
+    Value,
+    ObjectFirstKey,
+    ObjectKey,
+    Colon,
+    ArrayFirstValue,
+    AfterValue,
+    String,
+    StringEscape,
+    StringUnicode,
+    Literal,
+    SseLineStart,
+    SseData,
+    SkipLine
+  };
+
+  struct Frame {
+    bool is_array{false};
+    std::size_t path_length{0}; // Length of path_ naming this container
+    std::size_t index{0};
+  };
+
+  std::vector<std::string> paths_;
+  ValueCallback on_value_;
+  Framing framing_;
+
+  State state_;
+  std::vector<Frame> stack_;
+  std::string path_;
+  std::string buffer_;      // Current key or captured value
+  std::string line_prefix_; // SSE field name being matched
+  bool in_key_{false};
+  bool capture_{false};
+  std::uint32_t code_unit_{0};
+  int hex_digits_{0};
+  std::uint32_t pending_high_surrogate_{0};
+  std::size_t malformed_{0};
+
+  [[nodiscard]] bool is_target() const;
+  [[nodiscard]] State document_start_state() const;
+  void set_element_path(const Frame &frame);
+  void begin_value(char c);
+  void end_value();
+  void fail();
+  void append_code_point(std::uint32_t code_point);
+  void flush_pending_surrogate();
+  std::size_t scan_string(std::string_view chunk, std::size_t pos);
+};
+
+// Request body assembled from segments that are serialized on demand, so
+// large strings (file injections, conversation context) are escaped straight
+// into the transport's buffer instead of being concatenated and copied.
+//
+// Views passed to raw()/escaped() are not copied and must outlive the rope;
+// use owned() for temporaries.
+class JsonRope {
+public:
+  JsonRope() = default;
+  JsonRope(const JsonRope &) = delete;
+  JsonRope &operator=(const JsonRope &) = delete;
+  JsonRope(JsonRope &&) noexcept = default;
+  JsonRope &operator=(JsonRope &&) noexcept = default;
+
+  // Pre-serialized JSON text, emitted verbatim
+  JsonRope &raw(std::string_view json);
+  // Copy of pre-serialized JSON text owned by the rope
+  JsonRope &owned(std::string json);
+  // Bytes emitted with JSON string escaping (no surrounding quotes);
+  // invalid UTF-8 is replaced with U+FFFD
+  JsonRope &escaped(std::string_view text);
+  // One quoted JSON string made of the concatenation of `pieces`
+  JsonRope &string(std::initializer_list<std::string_view> pieces);
+
+  // Serialized size in bytes (for Content-Length)
+  [[nodiscard]] std::size_t size() const;
+  // Copies up to `capacity` bytes of the serialized body into `dest`,
+  // continuing where the previous call stopped; returns 0 at the end.
+  std::size_t read(char *dest, std::size_t capacity);
+  void rewind();
+  // Fully serialized copy; intended for logging and tests
+  [[nodiscard]] std::string to_string() const;
+
+private:
+  struct Segment {
+    std::string_view text;
+    bool escape{false};
+  };
+
+  std::vector<Segment> segments_;
+  std::deque<std::string> storage_; // Stable addresses for owned() text
+  std::size_t segment_index_{0};
+  std::size_t segment_offset_{0};
+  char pending_[8]{};
+  std::size_t pending_size_{0};
+  std::size_t pending_offset_{0};
+};
+
+} // namespace Utils
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace Utils {
+
+// Where the lines of a text start, for jumping to line N without reading
+// everything before it. Only every kCheckpointInterval-th line start is
+// kept, so the index of a multi-GB log stays a few hundred KB; a lookup
+// scans forward from the checkpoint before it. The text is indexed lazily,
+// as far as the lines asked for, and must be the same on every call.
+class LineIndex {
+public:
+  static constexpr std::size_t kCheckpointInterval = 1024;
+
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  // Byte offset where `line` (0-based) starts, or npos past the last line
+  std::size_t line_offset(std::string_view text, std::size_t line);
+  // Lines in `text`, counting a last line without a newline; reads it all
+  std::size_t line_count(std::string_view text);
+
+  // Offset just past the `count`-th newline from `offset`, or npos if the
+  // text has fewer
+  static std::size_t skip_lines(std::string_view text, std::size_t offset,
+                                std::size_t count);
+  static std::size_t count_newlines(std::string_view text);
+
+private:
+  std::vector<std::size_t> checkpoints_{0}; // Start of every K-th line
+  std::size_t scanned_{0};                  // Bytes indexed so far
+  std::size_t newlines_{0};                 // Newlines among them
+
+  void extend(std::string_view text, std::size_t checkpoints);
+};
+
+} // namespace Utils
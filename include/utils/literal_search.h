@@ -0,0 +1,54 @@
+#pragma once
+#include "utils/aho_corasick.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Utils {
+
+// Finds any of a set of literal strings in a buffer, optionally ignoring
+// ASCII case. A single literal is located with an SSE2 scan for its rarest
+// byte (both cases of it) and then verified; several go through an
+// AhoCorasick automaton. Used as a prefilter in front of a regex: lines
+// without one of a pattern's required literals never reach the regex
+// engine.
+class LiteralSearch {
+public:
+  struct Match {
+    std::size_t position;
+    std::size_t length;
+  };
+
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  LiteralSearch(std::vector<std::string> literals, bool case_sensitive);
+
+  // An occurrence at or after `from`, the one that ends first; position
+  // npos if there is none
+  [[nodiscard]] Match find(std::string_view text, std::size_t from) const;
+  [[nodiscard]] bool empty() const { return literals_.empty(); }
+
+  // Literals one of which occurs in every match of the ECMAScript `regex`,
+  // one per top-level alternative; empty when no such set can be found.
+  // `exact` is set when the regex is nothing but those literals, so a
+  // literal hit is already a match.
+  static std::vector<std::string> required_literals(const std::string &regex,
+                                                    bool &exact);
+
+private:
+  struct Literal {
+    std::string text;
+    std::size_t anchor; // Byte of `text` scanned for
+  };
+
+  std::vector<Literal> literals_;
+  bool case_sensitive_;
+  std::optional<AhoCorasick> automaton_; // With more than one literal
+
+  [[nodiscard]] std::size_t find_one(std::string_view text, std::size_t from,
+                                     const Literal &literal) const;
+};
+
+} // namespace Utils
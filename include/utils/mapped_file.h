@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Utils {
+
+// Read-only memory mapping of a whole file. Pages are loaded by the OS as
+// they are touched, so huge files cost address space rather than memory.
+class MappedFile {
+public:
+  // What the file was when mapped; a change means the contents may differ
+  struct Identity {
+    std::uint64_t device{0};
+    std::uint64_t inode{0};
+    std::int64_t modified{0}; // Nanoseconds since the epoch
+    std::uint64_t size{0};
+    bool operator==(const Identity &) const = default;
+  };
+
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Maps `path`, replacing any earlier mapping; false if it can't be read
+  bool open(const std::string &path);
+  void close();
+
+  [[nodiscard]] std::string_view view() const { return {data_, size_}; }
+  [[nodiscard]] const Identity &identity() const { return identity_; }
+
+private:
+  const char *data_{nullptr};
+  std::size_t size_{0};
+  Identity identity_{};
+#ifdef _WIN32
+  void *mapping_{nullptr}; // HANDLE of the file mapping
+#endif
+};
+
+} // namespace Utils
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+
+namespace Utils {
+
+// Returning false stops the walk
+using FileVisitor = std::function<bool(const std::filesystem::path &)>;
+using FileFilter = std::function<bool(const std::filesystem::path &)>;
+
+// Threads a walk uses by default: the hardware's, at most 8
+std::size_t walk_threads();
+
+// Calls `visit` for every regular file under `root` that `accept` lets
+// through, on `threads` threads including the caller's. Each thread goes
+// depth-first from the back of its own queue of directories and files and
+// steals from the front of the others' when it runs dry, where the
+// biggest subtrees wait. Directory symlinks are not followed and
+// unreadable directories are skipped. `accept` and `visit` run
+// concurrently.
+void walk_files(const std::filesystem::path &root, std::size_t threads,
+                const FileFilter &accept, const FileVisitor &visit);
+
+// Calls `body(i)` for every i below `count`, shared out among `threads`
+// threads including the caller's; once a call returns false, no more
+// are started
+void parallel_for(std::size_t count, std::size_t threads,
+                  const std::function<bool(std::size_t)> &body);
+
+} // namespace Utils
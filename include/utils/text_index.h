@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Utils {
+
+// In-memory inverted index with BM25 ranking. Documents are identified by
+// caller-chosen ids (kept small and dense, e.g. issue numbers, since they
+// index a table) and can be replaced or removed, so the index follows a
+// changing collection without being rebuilt. Removal is lazy: postings of
+// replaced documents are skipped and swept out once they are the majority.
+class TextIndex {
+public:
+  using Hit = std::pair<std::uint32_t, double>; // Document id, score
+
+  // Indexes `text` under `id`, replacing what was indexed there before
+  void add(std::uint32_t id, std::string_view text);
+  void remove(std::uint32_t id);
+
+  // Best `limit` documents for the words of `query`, highest score first;
+  // ties go to the higher id
+  [[nodiscard]] std::vector<Hit> search(std::string_view query,
+                                        std::size_t limit) const;
+  [[nodiscard]] std::size_t size() const { return live_documents_; }
+
+  // Lowercased ASCII words of two or more letters or digits; other bytes
+  // (including UTF-8) separate words
+  static void tokenize(std::string_view text,
+                       const std::function<void(std::string_view)> &on_word);
+
+private:
+  struct Posting {
+    std::uint32_t id;
+    std::uint32_t generation; // Stale once the document is re-added
+    std::uint32_t frequency;
+  };
+  struct Document {
+    std::uint32_t length{0}; // Words
+    std::uint32_t generation{0};
+    bool live{false};
+    std::vector<std::uint32_t> terms;
+  };
+  struct TermHash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view term) const {
+      return std::hash<std::string_view>{}(term);
+    }
+  };
+
+  std::unordered_map<std::string, std::uint32_t, TermHash, std::equal_to<>>
+      term_ids_;
+  std::vector<std::vector<Posting>> postings_; // By term id
+  std::vector<std::uint32_t> document_frequency_; // Live postings per term
+  std::vector<Document> documents_;              // By document id
+  std::size_t live_documents_{0};
+  std::uint64_t total_length_{0};
+  std::size_t live_postings_{0};
+  std::size_t stale_postings_{0};
+
+  [[nodiscard]] bool is_current(const Posting &posting) const;
+  void sweep();
+};
+
+} // namespace Utils
@@ -0,0 +1,53 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Utils {
+
+// Fixed set of worker threads draining a FIFO queue. Tasks must not block
+// on futures of other tasks in the same pool, or the pool can deadlock.
+class ThreadPool {
+private:
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> queue_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  bool stopping_{false};
+
+  void post(std::function<void()> task);
+  void worker_loop();
+
+public:
+  explicit ThreadPool(std::size_t threads);
+  // Finishes the queued tasks, then joins the workers
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  template <typename F>
+  std::future<std::invoke_result_t<F>> submit(F &&task) {
+    using Result = std::invoke_result_t<F>;
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<F>(task));
+    std::future<Result> result = packaged->get_future();
+    post([packaged] { (*packaged)(); });
+    return result;
+  }
+
+  [[nodiscard]] std::size_t size() const { return workers_.size(); }
+
+  // Process-wide pool sized to the machine (at least 4 workers). Never
+  // destroyed, so a task stuck on slow I/O cannot hold up exit.
+  static ThreadPool &shared();
+};
+
+} // namespace Utils
@@ -1,4 +1,5 @@
 #include "core/agent.h"
+#include "core/tool_executor.h"
 #include "data/memory_manager.h"
 #include "services/ai_service.h"
 #include "services/auth_service.h"
@@ -13,6 +14,8 @@
 #include "services/mcp_service.h"
 #include "services/multi_file_service.h"
 #include "services/sandbox_service.h"
+#include "services/summary_service.h"
+#include "services/telemetry_service.h"
 #include "services/theme_service.h"
 #include "services/web_service.h"
 #include "utils/config.h"
@@ -23,6 +26,7 @@
 #include <algorithm>
 #include <atomic>
 #include <cctype>
+#include <cmath>
 #include <iostream>
 #include <thread>
 
@@ -34,6 +38,11 @@
 
 // Constants for response handling
 const size_t MAX_RESPONSE_LENGTH = 8000;
+// Larger fetched pages and @ injections are summarized in chunks
+const size_t MAX_FETCH_LENGTH = 1024 * 1024;
+const size_t MAX_INJECTION_LENGTH = 32000;
+// Follow-up requests per user message that feed tool results back
+const int MAX_TOOL_ROUNDS = 3;
 
 // Using the Mode enum from agent.h instead of separate constants
 
@@ -43,6 +52,12 @@ Agent::Agent()
 
 Agent::~Agent() {
   // Destructor defined here because unique_ptr types are forward declared
+  if (warm_up_cancelled_) {
+    *warm_up_cancelled_ = true;
+  }
+  if (warm_up_thread_.joinable()) {
+    warm_up_thread_.join();
+  }
 }
 
 // Helper: trim whitespace
@@ -58,6 +73,7 @@ static inline std::string trim_copy(const std::string &s) {
 
 void Agent::run() {
   initialize_mode();
+  start_warm_up();
 
   // Data-driven model name mapping
   // Data-driven model name mapping
@@ -195,6 +211,21 @@ void Agent::initialize_mode() {
   }
 }
 
+void Agent::start_warm_up() {
+  if (mode_ == Mode::MODE_UNSET || warm_up_thread_.joinable()) {
+    return;
+  }
+
+  // Connect (and load the local model) while the user types the first
+  // prompt; the thread uses its own AIService so nothing is shared with chat
+  Services::WebService::initialize_connection_pool();
+  auto cancelled = std::make_shared<std::atomic<bool>>(false);
+  warm_up_cancelled_ = cancelled;
+  warm_up_thread_ = std::thread([mode = mode_, api_key = api_key_, cancelled] {
+    Services::AIService(mode, api_key).warm_up(*cancelled);
+  });
+}
+
 bool Agent::is_online_mode() const {
   return mode_ == Agent::Mode::MODE_TOGETHER ||
          mode_ == Agent::Mode::MODE_CEREBRAS ||
@@ -267,20 +298,16 @@ void Agent::process_user_input(const std::string &input) {
 void Agent::handle_direct_command(const std::string &input) {
   std::string result;
 
-  if (input.rfind("search:", 0) == 0) {
-    std::string query = trim_copy(input.substr(7));
-    auto validation = Utils::Validator::validate_search_query(query);
-    if (!validation.is_valid) {
-      result = "Error: " + validation.error_message;
-    } else {
-      if (!validation.warnings.empty()) {
-        for (const auto &warning : validation.warnings) {
-          Utils::UI::print_warning(warning);
-        }
+  if (ToolExecutor::is_read_only(input)) {
+    if (input.rfind("search:", 0) == 0) {
+      auto validation =
+          Utils::Validator::validate_search_query(trim_copy(input.substr(7)));
+      for (const auto &warning : validation.warnings) {
+        Utils::UI::print_warning(warning);
       }
-      result = Services::WebService::search(query);
-      memory_->save_interaction("search:" + query, result);
     }
+    result = ToolExecutor::run_read_only(input);
+    record_interaction(input, result);
   } else if (input.rfind("cmd:", 0) == 0) {
     std::string command = trim_copy(input.substr(4));
     auto validation = Utils::Validator::validate_command_safe(command);
@@ -293,122 +320,30 @@ void Agent::handle_direct_command(const std::string &input) {
       std::getline(std::cin, confirm);
       if (confirm != "y" && confirm != "Y") {
         result = "Command cancelled by user";
-        memory_->save_interaction("cmd:" + command, result);
+        record_interaction("cmd:" + command, result);
         std::cout << result << std::endl;
         return;
       }
     }
-    result = Services::CommandService::execute(command);
-    memory_->save_interaction("cmd:" + command, result);
-  } else if (input.rfind("read:", 0) == 0) {
-    std::string params = trim_copy(input.substr(5));
-    // Check if it has range parameters: read:filename:start:count
-    size_t first_colon = params.find(':');
-    if (first_colon != std::string::npos) {
-      std::string filename = params.substr(0, first_colon);
-      auto validation = Utils::Validator::validate_file_exists(filename);
-      if (!validation.is_valid) {
-        result = "Error: " + validation.error_message;
-      } else {
-        std::string range_params = params.substr(first_colon + 1);
-        size_t second_colon = range_params.find(':');
-
-        if (second_colon != std::string::npos) {
-          int start_line = std::stoi(range_params.substr(0, second_colon));
-          int line_count = std::stoi(range_params.substr(second_colon + 1));
-          result = Services::FileService::read_file_range(filename, start_line,
-                                                          line_count);
-        } else {
-          int start_line = std::stoi(range_params);
-          result = Services::FileService::read_file_range(filename, start_line);
-        }
-      }
-    } else {
-      auto validation = Utils::Validator::validate_file_exists(params);
-      if (!validation.is_valid) {
-        result = "Error: " + validation.error_message;
-      } else {
-        result = Services::FileService::read_file(params);
-      }
-    }
-    memory_->save_interaction("read:" + params, result);
+    result = ToolExecutor::run_side_effect(input);
+    record_interaction("cmd:" + command, result);
   } else if (input.rfind("write:", 0) == 0) {
-    // Format: write:filename content...
-    size_t space_pos = input.find(' ', 6); // index 6 is safe for "write:"
-    if (space_pos != std::string::npos) {
-      std::string filename = trim_copy(input.substr(6, space_pos - 6));
-      std::string content = input.substr(space_pos + 1);
-
-      // Validate the file is writable
-      auto validation = Utils::Validator::validate_file_writable(filename);
-      if (!validation.is_valid) {
-        result = "Error: " + validation.error_message;
-      } else {
-        result = Services::FileService::write_file(filename, content);
-        memory_->save_interaction("write:" + filename, result);
-      }
-    } else {
-      result = "Usage: write:filename content";
-    }
+    result = ToolExecutor::run_side_effect(input);
+    // Key on the target file rather than the new content
+    record_interaction(input.substr(0, input.find(' ')), result);
   } else if (input.rfind("replace:", 0) == 0) {
-    // Format: replace:filename:old_text:new_text[:expected_count]
-    std::string params = input.substr(8);
-    std::vector<std::string> parts;
-    size_t pos = 0;
-    size_t colon_pos;
-
-    // Split by colons (up to 4 parts)
-    while ((colon_pos = params.find(':', pos)) != std::string::npos &&
-           parts.size() < 3) {
-      parts.push_back(params.substr(pos, colon_pos - pos));
-      pos = colon_pos + 1;
-    }
-    parts.push_back(params.substr(pos)); // Last part
-
-    if (parts.size() >= 3) {
-      const std::string &filename = parts[0];
-      const std::string &old_text = parts[1];
-      const std::string &new_text = parts[2];
-      int expected = (parts.size() > 3) ? std::stoi(parts[3]) : 1;
-
-      auto edit_result = Services::FileService::replace_text_in_file(
-          filename, old_text, new_text, expected);
-      result = edit_result.message;
-      memory_->save_interaction("replace:" + filename, result);
-    } else {
-      result = "Usage: replace:filename:old_text:new_text[:expected_count]";
-    }
-  } else if (input.rfind("grep:", 0) == 0) {
-    // Format: grep:pattern[:directory[:file_filter]]
-    std::string params = input.substr(5);
-    std::vector<std::string> parts;
-    size_t pos = 0;
-    size_t colon_pos;
-
-    while ((colon_pos = params.find(':', pos)) != std::string::npos &&
-           parts.size() < 2) {
-      parts.push_back(params.substr(pos, colon_pos - pos));
-      pos = colon_pos + 1;
-    }
-    parts.push_back(params.substr(pos));
-
-    std::string pattern = parts[0];
-    std::string directory = (parts.size() > 1) ? parts[1] : ".";
-    std::string filter = (parts.size() > 2) ? parts[2] : "*";
-
-    auto search_results =
-        Services::FileService::search_in_directory(directory, pattern, filter);
-
-    if (search_results.empty()) {
-      result = "No matches found for pattern: " + pattern;
-    } else {
-      result = "Found " + std::to_string(search_results.size()) + " matches:\n";
-      for (const auto &match : search_results) {
-        result += match.file_path + ":" + std::to_string(match.line_number) +
-                  ": " + match.line_content + "\n";
-      }
-    }
-    memory_->save_interaction("grep:" + pattern, result);
+    result = ToolExecutor::run_side_effect(input);
+    record_interaction(input.substr(0, input.find(':', 8)), result);
+  } else if (input.rfind("replace_all:", 0) == 0) {
+    result = ToolExecutor::run_side_effect(input);
+    record_interaction(input.substr(0, input.find(':', 12)), result);
+  } else if (input.rfind("github:sync:", 0) == 0) {
+    result = ToolExecutor::run_side_effect(input);
+    record_interaction(input, result);
+  } else if (ToolExecutor::parse_invocation(input)) {
+    // A read outside the current directory; typing it is the confirmation
+    result = ToolExecutor::run_side_effect(input);
+    record_interaction(input, result);
   } else if (input.rfind("remember:", 0) == 0) {
     std::string fact = trim_copy(input.substr(9));
     memory_->save_global_fact(fact);
@@ -422,107 +357,10 @@ void Agent::handle_direct_command(const std::string &input) {
         global_context.empty() ? "No global memories stored" : global_context;
   } else if (input.rfind("clear", 0) == 0) {
     memory_->clear_memory();
-    result = "Session memory cleared";
-  } else if (input.rfind("analyze:", 0) == 0) {
-    std::string path = trim_copy(input.substr(8));
-    if (path.empty()) {
-      path = "."; // Current directory
+    if (ai_service_) {
+      ai_service_->reset_session();
     }
-    result = Services::CodebaseService::analyze_structure(path);
-    memory_->save_interaction("analyze:" + path, result);
-  } else if (input.rfind("components:", 0) == 0) {
-    std::string path = trim_copy(input.substr(11));
-    if (path.empty()) {
-      path = "."; // Current directory
-    }
-    result = Services::CodebaseService::find_main_components(path);
-    memory_->save_interaction("components:" + path, result);
-  } else if (input.rfind("todos:", 0) == 0) {
-    std::string path = trim_copy(input.substr(6));
-    if (path.empty()) {
-      path = "."; // Current directory
-    }
-    auto todos = Services::CodebaseService::find_todos(path);
-    if (todos.empty()) {
-      result = "No task comments found";
-    } else {
-      result = "Found " + std::to_string(todos.size()) + " task comments:\n";
-      for (const auto &todo : todos) {
-        result += todo + "\n";
-      }
-    }
-    memory_->save_interaction("todos:" + path, result);
-  } else if (input.rfind("git:", 0) == 0) {
-    std::string params = trim_copy(input.substr(4));
-    std::string path = "."; // Default to current directory
-
-    if (params.find("log") == 0) {
-      result = Services::GitService::get_git_log(path, 7);
-    } else if (params.find("status") == 0) {
-      result = Services::GitService::get_git_status(path);
-    } else if (params.find("analyze") == 0) {
-      result = Services::GitService::analyze_repository(path);
-    } else {
-      result = "Usage: git:log, git:status, git:analyze";
-    }
-    memory_->save_interaction("git:" + params, result);
-  } else if (input.rfind("tree:", 0) == 0) {
-    std::string path = trim_copy(input.substr(5));
-    if (path.empty()) {
-      path = "."; // Current directory
-    }
-    result = Services::CodebaseService::get_directory_tree(path, 3);
-    memory_->save_interaction("tree:" + path, result);
-  } else if (input.rfind("github:", 0) == 0) {
-    std::string params = trim_copy(input.substr(7));
-    auto parse_repo_spec = [](const std::string &repo_spec, std::string &owner,
-                              std::string &repo) -> bool {
-      size_t slash_pos = repo_spec.find('/');
-      if (slash_pos != std::string::npos) {
-        owner = repo_spec.substr(0, slash_pos);
-        repo = repo_spec.substr(slash_pos + 1);
-        return true;
-      }
-      return false;
-    };
-    if (params.rfind("repo:", 0) == 0) {
-      std::string repo_spec = trim_copy(params.substr(5));
-      std::string owner, repo;
-      if (parse_repo_spec(repo_spec, owner, repo)) {
-        result = Services::GitHubService::get_repo_info(owner, repo);
-      } else {
-        result = "Usage: github:repo:owner/repo";
-      }
-    } else if (params.rfind("issues:", 0) == 0) {
-      std::string repo_spec = trim_copy(params.substr(7));
-      std::string owner, repo;
-      if (parse_repo_spec(repo_spec, owner, repo)) {
-        auto issues = Services::GitHubService::get_issues(owner, repo);
-        if (issues.empty()) {
-          result = "No issues found";
-        } else {
-          result = "Found " + std::to_string(issues.size()) + " issues:\n";
-          for (const auto &issue : issues) {
-            result +=
-                "#" + std::to_string(issue.number) + ": " + issue.title + "\n";
-          }
-        }
-      } else {
-        result = "Usage: github:issues:owner/repo";
-      }
-    } else if (params.rfind("health:", 0) == 0) {
-      std::string repo_spec = trim_copy(params.substr(7));
-      std::string owner, repo;
-      if (parse_repo_spec(repo_spec, owner, repo)) {
-        result = Services::GitHubService::run_health_check(owner, repo);
-      } else {
-        result = "Usage: github:health:owner/repo";
-      }
-    } else {
-      result = "Usage: github:repo:owner/repo, github:issues:owner/repo, "
-               "github:health:owner/repo";
-    }
-    memory_->save_interaction("github:" + params, result);
+    result = "Session memory cleared";
   } else {
     result = "Unknown command";
   }
@@ -532,16 +370,8 @@ void Agent::handle_direct_command(const std::string &input) {
   }
 }
 
-void Agent::handle_ai_chat(const std::string &input) {
-  if (!ai_service_) {
-    ai_service_ = std::make_unique<Services::AIService>(mode_, api_key_);
-  }
-
-  if (!ai_service_->is_available()) {
-    std::cout << "AI service unavailable\n";
-    return;
-  }
-
+std::string Agent::request_ai_response(const std::string &prompt,
+                                       ToolScheduler &tools) {
   std::atomic<bool> done(false);
   std::thread spin([&done]() { Utils::UI::spinner(done); });
 
@@ -550,23 +380,139 @@ void Agent::handle_ai_chat(const std::string &input) {
   std::string hierarchical_context =
       Services::ContextService::load_hierarchical_context(".");
 
-  std::string full_context = memory_context;
+  // Passed as pieces so the combined context is never materialized
+  std::vector<std::string_view> full_context;
   if (!hierarchical_context.empty()) {
-    full_context = hierarchical_context + "\n\n" + memory_context;
+    full_context = {hierarchical_context, "\n\n"};
   }
+  full_context.push_back(memory_context);
 
-  std::string response = ai_service_->chat(input, full_context);
+  // Read-only tools the model names start while it is still generating
+  SpeculativeToolRunner runner(tools);
+  ai_service_->set_content_observer(
+      [&runner](std::string_view text) { runner.feed(text); });
+
+  std::string response;
+  if (ai_service_->supports_session()) {
+    // Local models keep the conversation on the server; only a change to the
+    // project or global memory context forces the history to be resent
+    std::string global_context = memory_->get_global_context();
+    std::size_t session_key =
+        std::hash<std::string>{}(hierarchical_context) ^
+        (std::hash<std::string>{}(global_context) << 1);
+    response = ai_service_->chat_in_session(prompt, full_context, session_key,
+                                            unsent_interactions_);
+  } else {
+    response = ai_service_->chat(prompt, full_context);
+  }
+  unsent_interactions_.clear(); // Sent, or part of the memory context
+  ai_service_->set_content_observer(nullptr);
+  runner.finish();
+  token_usage_ += ai_service_->get_last_usage().total_tokens();
 
   done = true;
   if (spin.joinable())
     spin.join();
+  return response;
+}
+
+void Agent::record_interaction(const std::string &input,
+                               const std::string &result) {
+  memory_->save_interaction(input, result);
+  unsent_interactions_ += "User: " + input + "\nAssistant: " +
+                          (result.length() > MAX_RESPONSE_LENGTH
+                               ? result.substr(0, MAX_RESPONSE_LENGTH) +
+                                     "\n...[truncated]"
+                               : result) +
+                          "\n";
+}
+
+void Agent::handle_ai_chat(const std::string &input) {
+  if (!ai_service_) {
+    ai_service_ = std::make_unique<Services::AIService>(mode_, api_key_);
+  }
+
+  if (!ai_service_->is_available()) {
+    std::cout << "AI service unavailable\n";
+    return;
+  }
 
-  if (!response.empty()) {
+  std::string prompt = input;
+  for (int round = 0;; ++round) {
+    ToolScheduler tools;
+    std::string response = request_ai_response(prompt, tools);
+    if (response.empty()) {
+      std::cout << "No response\n";
+      return;
+    }
     std::cout << response << std::endl;
-    memory_->save_interaction(input, response);
-  } else {
-    std::cout << "No response\n";
+    memory_->save_interaction(round == 0 ? input : "[tool results]",
+                              response);
+
+    if (tools.empty() || round >= MAX_TOOL_ROUNDS ||
+        response.rfind("Error:", 0) == 0) {
+      return;
+    }
+    bool run_side_effects = confirm_side_effects(tools.side_effects());
+
+    // Read-only tools mostly finished while the response was streaming
+    prompt = "Tool results:\n";
+    for (const auto &tool : tools.collect(run_side_effects)) {
+      Utils::UI::print_info("Ran " + tool.invocation);
+      std::string output = tool.output;
+      if (output.length() > MAX_RESPONSE_LENGTH) {
+        output = output.substr(0, MAX_RESPONSE_LENGTH) + "\n...[truncated]";
+      }
+      prompt += "[" + tool.invocation + "]\n" + output + "\n\n";
+    }
+    prompt += "Continue answering the original request using these results.";
+  }
+}
+
+bool Agent::confirm_side_effects(const std::vector<std::string> &commands) {
+  if (commands.empty()) {
+    return false;
+  }
+  Utils::UI::print_info("The response asks to run:");
+  for (const auto &command : commands) {
+    std::cout << "  " << command << std::endl;
+    if (command.rfind("cmd:", 0) == 0) {
+      auto validation =
+          Utils::Validator::validate_command_safe(command.substr(4));
+      for (const auto &warning : validation.warnings) {
+        Utils::UI::print_warning(warning);
+      }
+    }
+  }
+  std::cout << "Run them in this order? (y/N): ";
+  std::string confirm;
+  std::getline(std::cin, confirm);
+  return confirm == "y" || confirm == "Y";
+}
+
+Services::SummaryResult
+Agent::summarize_content(const std::string &label, const std::string &text,
+                         const std::string &focus) {
+  if (!ai_service_) {
+    ai_service_ = std::make_unique<Services::AIService>(mode_, api_key_);
+  }
+  if (!ai_service_->is_available()) {
+    return {};
   }
+
+  std::atomic<bool> done(false);
+  std::thread spin([&done]() { Utils::UI::spinner(done); });
+
+  Services::SummaryOptions options;
+  options.focus = focus;
+  auto summary = Services::SummaryService::summarize(mode_, api_key_, label,
+                                                     text, options);
+  token_usage_ += summary.total_tokens;
+
+  done = true;
+  if (spin.joinable())
+    spin.join();
+  return summary;
 }
 
 void Agent::handle_file_injection_command(const std::string &input) {
@@ -605,7 +551,7 @@ void Agent::handle_shell_command(const std::string &input) {
 
   std::string result = Services::CommandService::execute(command);
   std::cout << result << std::endl;
-  memory_->save_interaction("!" + command, result);
+  record_interaction("!" + command, result);
 }
 
 void Agent::handle_meta_command(const std::string &input) {
@@ -627,6 +573,16 @@ void Agent::handle_meta_command(const std::string &input) {
     compress_context();
   } else if (command == "stats") {
     show_session_stats();
+  } else if (command == "stats json" || command.rfind("stats json ", 0) == 0) {
+    std::string export_path = trim_copy(command.substr(10));
+    std::cout << Services::TelemetryService::to_json_string() << std::endl;
+    if (!export_path.empty()) {
+      if (Services::TelemetryService::export_json(export_path)) {
+        std::cout << "Telemetry exported to: " << export_path << std::endl;
+      } else {
+        std::cout << "Error: Failed to export telemetry" << std::endl;
+      }
+    }
   } else if (command.rfind("context ", 0) == 0) {
     handle_context_management(command.substr(8));
   } else if (command.rfind("files ", 0) == 0) {
@@ -694,6 +650,16 @@ std::string Agent::process_file_injections(const std::string &input) {
     if (start < end) {
       std::string path = result.substr(start, end - start);
       std::string file_content = read_file_or_directory(path);
+      if (file_content.length() > MAX_INJECTION_LENGTH) {
+        // Too large for one prompt; inject a summary of all of it instead
+        auto summary =
+            summarize_content("the contents of " + path, file_content, input);
+        if (summary.success) {
+          file_content = "[Summary of " + path + " from " +
+                         std::to_string(summary.chunks) + " chunks]\n\n" +
+                         summary.summary;
+        }
+      }
 
       // Replace @path with file content
       size_t replace_start = pos;
@@ -806,6 +772,8 @@ void Agent::show_meta_help() {
   std::cout << "  /compress             - Compress conversation context"
             << std::endl;
   std::cout << "  /stats                - Show session statistics" << std::endl;
+  std::cout << "  /stats json [file]    - Dump token/latency telemetry as JSON"
+            << std::endl;
   std::cout << "  /context show         - Show hierarchical context"
             << std::endl;
   std::cout << "  /context refresh      - Refresh context cache" << std::endl;
@@ -813,8 +781,9 @@ void Agent::show_meta_help() {
             << std::endl;
   std::cout << "  /files <patterns>     - Read multiple files with patterns"
             << std::endl;
-  std::cout << "  /fetch <url> [format] - Fetch web content (text/json/raw)"
-            << std::endl;
+  std::cout
+      << "  /fetch <url> [format] - Fetch web content (text/full/json/raw)"
+      << std::endl;
   std::cout
       << "  /checkpoint <cmd>     - Manage checkpoints (create/list/delete)"
       << std::endl;
@@ -836,6 +805,10 @@ void Agent::show_meta_help() {
   std::cout << "  /github issues:owner/repo - List repository issues"
             << std::endl;
   std::cout << "  /github health:owner/repo - Run health check" << std::endl;
+  std::cout << "  /github sync:owner/repo - Mirror issues and PRs locally"
+            << std::endl;
+  std::cout << "  /github related:owner/repo <text> - Find related issues"
+            << std::endl;
   std::cout << "  /quit or /exit        - Exit the program" << std::endl;
   std::cout << std::endl;
   std::cout << "File injection commands:" << std::endl;
@@ -869,6 +842,9 @@ void Agent::handle_chat_management(const std::string &command) {
       return;
     }
     if (memory_->resume_conversation_state(tag)) {
+      if (ai_service_) {
+        ai_service_->reset_session();
+      }
       std::cout << "Conversation resumed: " << tag << std::endl;
     } else {
       std::cout << "Could not resume conversation: " << tag << std::endl;
@@ -896,6 +872,10 @@ void Agent::show_available_tools() {
   std::cout << "    write:file content          - Write to file" << std::endl;
   std::cout << "    replace:file:old:new        - Replace text in file"
             << std::endl;
+  std::cout << "    replace_all:glob:old:new    - Replace text in many files"
+            << std::endl;
+  std::cout << "    replace_preview:glob:old:new - Preview replace_all"
+            << std::endl;
   std::cout << "    grep:pattern[:dir[:ext]]    - Search in files" << std::endl;
   std::cout << "  Project Analysis:" << std::endl;
   std::cout << "    analyze:[path]              - Analyze project structure"
@@ -924,6 +904,10 @@ void Agent::show_available_tools() {
             << std::endl;
   std::cout << "    github:health:owner/repo    - Run health check"
             << std::endl;
+  std::cout << "    github:sync:owner/repo      - Mirror issues and PRs locally"
+            << std::endl;
+  std::cout << "    github:related:owner/repo <text> - Find related issues"
+            << std::endl;
 }
 
 void Agent::show_memory_context() {
@@ -975,6 +959,7 @@ void Agent::compress_context() {
 
     // Use AI service to generate summary
     std::string summary = ai_service_->chat(compression_prompt, "");
+    token_usage_ += ai_service_->get_last_usage().total_tokens();
 
     if (summary.empty()) {
       std::cout << "Failed to generate compression summary." << std::endl;
@@ -1006,6 +991,8 @@ void Agent::show_session_stats() {
             << std::endl;
   std::cout << "  Commands Processed: " << command_count_ << std::endl;
   std::cout << "  Token Usage: " << token_usage_ << std::endl;
+  std::cout << "Model Telemetry:" << std::endl;
+  std::cout << Services::TelemetryService::format_summary();
 }
 
 void Agent::handle_context_management(const std::string &command) {
@@ -1097,85 +1084,119 @@ void Agent::handle_multi_file_command(const std::string &command) {
   std::cout << formatted << std::endl;
 
   // Save to memory for AI context
-  memory_->save_interaction("/files " + command, formatted);
+  record_interaction("/files " + command, formatted);
+}
+
+// One URL in the given /fetch format
+static std::string fetch_single(const std::string &url,
+                                const std::string &format) {
+  std::string result;
+  if (format == "json") {
+    result = Services::WebService::fetch_json(url);
+  } else if (format == "raw") {
+    auto response = Services::WebService::fetch_url(url);
+    if (response.success) {
+      result = "Status: " + std::to_string(response.status_code) + "\n";
+      result += "Content-Type: " + response.content_type + "\n\n";
+      result.append(response.content, 0, MAX_FETCH_LENGTH);
+    } else {
+      result = "Error: " + response.error_message;
+    }
+  } else if (format == "full") {
+    result = Services::WebService::fetch_text(url, MAX_FETCH_LENGTH, false);
+  } else { // default to text
+    result = Services::WebService::fetch_text(url, MAX_FETCH_LENGTH);
+  }
+  return result;
 }
 
 void Agent::handle_web_fetch_command(const std::string &command) {
   if (command.empty()) {
-    std::cout << "Usage: /fetch <url> [options]" << std::endl;
+    std::cout << "Usage: /fetch <url>... [options]" << std::endl;
     std::cout << "Options:" << std::endl;
-    std::cout << "  text    - Extract text content from HTML" << std::endl;
+    std::cout << "  text    - Main content of an HTML page (default)"
+              << std::endl;
+    std::cout << "  full    - All text of an HTML page, menus included"
+              << std::endl;
     std::cout << "  json    - Parse and format JSON response" << std::endl;
     std::cout << "  raw     - Return raw response content" << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  /fetch https://api.github.com/users/octocat json"
               << std::endl;
     std::cout << "  /fetch https://example.com text" << std::endl;
+    std::cout << "  /fetch https://a.example/docs https://b.example/docs"
+              << std::endl;
     return;
   }
 
+  // Any number of URLs, optionally followed by the format
   std::istringstream iss(command);
-  std::string url, format = "text";
-  iss >> url >> format;
+  std::vector<std::string> urls;
+  std::string format = "text";
+  for (std::string word; iss >> word;) {
+    if (word.find("://") != std::string::npos) {
+      urls.push_back(word);
+    } else {
+      format = word;
+    }
+  }
 
-  if (url.empty()) {
+  if (urls.empty()) {
     std::cout << "Error: URL is required" << std::endl;
     return;
   }
 
-  if (!Services::WebService::is_valid_url(url)) {
-    std::cout << "Error: Invalid URL format. Use http:// or https://"
-              << std::endl;
-    return;
+  for (const auto &url : urls) {
+    if (!Services::WebService::is_valid_url(url)) {
+      std::cout << "Error: Invalid URL format. Use http:// or https://"
+                << std::endl;
+      return;
+    }
   }
 
-  std::cout << "Fetching: " << url << std::endl;
-
   std::string result;
-  if (format == "json") {
-    result = Services::WebService::fetch_json(url);
-  } else if (format == "raw") {
-    auto response = Services::WebService::fetch_url(url);
-    if (response.success) {
-      result = "Status: " + std::to_string(response.status_code) + "\n";
-      result += "Content-Type: " + response.content_type + "\n\n";
-      result += response.content;
-      if (result.length() > MAX_RESPONSE_LENGTH) {
-        result = result.substr(0, MAX_RESPONSE_LENGTH) +
-                 "\n\n[Content truncated - showing first " +
-                 std::to_string(MAX_RESPONSE_LENGTH) + " characters]";
+  std::string label = "the page " + urls.front();
+  if (urls.size() > 1) {
+    std::cout << "Fetching " << urls.size() << " URLs..." << std::endl;
+    auto responses = Services::WebService::fetch_many(urls);
+    // Each page gets an equal share of the text budget
+    std::size_t share = MAX_FETCH_LENGTH / urls.size();
+    for (std::size_t i = 0; i < urls.size(); ++i) {
+      result += "=== " + urls[i] + " ===\n";
+      if (format == "raw" || format == "json") {
+        result += responses[i].success
+                      ? responses[i].content.substr(0, share)
+                      : "Error: " + responses[i].error_message;
+      } else {
+        result += Services::WebService::response_text(responses[i], share,
+                                                      format != "full");
       }
-    } else {
-      result = "Error: " + response.error_message;
+      result += "\n\n";
     }
-  } else { // default to text
-    result = Services::WebService::fetch_text(url);
-    return;
+    label = "these " + std::to_string(urls.size()) + " pages";
+  } else {
+    std::cout << "Fetching: " << urls.front() << std::endl;
+    result = fetch_single(urls.front(), format);
   }
 
-  // Process the fetched content with AI if needed
-  if (result.length() > 1000) { // Only process large content with AI
-    std::atomic<bool> done(false);
-    std::thread spin([&done]() { Utils::UI::spinner(done); });
-
-    std::string context = memory_->get_context_string();
-    std::string ai_prompt = "Summarize the following content:\n\n" + result;
-    std::string response = ai_service_->chat(ai_prompt, context);
-
-    done = true;
-    if (spin.joinable())
-      spin.join();
-
-    if (!response.empty()) {
-      std::cout << "\nAI Summary:\n" << response << std::endl;
-      memory_->save_interaction("web_fetch_summary", response);
+  // Summarize large content with the model, chunk by chunk if needed
+  if (result.length() > 1000 && result.rfind("Error", 0) != 0) {
+    auto summary = summarize_content(label, result, "");
+    if (summary.success) {
+      std::cout << "\nAI Summary:\n" << summary.summary << std::endl;
+      record_interaction("web_fetch_summary", summary.summary);
     }
   }
 
+  if (result.length() > MAX_RESPONSE_LENGTH) {
+    result = result.substr(0, MAX_RESPONSE_LENGTH) +
+             "\n\n[Content truncated - showing first " +
+             std::to_string(MAX_RESPONSE_LENGTH) + " characters]";
+  }
   std::cout << result << std::endl;
 
   // Save to memory for AI context
-  memory_->save_interaction("/fetch " + command, result);
+  record_interaction("/fetch " + command, result);
 }
 
 void Agent::handle_checkpoint_command(const std::string &command) {
@@ -1354,8 +1375,7 @@ void Agent::handle_checkpoint_command(const std::string &command) {
   }
 
   // Save to memory for AI context
-  memory_->save_interaction("/checkpoint " + command,
-                            "Checkpoint command executed");
+  record_interaction("/checkpoint " + command, "Checkpoint command executed");
 }
 
 void Agent::handle_mcp_command(const std::string &command) {
@@ -1628,7 +1648,7 @@ void Agent::handle_mcp_command(const std::string &command) {
   }
 
   // Save to memory for AI context
-  memory_->save_interaction("/mcp " + command, "MCP command executed");
+  record_interaction("/mcp " + command, "MCP command executed");
 }
 
 void Agent::handle_theme_command(const std::string &command) {
@@ -1713,7 +1733,7 @@ void Agent::handle_theme_command(const std::string &command) {
     std::cout << "Error: " << e.what() << std::endl;
   }
 
-  memory_->save_interaction("/theme " + command, "Theme command executed");
+  record_interaction("/theme " + command, "Theme command executed");
 }
 
 void Agent::handle_auth_command(const std::string &command) {
@@ -1734,6 +1754,9 @@ void Agent::handle_auth_command(const std::string &command) {
     std::cout << "  /auth test <provider>                   - Test provider "
                  "connection"
               << std::endl;
+    std::cout << "  /auth limit <provider> <rpm|tpm|host_rpm> <n> - Set "
+                 "client-side rate limit (0 = off)"
+              << std::endl;
     return;
   }
 
@@ -1806,6 +1829,43 @@ void Agent::handle_auth_command(const std::string &command) {
       std::cout << "Model: " << provider_info.model << std::endl;
       std::cout << "Base URL: " << provider_info.base_url << std::endl;
 
+    } else if (action == "limit") {
+      static const std::map<std::string, std::string> limit_keys = {
+          {"rpm", "requests_per_minute"},
+          {"tpm", "tokens_per_minute"},
+          {"host_rpm", "host_requests_per_minute"}};
+      std::string provider_name, limit_name, value;
+      iss >> provider_name >> limit_name >> value;
+      auto key_it = limit_keys.find(limit_name);
+      if (provider_name.empty() || key_it == limit_keys.end() ||
+          value.empty()) {
+        std::cout << "Usage: /auth limit <provider> <rpm|tpm|host_rpm> <n>"
+                  << std::endl;
+        return;
+      }
+      double limit = -1.0;
+      std::size_t parsed = 0;
+      try {
+        limit = std::stod(value, &parsed);
+      } catch (const std::exception &) {
+        parsed = 0;
+      }
+      if (parsed != value.size() || !std::isfinite(limit) || limit < 0.0) {
+        std::cout << "Error: Rate limit must be a non-negative number (0 "
+                     "turns it off)"
+                  << std::endl;
+        return;
+      }
+
+      if (Services::AuthService::update_provider_config(
+              provider_name, {{key_it->second, value}})) {
+        std::cout << " Rate limit " << limit_name << " for " << provider_name
+                  << " set to " << value << std::endl;
+      } else {
+        std::cout << "Error: Provider not found: " << provider_name
+                  << std::endl;
+      }
+
     } else if (action == "test") {
       std::string provider_name;
       iss >> provider_name;
@@ -1831,7 +1891,7 @@ void Agent::handle_auth_command(const std::string &command) {
     std::cout << "Error: " << e.what() << std::endl;
   }
 
-  memory_->save_interaction("/auth " + command, "Auth command executed");
+  record_interaction("/auth " + command, "Auth command executed");
 }
 
 void Agent::handle_sandbox_command(const std::string &command) {
@@ -1932,7 +1992,7 @@ void Agent::handle_sandbox_command(const std::string &command) {
     std::cout << "Error: " << e.what() << std::endl;
   }
 
-  memory_->save_interaction("/sandbox " + command, "Sandbox command executed");
+  record_interaction("/sandbox " + command, "Sandbox command executed");
 }
 
 void Agent::handle_error_command(const std::string &command) {
@@ -2004,6 +2064,6 @@ void Agent::handle_error_command(const std::string &command) {
     std::cout << "Error: " << e.what() << std::endl;
   }
 
-  memory_->save_interaction("/error " + command, "Error command executed");
+  record_interaction("/error " + command, "Error command executed");
 }
 } // namespace Core
@@ -0,0 +1,520 @@
+#include "core/tool_executor.h"
+#include "services/codebase_service.h"
+#include "services/command_service.h"
+#include "services/file_service.h"
+#include "services/git_service.h"
+#include "services/github_service.h"
+#include "services/web_service.h"
+#include "utils/thread_pool.h"
+#include "utils/validation.h"
+#include <array>
+#include <cctype>
+#include <filesystem>
+
+namespace Core {
+
+static const std::array<std::string_view, 10> kReadOnlyPrefixes = {
+    "search:", "read:", "grep:",   "analyze:", "components:",
+    "todos:",  "git:",  "tree:",   "github:",  "replace_preview:"};
+// github:sync: writes the issue mirror and may issue hundreds of requests
+static const std::array<std::string_view, 5> kSideEffectPrefixes = {
+    "write:", "replace:", "replace_all:", "cmd:", "github:sync:"};
+
+static std::string trim_copy(std::string_view s) {
+  size_t a = 0;
+  while (a < s.size() && std::isspace(static_cast<unsigned char>(s[a])))
+    ++a;
+  size_t b = s.size();
+  while (b > a && std::isspace(static_cast<unsigned char>(s[b - 1])))
+    --b;
+  return std::string(s.substr(a, b - a));
+}
+
+static bool starts_with_any(std::string_view text,
+                            const auto &prefixes) {
+  for (std::string_view prefix : prefixes) {
+    if (text.substr(0, prefix.size()) == prefix) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Splits "a:b:c" into at most `max_parts` pieces; the last keeps the rest
+static std::vector<std::string> split_params(const std::string &params,
+                                             size_t max_parts) {
+  std::vector<std::string> parts;
+  size_t pos = 0;
+  size_t colon_pos;
+  while ((colon_pos = params.find(':', pos)) != std::string::npos &&
+         parts.size() + 1 < max_parts) {
+    parts.push_back(params.substr(pos, colon_pos - pos));
+    pos = colon_pos + 1;
+  }
+  parts.push_back(params.substr(pos));
+  return parts;
+}
+
+std::optional<std::string>
+ToolExecutor::parse_invocation(std::string_view line) {
+  std::string text = trim_copy(line);
+  // Models often format commands as list items or inline code
+  if (text.rfind("- ", 0) == 0 || text.rfind("* ", 0) == 0) {
+    text = trim_copy(std::string_view(text).substr(2));
+  }
+  while (!text.empty() && text.front() == '`') {
+    text.erase(0, 1);
+  }
+  while (!text.empty() && text.back() == '`') {
+    text.pop_back();
+  }
+
+  if (starts_with_any(text, kReadOnlyPrefixes) ||
+      starts_with_any(text, kSideEffectPrefixes)) {
+    return text;
+  }
+  return std::nullopt;
+}
+
+static bool reads_only(const std::string &invocation) {
+  return starts_with_any(invocation, kReadOnlyPrefixes) &&
+         !starts_with_any(invocation, kSideEffectPrefixes);
+}
+
+// The file or directory a local read-only tool looks at, if it takes one
+static std::optional<std::string> read_path(const std::string &invocation) {
+  size_t colon = invocation.find(':');
+  std::string tool = invocation.substr(0, colon + 1);
+  std::string params =
+      trim_copy(std::string_view(invocation).substr(colon + 1));
+  if (tool == "read:") {
+    return split_params(params, 3)[0];
+  }
+  if (tool == "grep:") {
+    std::vector<std::string> parts =
+        split_params(invocation.substr(colon + 1), 3);
+    return parts.size() > 1 ? parts[1] : ".";
+  }
+  if (tool == "analyze:" || tool == "components:" || tool == "todos:" ||
+      tool == "tree:") {
+    return params.empty() ? "." : params;
+  }
+  return std::nullopt;
+}
+
+// Resolves ".." and symlinks first so neither can step out of the workspace
+static bool inside_workspace(const std::string &path) {
+  std::error_code ec;
+  auto root = std::filesystem::weakly_canonical(
+      std::filesystem::current_path(ec), ec);
+  if (ec) {
+    return false;
+  }
+  auto resolved = std::filesystem::weakly_canonical(path, ec);
+  return !ec && Services::FileService::is_within_directory(resolved.string(),
+                                                           root.string());
+}
+
+bool ToolExecutor::is_read_only(const std::string &invocation) {
+  if (!reads_only(invocation)) {
+    return false;
+  }
+  auto path = read_path(invocation);
+  return !path || inside_workspace(*path);
+}
+
+static std::string run_read(const std::string &params) {
+  // read:filename or read:filename:start[:count]
+  std::vector<std::string> parts = split_params(params, 3);
+  auto validation = Utils::Validator::validate_file_exists(parts[0]);
+  if (!validation.is_valid) {
+    return "Error: " + validation.error_message;
+  }
+  if (parts.size() == 1) {
+    return Services::FileService::read_file(parts[0]);
+  }
+  int start_line = std::stoi(parts[1]);
+  if (parts.size() == 3) {
+    return Services::FileService::read_file_range(parts[0], start_line,
+                                                  std::stoi(parts[2]));
+  }
+  return Services::FileService::read_file_range(parts[0], start_line);
+}
+
+static std::string run_grep(const std::string &params) {
+  // grep:pattern[:directory[:file_filter]]
+  std::vector<std::string> parts = split_params(params, 3);
+  const std::string &pattern = parts[0];
+  std::string directory = parts.size() > 1 ? parts[1] : ".";
+  std::string filter = parts.size() > 2 ? parts[2] : "*";
+
+  auto matches =
+      Services::FileService::search_in_directory(directory, pattern, filter);
+  if (matches.empty()) {
+    return "No matches found for pattern: " + pattern;
+  }
+  std::string result =
+      "Found " + std::to_string(matches.size()) + " matches:\n";
+  for (const auto &match : matches) {
+    result += match.file_path + ":" + std::to_string(match.line_number) +
+              ": " + match.line_content + "\n";
+  }
+  return result;
+}
+
+static std::string run_replace_all(const std::string &params, bool dry_run) {
+  // replace_all:glob:old_text:new_text[:expected_per_file], or
+  // replace_preview: with the same parameters for a dry run
+  std::vector<std::string> parts = split_params(params, 4);
+  if (parts.size() < 3) {
+    return "Usage: replace_all:glob:old_text:new_text[:expected_per_file]";
+  }
+  Services::ReplaceOptions options;
+  options.dry_run = dry_run;
+  if (parts.size() > 3) {
+    options.expected_per_file = std::stoi(parts[3]);
+  }
+  return Services::FileService::replace_in_files(parts[0], parts[1], parts[2],
+                                                 options)
+      .message;
+}
+
+static std::string run_github(const std::string &params) {
+  auto parse_repo_spec = [](const std::string &repo_spec, std::string &owner,
+                            std::string &repo) -> bool {
+    size_t slash_pos = repo_spec.find('/');
+    if (slash_pos != std::string::npos) {
+      owner = repo_spec.substr(0, slash_pos);
+      repo = repo_spec.substr(slash_pos + 1);
+      return true;
+    }
+    return false;
+  };
+
+  std::string owner, repo;
+  if (params.rfind("repo:", 0) == 0) {
+    if (!parse_repo_spec(trim_copy(params.substr(5)), owner, repo)) {
+      return "Usage: github:repo:owner/repo";
+    }
+    return Services::GitHubService::get_repo_info(owner, repo);
+  }
+  if (params.rfind("issues:", 0) == 0) {
+    if (!parse_repo_spec(trim_copy(params.substr(7)), owner, repo)) {
+      return "Usage: github:issues:owner/repo";
+    }
+    auto issues = Services::GitHubService::get_issues(owner, repo);
+    if (issues.empty()) {
+      return "No issues found";
+    }
+    std::string result =
+        "Found " + std::to_string(issues.size()) + " issues:\n";
+    for (const auto &issue : issues) {
+      result += "#" + std::to_string(issue.number) + ": " + issue.title + "\n";
+    }
+    return result;
+  }
+  if (params.rfind("health:", 0) == 0) {
+    if (!parse_repo_spec(trim_copy(params.substr(7)), owner, repo)) {
+      return "Usage: github:health:owner/repo";
+    }
+    return Services::GitHubService::run_health_check(owner, repo);
+  }
+  if (params.rfind("sync:", 0) == 0) {
+    if (!parse_repo_spec(trim_copy(params.substr(5)), owner, repo)) {
+      return "Usage: github:sync:owner/repo";
+    }
+    return Services::GitHubService::sync_issue_mirror(owner, repo);
+  }
+  if (params.rfind("related:", 0) == 0) {
+    std::string spec = trim_copy(params.substr(8));
+    size_t space = spec.find(' ');
+    if (space == std::string::npos ||
+        !parse_repo_spec(spec.substr(0, space), owner, repo)) {
+      return "Usage: github:related:owner/repo <text>";
+    }
+    return Services::GitHubService::find_related_issues(
+        owner, repo, trim_copy(spec.substr(space + 1)));
+  }
+  return "Usage: github:repo:owner/repo, github:issues:owner/repo, "
+         "github:health:owner/repo, github:sync:owner/repo, "
+         "github:related:owner/repo <text>";
+}
+
+std::string ToolExecutor::run_read_only(const std::string &invocation) {
+  size_t colon = invocation.find(':');
+  std::string tool = invocation.substr(0, colon + 1);
+  std::string params =
+      trim_copy(std::string_view(invocation).substr(colon + 1));
+  std::string path = params.empty() ? "." : params; // Current directory
+
+  try {
+    if (tool == "search:") {
+      auto validation = Utils::Validator::validate_search_query(params);
+      if (!validation.is_valid) {
+        return "Error: " + validation.error_message;
+      }
+      return Services::WebService::search(params);
+    }
+    if (tool == "read:") {
+      return run_read(params);
+    }
+    if (tool == "grep:") {
+      return run_grep(invocation.substr(colon + 1));
+    }
+    if (tool == "analyze:") {
+      return Services::CodebaseService::analyze_structure(path);
+    }
+    if (tool == "components:") {
+      return Services::CodebaseService::find_main_components(path);
+    }
+    if (tool == "todos:") {
+      auto todos = Services::CodebaseService::find_todos(path);
+      if (todos.empty()) {
+        return "No task comments found";
+      }
+      std::string result =
+          "Found " + std::to_string(todos.size()) + " task comments:\n";
+      for (const auto &todo : todos) {
+        result += todo + "\n";
+      }
+      return result;
+    }
+    if (tool == "git:") {
+      if (params.find("log") == 0) {
+        return Services::GitService::get_git_log(".", 7);
+      }
+      if (params.find("status") == 0) {
+        return Services::GitService::get_git_status(".");
+      }
+      if (params.find("analyze") == 0) {
+        return Services::GitService::analyze_repository(".");
+      }
+      return "Usage: git:log, git:status, git:analyze";
+    }
+    if (tool == "tree:") {
+      return Services::CodebaseService::get_directory_tree(path, 3);
+    }
+    if (tool == "github:") {
+      return run_github(params);
+    }
+    if (tool == "replace_preview:") {
+      return run_replace_all(invocation.substr(colon + 1), true);
+    }
+  } catch (const std::exception &e) {
+    return "Error: " + std::string(e.what());
+  }
+  return "Unknown command";
+}
+
+std::string ToolExecutor::run_side_effect(const std::string &invocation) {
+  try {
+    if (invocation.rfind("write:", 0) == 0) {
+      // Format: write:filename content...
+      size_t space_pos = invocation.find(' ', 6);
+      if (space_pos == std::string::npos) {
+        return "Usage: write:filename content";
+      }
+      std::string filename = trim_copy(invocation.substr(6, space_pos - 6));
+      auto validation = Utils::Validator::validate_file_writable(filename);
+      if (!validation.is_valid) {
+        return "Error: " + validation.error_message;
+      }
+      return Services::FileService::write_file(
+          filename, invocation.substr(space_pos + 1));
+    }
+    if (invocation.rfind("replace:", 0) == 0) {
+      // Format: replace:filename:old_text:new_text[:expected_count]
+      std::vector<std::string> parts = split_params(invocation.substr(8), 4);
+      if (parts.size() < 3) {
+        return "Usage: replace:filename:old_text:new_text[:expected_count]";
+      }
+      int expected = (parts.size() > 3) ? std::stoi(parts[3]) : 1;
+      return Services::FileService::replace_text_in_file(
+                 parts[0], parts[1], parts[2], expected)
+          .message;
+    }
+    if (invocation.rfind("replace_all:", 0) == 0) {
+      return run_replace_all(invocation.substr(12), false);
+    }
+    if (invocation.rfind("cmd:", 0) == 0) {
+      return Services::CommandService::execute(
+          trim_copy(std::string_view(invocation).substr(4)));
+    }
+    if (invocation.rfind("github:sync:", 0) == 0) {
+      return run_github(trim_copy(std::string_view(invocation).substr(7)));
+    }
+    if (reads_only(invocation)) {
+      return run_read_only(invocation); // Outside the workspace
+    }
+  } catch (const std::exception &e) {
+    return "Error: " + std::string(e.what());
+  }
+  return "Unknown command";
+}
+
+std::chrono::milliseconds
+ToolScheduler::timeout_for(const std::string &invocation) {
+  using std::chrono::seconds;
+  if (invocation.rfind("cmd:", 0) == 0 ||
+      invocation.rfind("github:sync:", 0) == 0 ||
+      invocation.rfind("replace_all:", 0) == 0 ||
+      invocation.rfind("replace_preview:", 0) == 0) {
+    return seconds(120); // Commands, mirrors and edits across a tree
+  }
+  if (invocation.rfind("search:", 0) == 0 ||
+      invocation.rfind("github:", 0) == 0) {
+    return seconds(30); // Network round trips, possibly retried
+  }
+  return seconds(15);
+}
+
+ToolScheduler::ToolScheduler(std::size_t max_tools) : max_tools_(max_tools) {}
+
+void ToolScheduler::start(Entry &entry) {
+  entry.deadline = std::chrono::steady_clock::now() +
+                   timeout_for(entry.invocation);
+  entry.output = Utils::ThreadPool::shared().submit(
+      [invocation = entry.invocation, read_only = entry.read_only] {
+        return read_only ? ToolExecutor::run_read_only(invocation)
+                         : ToolExecutor::run_side_effect(invocation);
+      });
+}
+
+std::string ToolScheduler::wait(Entry &entry) {
+  if (entry.output->wait_until(entry.deadline) != std::future_status::ready) {
+    return "Error: " + entry.invocation + " timed out after " +
+           std::to_string(timeout_for(entry.invocation).count() / 1000) + "s";
+  }
+  return entry.output->get();
+}
+
+std::string ToolScheduler::finish(Entry &entry) {
+  if (entry.output->wait_until(entry.deadline) == std::future_status::ready) {
+    return entry.output->get();
+  }
+  // It can't be cancelled midway, so nothing after it may start yet
+  std::string output = entry.output->get();
+  return "Error: " + entry.invocation + " ran past its " +
+         std::to_string(timeout_for(entry.invocation).count() / 1000) +
+         "s timeout; output:\n" + output;
+}
+
+void ToolScheduler::settle_abandoned_reads() {
+  // Reads can't be cancelled midway, so let timed-out ones finish first
+  for (auto &entry : entries_) {
+    if (entry.read_only && entry.output && entry.output->valid()) {
+      entry.output->wait();
+    }
+  }
+  for (auto &output : abandoned_) {
+    output.wait();
+  }
+  abandoned_.clear();
+}
+
+bool ToolScheduler::submit(const std::string &invocation) {
+  if (entries_.size() >= max_tools_) {
+    return false;
+  }
+  bool read_only = ToolExecutor::is_read_only(invocation);
+  // A repeated read only returns the same output unless state changed
+  if (read_only && !has_side_effects_) {
+    for (const auto &entry : entries_) {
+      if (entry.invocation == invocation) {
+        return false;
+      }
+    }
+  }
+
+  entries_.push_back({invocation, read_only, std::nullopt, {}});
+  if (read_only && !has_side_effects_) {
+    start(entries_.back());
+  }
+  has_side_effects_ = has_side_effects_ || !read_only;
+  return true;
+}
+
+std::vector<std::string> ToolScheduler::side_effects() const {
+  std::vector<std::string> invocations;
+  for (const auto &entry : entries_) {
+    if (!entry.read_only) {
+      invocations.push_back(entry.invocation);
+    }
+  }
+  return invocations;
+}
+
+std::vector<ToolResult> ToolScheduler::collect(bool run_side_effects) {
+  std::vector<ToolResult> results(entries_.size());
+  std::vector<bool> collected(entries_.size(), false);
+  auto collect_reads_before = [&](size_t end) {
+    for (size_t j = 0; j < end; ++j) {
+      if (entries_[j].read_only && !collected[j]) {
+        results[j].output = wait(entries_[j]);
+        collected[j] = true;
+      }
+    }
+  };
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    Entry &entry = entries_[i];
+    results[i].invocation = entry.invocation;
+    if (entry.read_only) {
+      if (!entry.output) {
+        start(entry); // Held back behind an earlier side effect
+      }
+      continue;
+    }
+    if (!run_side_effects) {
+      results[i].output = "Not run: side-effecting commands need approval";
+      continue;
+    }
+    // Barrier: everything submitted earlier sees the state before this
+    collect_reads_before(i);
+    settle_abandoned_reads();
+    start(entry);
+    results[i].output = finish(entry);
+  }
+  collect_reads_before(entries_.size());
+
+  for (auto &entry : entries_) {
+    if (entry.output && entry.output->valid()) {
+      abandoned_.push_back(std::move(*entry.output)); // Timed out
+    }
+  }
+  entries_.clear();
+  has_side_effects_ = false;
+  return results;
+}
+
+void SpeculativeToolRunner::on_line(std::string_view line) {
+  std::optional<std::string> invocation = ToolExecutor::parse_invocation(line);
+  if (invocation) {
+    scheduler_.submit(*invocation);
+  }
+}
+
+void SpeculativeToolRunner::feed(std::string_view chunk) {
+  size_t start = 0;
+  size_t newline;
+  while ((newline = chunk.find('\n', start)) != std::string_view::npos) {
+    if (line_.empty()) {
+      on_line(chunk.substr(start, newline - start));
+    } else {
+      line_.append(chunk.substr(start, newline - start));
+      on_line(line_);
+      line_.clear();
+    }
+    start = newline + 1;
+  }
+  line_.append(chunk.substr(start));
+}
+
+void SpeculativeToolRunner::finish() {
+  if (!line_.empty()) {
+    on_line(line_);
+    line_.clear();
+  }
+}
+
+} // namespace Core
@@ -1,10 +1,15 @@
 #include "services/ai_service.h"
 #include "core/agent_mode.h"
+#include "services/rate_limiter.h"
+#include "services/retry_scheduler.h"
 #include "services/web_service.h"
 #include "utils/config.h"
+#include "utils/json_stream.h"
+#include <charconv>
+#include <chrono>
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
-#include <sstream>
+#include <optional>
 
 // Use the HeaderMap from web_service.h
 
@@ -12,6 +17,8 @@
 
 namespace Services {
 
+static const size_t kErrorPreviewLength = 500;
+
 AIService::AIService(Core::AgentMode mode, const std::string &api_key)
     : mode_(mode), api_key_(api_key) {}
 
@@ -24,6 +31,12 @@ bool AIService::is_online_mode() const {
          mode_ == Core::AgentMode::MODE_OPENAI;
 }
 
+bool AIService::supports_session() const {
+  return mode_ == Core::AgentMode::MODE_LLAMA_3B ||
+         mode_ == Core::AgentMode::MODE_LLAMA_LATEST ||
+         mode_ == Core::AgentMode::MODE_LLAMA_31;
+}
+
 bool AIService::is_available() {
   // For online providers API key is required.
   if (is_online_mode()) {
@@ -33,6 +46,32 @@ bool AIService::is_available() {
   return true;
 }
 
+std::string AIService::get_provider_name() const {
+  switch (mode_) {
+  case Core::AgentMode::MODE_TOGETHER:
+    return "together";
+  case Core::AgentMode::MODE_CEREBRAS:
+    return "cerebras";
+  case Core::AgentMode::MODE_FIREWORKS:
+    return "fireworks";
+  case Core::AgentMode::MODE_GROQ:
+    return "groq";
+  case Core::AgentMode::MODE_DEEPSEEK:
+    return "deepseek";
+  case Core::AgentMode::MODE_OPENAI:
+    return "openai";
+  case Core::AgentMode::MODE_LLAMA_3B:
+    return "ollama:llama3.2:3b";
+  case Core::AgentMode::MODE_LLAMA_LATEST:
+    return "ollama:llama3.2:latest";
+  case Core::AgentMode::MODE_LLAMA_31:
+    return "ollama:llama3.1:latest";
+  case Core::AgentMode::MODE_UNSET:
+    break;
+  }
+  return "unknown";
+}
+
 std::string AIService::get_api_url() {
   if (std::getenv("TEST_MODE")) {
     // Use mock URLs for testing
@@ -78,155 +117,215 @@ std::string AIService::get_api_url() {
   }
 }
 
-nlohmann::json AIService::create_standard_payload(const std::string &model,
-                                                  const std::string &user_input,
-                                                  const std::string &context) {
-  std::string system_prompt = "You are a helpful AI assistant. " + context;
-  return {{"model", model},
-          {"messages",
-           {{{"role", "system"}, {"content", system_prompt}},
-            {{"role", "user"}, {"content", user_input}}}},
-          {"max_tokens", 1000},
-          {"temperature", 0.7}};
+// How long Ollama keeps the model (and its KV cache) loaded after a request
+static constexpr std::string_view kOllamaKeepAlive = "30m";
+
+// Conversation size at which a session restarts from a fresh system message
+// rather than overflow the model's default context window
+static constexpr long long kSessionTokenBudget = 3072;
+
+static constexpr std::string_view kStandardPromptPrefix =
+    "You are a helpful AI assistant. ";
+
+static constexpr std::string_view kSystemPrompt =
+    "You are an advanced AI agent with comprehensive codebase analysis and "
+    "development capabilities.\n\n"
+    "BASIC COMMANDS:\n"
+    "• search:query - Search the web for information\n"
+    "• cmd:command - Execute shell commands safely\n"
+    "• read:filename - Read file contents\n"
+    "• read:filename:start:count - Read specific line ranges from files\n"
+    "• write:filename content - Write content to files\n\n"
+    "ADVANCED FILE OPERATIONS:\n"
+    "• replace:filename:old_text:new_text[:expected_count] - Replace text in "
+    "files with precision\n"
+    "• replace_all:glob:old_text:new_text[:expected_per_file] - Replace text "
+    "in every file matching a glob such as src/**/*.cpp, all or nothing\n"
+    "• replace_preview:glob:old_text:new_text - Show what replace_all would "
+    "change without writing\n"
+    "• grep:pattern[:directory[:file_filter]] - Search for patterns in files "
+    "and directories\n\n"
+    "CODEBASE ANALYSIS:\n"
+    "• analyze:path - Analyze codebase structure, file types, and project "
+    "configuration\n"
+    "• components:path - Find main components and their relationships\n"
+    "• todos:path - Find all task comments in codebase\n"
+    "• tree:path - Display directory tree structure\n\n"
+    "GIT INTEGRATION:\n"
+    "• git:log - Show recent git commit history\n"
+    "• git:status - Show git working directory status\n"
+    "• git:analyze - Comprehensive git repository analysis\n\n"
+    "MEMORY MANAGEMENT:\n"
+    "• remember:fact - Save important facts to persistent global memory\n"
+    "• memory - View stored global memories\n"
+    "• clear - Clear current session memory\n"
+    "• forget - Clear all global memories\n\n"
+    "CAPABILITIES:\n"
+    "- Understand codebase structure and relationships\n"
+    "- Analyze git history and track changes\n"
+    "- Find and prioritize task comments\n"
+    "- Advanced text search and replacement with context validation\n"
+    "- Structured memory system for facts and preferences\n"
+    "- File operations with safety checks and path validation\n"
+    "- Enhanced error handling and user feedback\n\n"
+    "When users ask about codebase analysis, use analyze: or components: "
+    "commands.\n"
+    "For git-related questions, use git: commands.\n"
+    "For finding tasks or technical debt, use todos: command.\n"
+    "For complex file editing, use replace: instead of write: when modifying "
+    "existing content.\n"
+    "Use grep: to search for code patterns or text across multiple files.\n"
+    "Remember important user preferences and facts using remember:.\n"
+    "Put each command alone on its own line; read-only commands run as soon "
+    "as the line is written and their output is sent back to you.\n"
+    "Be helpful, precise, and professional.\n\n"
+    "Conversation history:\n";
+
+// Appends {"model":...,"messages":[system, history..., user] without the
+// closing brace; the system prompt and context pieces are escaped straight
+// from their owners instead of being concatenated first. `history` holds
+// alternating user/assistant contents of earlier turns.
+static void append_messages(Utils::JsonRope &body, std::string_view model,
+                            std::string_view prompt_prefix,
+                            const std::string &user_input,
+                            const std::vector<std::string_view> &context,
+                            const std::vector<std::string> &history = {}) {
+  body.raw("{\"model\":\"")
+      .raw(model)
+      .raw("\",\"messages\":[{\"role\":\"system\",\"content\":\"")
+      .escaped(prompt_prefix)
+      .escaped(kSystemPrompt);
+  for (std::string_view piece : context) {
+    body.escaped(piece);
+  }
+  body.raw("\"}");
+  for (std::size_t i = 0; i < history.size(); ++i) {
+    body.raw(i % 2 == 0 ? ",{\"role\":\"user\",\"content\":"
+                        : ",{\"role\":\"assistant\",\"content\":")
+        .string({history[i]})
+        .raw("}");
+  }
+  body.raw(",{\"role\":\"user\",\"content\":")
+      .string({user_input})
+      .raw("}]");
 }
 
-nlohmann::json AIService::create_payload(const std::string &user_input,
-                                         const std::string &context) {
-  std::string system_prompt =
-      "You are an advanced AI agent with comprehensive codebase analysis and "
-      "development capabilities.\n\n"
-      "BASIC COMMANDS:\n"
-      "• search:query - Search the web for information\n"
-      "• cmd:command - Execute shell commands safely\n"
-      "• read:filename - Read file contents\n"
-      "• read:filename:start:count - Read specific line ranges from files\n"
-      "• write:filename content - Write content to files\n\n"
-      "ADVANCED FILE OPERATIONS:\n"
-      "• replace:filename:old_text:new_text[:expected_count] - Replace text in "
-      "files with precision\n"
-      "• grep:pattern[:directory[:file_filter]] - Search for patterns in files "
-      "and directories\n\n"
-      "CODEBASE ANALYSIS:\n"
-      "• analyze:path - Analyze codebase structure, file types, and project "
-      "configuration\n"
-      "• components:path - Find main components and their relationships\n"
-      "• todos:path - Find all task comments in codebase\n"
-      "• tree:path - Display directory tree structure\n\n"
-      "GIT INTEGRATION:\n"
-      "• git:log - Show recent git commit history\n"
-      "• git:status - Show git working directory status\n"
-      "• git:analyze - Comprehensive git repository analysis\n\n"
-      "MEMORY MANAGEMENT:\n"
-      "• remember:fact - Save important facts to persistent global memory\n"
-      "• memory - View stored global memories\n"
-      "• clear - Clear current session memory\n"
-      "• forget - Clear all global memories\n\n"
-      "CAPABILITIES:\n"
-      "- Understand codebase structure and relationships\n"
-      "- Analyze git history and track changes\n"
-      "- Find and prioritize task comments\n"
-      "- Advanced text search and replacement with context validation\n"
-      "- Structured memory system for facts and preferences\n"
-      "- File operations with safety checks and path validation\n"
-      "- Enhanced error handling and user feedback\n\n"
-      "When users ask about codebase analysis, use analyze: or components: "
-      "commands.\n"
-      "For git-related questions, use git: commands.\n"
-      "For finding tasks or technical debt, use todos: command.\n"
-      "For complex file editing, use replace: instead of write: when modifying "
-      "existing content.\n"
-      "Use grep: to search for code patterns or text across multiple files.\n"
-      "Remember important user preferences and facts using remember:.\n"
-      "Be helpful, precise, and professional.\n\n"
-      "Conversation history:\n" +
-      context;
+Utils::JsonRope
+AIService::create_payload(const std::string &user_input,
+                          const std::vector<std::string_view> &context) const {
+  Utils::JsonRope body;
 
+  // Hosted OpenAI-compatible endpoints share one request shape
+  std::string_view standard_model;
   switch (mode_) {
   case Core::AgentMode::MODE_TOGETHER: // Together AI
-    return create_standard_payload(
-        "meta-llama/Llama-3.3-70B-Instruct-Turbo-Free", user_input,
-        system_prompt);
-  case Core::AgentMode::MODE_CEREBRAS: // Cerebras
-    return {{"model", "llama-4-maverick-17b-128e-instruct"},
-            {"messages",
-             {{{"role", "system"}, {"content", system_prompt}},
-              {{"role", "user"}, {"content", user_input}}}},
-            {"stream", true},
-            {"max_completion_tokens", 4096},
-            {"temperature", 0.7},
-            {"top_p", 0.9}};
+    standard_model = "meta-llama/Llama-3.3-70B-Instruct-Turbo-Free";
+    break;
   case Core::AgentMode::MODE_FIREWORKS: // Fireworks
-    return create_standard_payload(
-        "accounts/fireworks/models/llama-v3-70b-instruct", user_input,
-        system_prompt);
+    standard_model = "accounts/fireworks/models/llama-v3-70b-instruct";
+    break;
   case Core::AgentMode::MODE_GROQ: // Groq
-    return create_standard_payload("llama-3.1-70b-versatile", user_input,
-                                   system_prompt);
+    standard_model = "llama-3.1-70b-versatile";
+    break;
   case Core::AgentMode::MODE_DEEPSEEK: // DeepSeek
-    return create_standard_payload("deepseek-chat", user_input, system_prompt);
+    standard_model = "deepseek-chat";
+    break;
   case Core::AgentMode::MODE_OPENAI: // OpenAI
-    return create_standard_payload("gpt-4", user_input, system_prompt);
-  case Core::AgentMode::MODE_LLAMA_3B: // Llama 3B (local)
-    return {{"model", "llama3.2:3b"},
-            {"stream", false},
-            {"messages",
-             {{{"role", "system"}, {"content", system_prompt}},
-              {{"role", "user"}, {"content", user_input}}}}};
+    standard_model = "gpt-4";
+    break;
+  default:
+    break;
+  }
 
-  case Core::AgentMode::MODE_LLAMA_LATEST: // Llama latest (local)
-    return {{"model", "llama3.2:latest"},
-            {"stream", false},
-            {"messages",
-             {{{"role", "system"}, {"content", system_prompt}},
-              {{"role", "user"}, {"content", user_input}}}}};
+  if (!standard_model.empty()) {
+    append_messages(body, standard_model, kStandardPromptPrefix, user_input,
+                    context);
+    body.raw(",\"max_tokens\":1000,\"temperature\":0.7}");
+    return body;
+  }
+
+  if (mode_ == Core::AgentMode::MODE_CEREBRAS) { // Cerebras
+    append_messages(body, "llama-4-maverick-17b-128e-instruct", "", user_input,
+                    context);
+    body.raw(",\"stream\":true,\"max_completion_tokens\":4096,"
+             "\"temperature\":0.7,\"top_p\":0.9}");
+    return body;
+  }
+
+  append_messages(body, get_local_model(), "", user_input, context);
+  body.raw(",\"stream\":true,\"keep_alive\":\"")
+      .raw(kOllamaKeepAlive)
+      .raw("\"}");
+  return body;
+}
+
+Utils::JsonRope
+AIService::create_session_payload(const std::string &user_input) const {
+  // Earlier turns are replayed verbatim between the frozen system message and
+  // the new prompt, so every request extends the previous one
+  Utils::JsonRope body;
+  append_messages(body, get_local_model(), "", user_input, {session_.context},
+                  session_.messages);
+  body.raw(",\"stream\":true,\"keep_alive\":\"")
+      .raw(kOllamaKeepAlive)
+      .raw("\"}");
+  return body;
+}
 
+std::string_view AIService::get_local_model() const {
+  switch (mode_) {
+  case Core::AgentMode::MODE_LLAMA_LATEST: // Llama latest (local)
+    return "llama3.2:latest";
   case Core::AgentMode::MODE_LLAMA_31: // Llama 3.1 (local)
-    return {{"model", "llama3.1:latest"},
-            {"stream", false},
-            {"messages",
-             {{{"role", "system"}, {"content", system_prompt}},
-              {{"role", "user"}, {"content", user_input}}}}};
-
-  default: // Fallback to Llama 3B
-    return {{"model", "llama3.2:3b"},
-            {"stream", false},
-            {"messages",
-             {{{"role", "system"}, {"content", system_prompt}},
-              {{"role", "user"}, {"content", user_input}}}}};
+    return "llama3.1:latest";
+  case Core::AgentMode::MODE_LLAMA_3B: // Llama 3B (local)
+  default:                             // Fallback to Llama 3B
+    return "llama3.2:3b";
   }
 }
 
-std::string AIService::parse_cerebras_stream(const std::string &response) {
-  // Response is server-sent events style; accumulate content deltas.
-  std::string result;
-  std::istringstream stream(response);
-  std::string line;
-
-  while (std::getline(stream, line)) {
-    // trim leading spaces
-    if (line.rfind("data: ", 0) == 0) {
-      std::string json_str = line.substr(6);
-      if (json_str == "[DONE]")
-        break;
-
-      try {
-        auto json = nlohmann::json::parse(json_str);
-        if (json.contains("choices") && !json["choices"].empty()) {
-          auto &choice = json["choices"][0];
-          if (choice.contains("delta") && choice["delta"].contains("content")) {
-            // content might be string
-            result += choice["delta"]["content"].get<std::string>();
-          } else if (choice.contains("text")) {
-            result += choice["text"].get<std::string>();
-          }
-        }
-      } catch (const std::exception &) {
-        // ignore malformed chunk and continue
-        continue;
-      }
-    }
+std::vector<std::string> AIService::get_response_fields() const {
+  std::vector<std::string> fields = {
+      "usage.prompt_tokens", "usage.completion_tokens", "prompt_eval_count",
+      "eval_count", "eval_duration"};
+
+  switch (mode_) {
+  case Core::AgentMode::MODE_CEREBRAS: // Server-sent event deltas
+    fields.insert(fields.end(), {"choices.0.delta.content", "choices.0.text"});
+    break;
+  case Core::AgentMode::MODE_LLAMA_3B: // Ollama NDJSON chunks
+  case Core::AgentMode::MODE_LLAMA_LATEST:
+  case Core::AgentMode::MODE_LLAMA_31:
+    fields.insert(fields.end(), {"message.content", "response"});
+    break;
+  default:
+    fields.insert(fields.end(),
+                  {"choices.0.message.content", "choices.0.text"});
+    break;
+  }
+  return fields;
+}
+
+bool AIService::record_usage_field(std::string_view path,
+                                   std::string_view value) {
+  long long *target = nullptr;
+  if (path == "usage.prompt_tokens" || path == "prompt_eval_count") {
+    target = &last_usage_.prompt_tokens;
+  } else if (path == "usage.completion_tokens" || path == "eval_count") {
+    target = &last_usage_.completion_tokens;
+  } else if (path == "eval_duration") {
+    target = &last_eval_duration_ns_;
+  } else {
+    return false;
+  }
+
+  long long parsed = 0;
+  auto [ptr, ec] =
+      std::from_chars(value.data(), value.data() + value.size(), parsed);
+  if (ec == std::errc()) {
+    *target = parsed;
   }
-  return result;
+  return true;
 }
 
 std::string safe_get_string(const nlohmann::json &j,
@@ -245,12 +344,93 @@ std::string safe_get_string(const nlohmann::json &j,
 
 std::string AIService::chat(const std::string &user_input,
                             const std::string &context) {
+  return chat(user_input, std::vector<std::string_view>{context});
+}
+
+std::string AIService::chat(const std::string &user_input,
+                            const std::vector<std::string_view> &context) {
   if (!is_available()) {
     return "Error: AI service is not available. Please check your API key and "
            "internet connection.";
   }
 
   auto payload = create_payload(user_input, context);
+  return complete(payload);
+}
+
+std::string AIService::chat_in_session(
+    const std::string &user_input, const std::vector<std::string_view> &context,
+    std::size_t session_key, std::string_view recent) {
+  if (!supports_session()) {
+    return chat(user_input, context);
+  }
+
+  // Reuse is only safe while the rendered prefix stays byte-identical
+  bool continuing = session_.active && session_.key == session_key &&
+                    session_.cached_tokens < kSessionTokenBudget;
+  if (!continuing) {
+    reset_session();
+    for (std::string_view piece : context) {
+      session_.context.append(piece);
+    }
+    session_.key = session_key;
+  }
+
+  // A fresh session already has them in its context; a continued one gets
+  // them appended, which leaves the cached prefix intact
+  std::string message = user_input;
+  if (continuing && !recent.empty()) {
+    message = "Since your last reply:\n" + std::string(recent) + "\n" +
+              user_input;
+  }
+  auto payload = create_session_payload(message);
+  long long previous_tokens = session_.cached_tokens;
+  TurnMetrics metrics;
+  std::string response = complete(payload, &metrics);
+  if (!metrics.success) {
+    return response;
+  }
+
+  // Ollama reports only the prompt tokens it had to evaluate, so a count
+  // below what the server already held means the cached prefix was used
+  bool reused = continuing && last_usage_.prompt_tokens < previous_tokens;
+  session_.cached_tokens = (reused ? previous_tokens : 0) +
+                           last_usage_.prompt_tokens +
+                           last_usage_.completion_tokens;
+  session_.active = true;
+  session_.messages.push_back(message);
+  session_.messages.push_back(response);
+  if (reused) {
+    TelemetryService::record_prompt_cache_hit(metrics.provider);
+  }
+  return response;
+}
+
+void AIService::reset_session() { session_ = {}; }
+
+bool AIService::warm_up(const std::atomic<bool> &cancelled) {
+  if (!is_available()) {
+    return false;
+  }
+
+  std::string url = get_api_url();
+  std::string body;
+  if (supports_session()) {
+    // A generate request without a prompt only loads the model
+    const std::string chat_endpoint = "/api/chat";
+    std::size_t endpoint = url.rfind(chat_endpoint);
+    if (endpoint != std::string::npos) {
+      url.replace(endpoint, chat_endpoint.size(), "/api/generate");
+    }
+    body = "{\"model\":\"" + std::string(get_local_model()) +
+           "\",\"keep_alive\":\"" + std::string(kOllamaKeepAlive) + "\"}";
+  }
+
+  return WebService::warm_up(url, body, cancelled).success;
+}
+
+std::string AIService::complete(Utils::JsonRope &payload,
+                                TurnMetrics *turn_metrics) {
   auto url = get_api_url();
 
   try {
@@ -280,82 +460,124 @@ std::string AIService::chat(const std::string &user_input,
       break;
     }
 
-    // Use WebService to make the HTTP request
-    WebService web_service;
-    std::string json_body = payload.dump();
-
-    WebResponse response;
-    if (mode_ == Core::AgentMode::MODE_TOGETHER ||
-        mode_ == Core::AgentMode::MODE_CEREBRAS ||
-        mode_ == Core::AgentMode::MODE_FIREWORKS ||
-        mode_ == Core::AgentMode::MODE_GROQ ||
-        mode_ == Core::AgentMode::MODE_DEEPSEEK ||
-        mode_ == Core::AgentMode::MODE_OPENAI ||
-        mode_ == Core::AgentMode::MODE_LLAMA_3B ||
-        mode_ == Core::AgentMode::MODE_LLAMA_LATEST ||
-        mode_ == Core::AgentMode::MODE_LLAMA_31) {
-      // All providers use POST
-      response = web_service.post_json(url, json_body, headers);
-    } else {
-      // Fallback (should not happen)
-      response = web_service.post_json(url, json_body, headers);
-    }
+    // Pull only the content and usage fields out of the body as it streams
+    // in; nothing but a short preview of the raw bytes is retained.
+    std::string content;
+    bool has_content = false;
+    std::string raw_preview;
+    std::optional<std::chrono::steady_clock::time_point> first_token;
+    std::optional<Utils::JsonFieldExtractor> extractor;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Rate-limit and overload replies arrive before any content, so each
+    // retry starts decoding from scratch
+    WebResponse response = RetryScheduler::execute(url, [&] {
+      last_usage_ = {};
+      last_eval_duration_ns_ = 0;
+      content.clear();
+      has_content = false;
+      raw_preview.clear();
+      first_token.reset();
+      extractor.emplace(
+          get_response_fields(),
+          [&](std::string_view path, std::string_view value) {
+            if (record_usage_field(path, value)) {
+              return;
+            }
+            if (!first_token && !value.empty()) {
+              first_token = std::chrono::steady_clock::now();
+            }
+            content.append(value);
+            has_content = true;
+            if (content_observer_) {
+              content_observer_(value);
+            }
+          },
+          mode_ == Core::AgentMode::MODE_CEREBRAS
+              ? Utils::JsonFieldExtractor::Framing::ServerSentEvents
+              : Utils::JsonFieldExtractor::Framing::Json);
+
+      WebResponse attempt = WebService::post_json_stream(
+          url, payload, headers, [&](std::string_view chunk) {
+            if (raw_preview.size() < kErrorPreviewLength) {
+              raw_preview.append(
+                  chunk.substr(0, kErrorPreviewLength - raw_preview.size()));
+            }
+            extractor->feed(chunk);
+          });
+      // A reply cut off before any text was shown is retried like a lost
+      // connection; once text has reached the observer it would repeat
+      if (!attempt.success && attempt.status_code == 200 && !has_content) {
+        attempt.status_code = 0;
+      }
+      return attempt;
+    });
+
+    auto end = std::chrono::steady_clock::now();
+    TurnMetrics metrics;
+    metrics.provider = get_provider_name();
+    metrics.total_ms =
+        std::chrono::duration<double, std::milli>(end - start).count();
+    metrics.ttft_ms =
+        first_token
+            ? std::chrono::duration<double, std::milli>(*first_token - start)
+                  .count()
+            : metrics.total_ms;
 
     if (response.status_code != 200) {
-      std::string error_content = response.content;
-      if (error_content.length() > 500) {
-        error_content = error_content.substr(0, 500) + "...[truncated]";
+      TelemetryService::record_turn(metrics);
+      std::string error_content = raw_preview;
+      if (error_content.length() >= kErrorPreviewLength) {
+        error_content += "...[truncated]";
       }
       return "Error: AI service returned status code " +
              std::to_string(response.status_code) + " - " + error_content +
              " | Error: " + response.error_message;
     }
 
-    // Handle streaming response for Cerebras
-    if (mode_ == Core::AgentMode::MODE_CEREBRAS) {
-      return parse_cerebras_stream(response.content);
+    if (!response.success) {
+      // The status was fine but the transfer broke off mid-reply
+      TelemetryService::record_turn(metrics);
+      return "Error: AI service response was interrupted - " +
+             response.error_message;
     }
 
-    // Parse the response based on the service
-    auto json_response = nlohmann::json::parse(response.content);
+    if (!has_content) {
+      TelemetryService::record_turn(metrics);
+      // If we get here, the response format wasn't as expected
+      return "Error: Unexpected response format from AI service: " +
+             raw_preview;
+    }
 
-    // Handle different response formats
-    switch (mode_) {
-    case Core::AgentMode::MODE_TOGETHER:  // Together AI
-    case Core::AgentMode::MODE_FIREWORKS: // Fireworks
-    case Core::AgentMode::MODE_GROQ:      // Groq
-    case Core::AgentMode::MODE_DEEPSEEK:  // DeepSeek
-    case Core::AgentMode::MODE_OPENAI:    // OpenAI
-    case Core::AgentMode::MODE_CEREBRAS:  // Cerebras
-      if (json_response.contains("choices") &&
-          !json_response["choices"].empty()) {
-        auto &choice = json_response["choices"][0];
-        if (choice.contains("message") &&
-            choice["message"].contains("content")) {
-          return choice["message"]["content"].get<std::string>();
-        } else if (choice.contains("text")) {
-          return choice["text"].get<std::string>();
-        }
-      }
-      break;
-    case Core::AgentMode::MODE_LLAMA_3B: // Local Ollama
-    case Core::AgentMode::MODE_LLAMA_LATEST:
-    case Core::AgentMode::MODE_LLAMA_31:
-      if (json_response.contains("message") &&
-          json_response["message"].contains("content")) {
-        return json_response["message"]["content"].get<std::string>();
-      } else if (json_response.contains("response")) {
-        return json_response["response"].get<std::string>();
-      }
-      break;
-    case Core::AgentMode::MODE_UNSET:
-      // No action
-      break;
+    // Prefer the server's own decode time; for the streamed Cerebras
+    // response, time the generation phase after the first token arrived.
+    metrics.success = true;
+    metrics.usage = last_usage_;
+    if (last_usage_.total_tokens() > 0) {
+      // The limiter charged a size-based estimate; settle the difference
+      RateLimiter::consume_tokens(
+          url, headers,
+          static_cast<double>(last_usage_.total_tokens()) -
+              RateLimiter::estimate_tokens(payload.size()));
+    }
+    double generation_ms = metrics.total_ms;
+    if (last_eval_duration_ns_ > 0) {
+      generation_ms = static_cast<double>(last_eval_duration_ns_) / 1e6;
+    } else if (mode_ == Core::AgentMode::MODE_CEREBRAS && first_token) {
+      generation_ms = metrics.total_ms - metrics.ttft_ms;
+    }
+    if (generation_ms > 0.0 && last_usage_.completion_tokens > 0) {
+      metrics.tokens_per_second =
+          static_cast<double>(last_usage_.completion_tokens) * 1000.0 /
+          generation_ms;
+    }
+    TelemetryService::record_turn(metrics);
+    if (turn_metrics) {
+      *turn_metrics = metrics;
     }
 
-    // If we get here, the response format wasn't as expected
-    return "Error: Unexpected response format from AI service: " +
-           response.content;
+    return content;
 
   } catch (const std::exception &e) {
     return "Error: " + std::string(e.what());
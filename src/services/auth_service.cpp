@@ -22,6 +22,7 @@
 // Initialize static members
 namespace Services {
 std::map<std::string, AuthProvider> AuthService::providers;
+std::mutex AuthService::providers_mutex;
 std::string AuthService::active_provider = "together";
 std::vector<unsigned char> AuthService::encryption_key;
 std::string AuthService::key_file_path = "data/encryption_key.bin";
@@ -398,7 +399,9 @@ Services::AuthService::decrypt_credential(const std::string &encrypted_hex) {
   return std::string(plaintext.begin(), plaintext.end());
 }
 
-void Services::AuthService::initialize_default_providers() {
+std::map<std::string, Services::AuthProvider>
+Services::AuthService::default_providers() {
+  std::map<std::string, AuthProvider> defaults;
   // Together AI
   AuthProvider together;
   together.name = "together";
@@ -406,7 +409,7 @@ void Services::AuthService::initialize_default_providers() {
   together.base_url = "https://api.together.xyz/v1";
   together.model = "meta-llama/Llama-3.2-3B-Instruct-Turbo";
   together.is_active = true;
-  providers["together"] = together;
+  defaults["together"] = together;
 
   // Ollama (local)
   AuthProvider ollama;
@@ -415,7 +418,7 @@ void Services::AuthService::initialize_default_providers() {
   ollama.base_url = "http://localhost:11434/v1";
   ollama.model = "llama3.2:3b";
   ollama.api_key = "ollama"; // Placeholder for local
-  providers["ollama"] = ollama;
+  defaults["ollama"] = ollama;
 
   // OpenAI
   AuthProvider openai;
@@ -423,7 +426,7 @@ void Services::AuthService::initialize_default_providers() {
   openai.display_name = "OpenAI";
   openai.base_url = "https://api.openai.com/v1";
   openai.model = "gpt-4";
-  providers["openai"] = openai;
+  defaults["openai"] = openai;
 
   // Anthropic
   AuthProvider anthropic;
@@ -431,7 +434,7 @@ void Services::AuthService::initialize_default_providers() {
   anthropic.display_name = "Anthropic Claude";
   anthropic.base_url = "https://api.anthropic.com/v1";
   anthropic.model = "claude-3-sonnet-20240229";
-  providers["anthropic"] = anthropic;
+  defaults["anthropic"] = anthropic;
 
   // Cerebras
   AuthProvider cerebras;
@@ -439,7 +442,15 @@ void Services::AuthService::initialize_default_providers() {
   cerebras.display_name = "Cerebras";
   cerebras.base_url = "https://api.cerebras.ai/v1";
   cerebras.model = "llama3.1-8b";
-  providers["cerebras"] = cerebras;
+  defaults["cerebras"] = cerebras;
+  return defaults;
+}
+
+void Services::AuthService::initialize_default_providers() {
+  std::lock_guard<std::mutex> lock(providers_mutex);
+  for (auto &[name, provider] : default_providers()) {
+    providers[name] = std::move(provider);
+  }
 }
 
 void Services::AuthService::initialize() {
@@ -460,8 +471,12 @@ void Services::AuthService::initialize() {
     if (env_key && provider.api_key.empty()) {
       try {
         // Encrypt the API key before storing it
-        provider.api_key = encrypt_credential(env_key);
-        provider.is_valid = true;
+        std::string api_key = encrypt_credential(env_key);
+        {
+          std::lock_guard<std::mutex> lock(providers_mutex);
+          provider.api_key = std::move(api_key);
+          provider.is_valid = true;
+        }
         // Save the encrypted key to config
         save_auth_config();
       } catch (const std::exception &e) {
@@ -473,7 +488,10 @@ void Services::AuthService::initialize() {
 }
 
 bool Services::AuthService::add_provider(const AuthProvider &provider) {
-  providers[provider.name] = provider;
+  {
+    std::lock_guard<std::mutex> lock(providers_mutex);
+    providers[provider.name] = provider;
+  }
   return save_auth_config();
 }
 
@@ -490,7 +508,10 @@ bool Services::AuthService::remove_provider(const std::string &provider_name) {
     return false;
   }
 
-  providers.erase(it);
+  {
+    std::lock_guard<std::mutex> lock(providers_mutex);
+    providers.erase(it);
+  }
 
   // If we're removing the active provider, switch to together
   if (active_provider == provider_name) {
@@ -507,13 +528,16 @@ bool Services::AuthService::set_active_provider(
     return false;
   }
 
-  // Deactivate all providers
-  for (auto &[name, provider] : providers) {
-    provider.is_active = false;
-  }
+  {
+    std::lock_guard<std::mutex> lock(providers_mutex);
+    // Deactivate all providers
+    for (auto &[name, provider] : providers) {
+      provider.is_active = false;
+    }
 
-  // Activate the selected provider
-  it->second.is_active = true;
+    // Activate the selected provider
+    it->second.is_active = true;
+  }
   active_provider = provider_name;
 
   return save_auth_config();
@@ -651,6 +675,7 @@ bool Services::AuthService::load_auth_config() {
     }
 
     if (config.contains("providers")) {
+      std::lock_guard<std::mutex> lock(providers_mutex);
       for (const auto &[name, provider_json] : config["providers"].items()) {
         auto it = providers.find(name);
         if (it != providers.end()) {
@@ -704,11 +729,92 @@ bool Services::AuthService::update_provider_config(
     return false;
   }
 
-  for (const auto &[key, value] : config) {
-    it->second.additional_config[key] = value;
+  {
+    std::lock_guard<std::mutex> lock(providers_mutex);
+    for (const auto &[key, value] : config) {
+      it->second.additional_config[key] = value;
+    }
   }
 
-  return save_auth_config();
+  bool saved = save_auth_config();
+  RateLimiter::reload();
+  return saved;
+}
+
+std::map<std::string, Services::RateLimitConfig>
+Services::AuthService::load_rate_limits() {
+  std::map<std::string, RateLimitConfig> limits;
+
+  auto config_number = [](const std::map<std::string, std::string> &config,
+                          const std::string &key) {
+    auto it = config.find(key);
+    if (it == config.end()) {
+      return 0.0;
+    }
+    try {
+      return std::max(0.0, std::stod(it->second));
+    } catch (const std::exception &) {
+      return 0.0;
+    }
+  };
+
+  auto add_provider_limits =
+      [&](const std::string &base_url,
+          const std::map<std::string, std::string> &config) {
+        RateLimitConfig limit;
+        limit.host_requests_per_minute =
+            config_number(config, "host_requests_per_minute");
+        limit.requests_per_minute =
+            config_number(config, "requests_per_minute");
+        limit.tokens_per_minute = config_number(config, "tokens_per_minute");
+        if (!base_url.empty() && (limit.host_requests_per_minute > 0.0 ||
+                                  limit.requests_per_minute > 0.0 ||
+                                  limit.tokens_per_minute > 0.0)) {
+          limits[WebService::get_host(base_url)] = limit;
+        }
+      };
+
+  // Called from worker threads, so it works on a snapshot of the table
+  std::map<std::string, AuthProvider> known_providers;
+  {
+    std::lock_guard<std::mutex> lock(providers_mutex);
+    known_providers = providers;
+  }
+  if (known_providers.empty()) {
+    known_providers = default_providers();
+  }
+  for (const auto &[name, provider] : known_providers) {
+    add_provider_limits(provider.base_url, provider.additional_config);
+  }
+
+  try {
+    std::ifstream file(get_auth_config_path());
+    if (!file) {
+      return limits;
+    }
+    nlohmann::json config;
+    file >> config;
+
+    if (config.contains("providers")) {
+      for (const auto &[name, provider_json] : config["providers"].items()) {
+        auto known = known_providers.find(name);
+        std::string base_url = provider_json.value(
+            "base_url",
+            known != known_providers.end() ? known->second.base_url : "");
+        std::map<std::string, std::string> additional_config;
+        if (provider_json.contains("additional_config")) {
+          additional_config =
+              provider_json["additional_config"]
+                  .get<std::map<std::string, std::string>>();
+        }
+        add_provider_limits(base_url, additional_config);
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Failed to load rate limits: " << e.what() << std::endl;
+  }
+
+  return limits;
 }
 
 bool Services::AuthService::test_provider_connection(
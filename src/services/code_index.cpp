@@ -0,0 +1,463 @@
+#include "services/code_index.h"
+#include "services/file_service.h"
+#include "utils/literal_search.h"
+#include "utils/mapped_file.h"
+#include "utils/parallel_walk.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace Services {
+
+static constexpr char kMagic[8] = {'L', 'W', 'T', 'R', 'I', 'G', 'R', 'M'};
+static constexpr std::uint32_t kFormatVersion = 1;
+// Larger files are not indexed; every search reads them
+static constexpr std::uint64_t kMaxIndexedFileSize = 8 * 1024 * 1024;
+static constexpr std::uint32_t kTrigramCount = 1U << 24;
+
+static std::uint32_t fold(char c) {
+  auto byte = static_cast<unsigned char>(c);
+  return byte >= 'A' && byte <= 'Z' ? byte - 'A' + 'a' : byte;
+}
+
+// Distinct trigrams of `text`, sorted. Trigrams spanning a newline are left
+// out, since the literals searched for never contain one. `seen` is a bit
+// per trigram, clear before and after.
+static std::vector<std::uint32_t>
+trigrams_of(std::string_view text, std::vector<std::uint64_t> &seen) {
+  std::vector<std::uint32_t> found;
+  std::uint32_t trigram = 0;
+  std::size_t run = 0;
+  for (char c : text) {
+    if (c == '\n') {
+      run = 0;
+      continue;
+    }
+    trigram = ((trigram << 8) | fold(c)) & (kTrigramCount - 1);
+    if (++run >= 3) {
+      std::uint64_t bit = 1ULL << (trigram & 63);
+      std::uint64_t &word = seen[trigram >> 6];
+      if ((word & bit) == 0) {
+        word |= bit;
+        found.push_back(trigram);
+      }
+    }
+  }
+  for (std::uint32_t t : found) {
+    seen[t >> 6] &= ~(1ULL << (t & 63));
+  }
+  std::sort(found.begin(), found.end());
+  return found;
+}
+
+// Modification time and size of a file with a single stat where possible
+static bool stat_file(const std::filesystem::path &path,
+                      std::int64_t &modified, std::uint64_t &size) {
+#ifdef _WIN32
+  std::error_code time_error;
+  std::error_code size_error;
+  auto time = std::filesystem::last_write_time(path, time_error);
+  size = std::filesystem::file_size(path, size_error);
+  modified = static_cast<std::int64_t>(time.time_since_epoch().count());
+  return !time_error && !size_error;
+#else
+  struct stat info;
+  if (::stat(path.c_str(), &info) != 0) {
+    return false;
+  }
+#ifdef __APPLE__
+  const struct timespec &time = info.st_mtimespec;
+#else
+  const struct timespec &time = info.st_mtim;
+#endif
+  modified = static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+  size = static_cast<std::uint64_t>(info.st_size);
+  return true;
+#endif
+}
+
+CodeIndex::CodeIndex(std::string root, std::string index_path)
+    : root_(std::move(root)), index_path_(std::move(index_path)) {}
+
+bool CodeIndex::can_narrow(const std::string &pattern) {
+  bool exact = false;
+  auto literals = Utils::LiteralSearch::required_literals(pattern, exact);
+  return !literals.empty() &&
+         std::all_of(literals.begin(), literals.end(),
+                     [](const std::string &literal) {
+                       return literal.size() >= 3;
+                     });
+}
+
+bool CodeIndex::refresh(const std::string &subtree) {
+  struct Found {
+    std::string path;
+    std::int64_t modified;
+    std::uint64_t size;
+  };
+  const std::filesystem::path root(root_);
+  const std::string prefix = (root / "").generic_string();
+  // Files outside the subtree are left as they are
+  const std::string scope = subtree.empty() ? "" : subtree + "/";
+  std::vector<Found> found;
+  std::mutex found_mutex;
+  Utils::walk_files(
+      scope.empty() ? root : root / subtree, Utils::walk_threads(),
+      [](const std::filesystem::path &path) {
+        return FileService::is_text_file(path.string());
+      },
+      [&](const std::filesystem::path &path) {
+        Found file;
+        if (!stat_file(path, file.modified, file.size)) {
+          return true;
+        }
+        file.path = path.generic_string();
+        if (file.path.compare(0, prefix.size(), prefix) == 0) {
+          file.path.erase(0, prefix.size());
+        } else {
+          file.path = path.lexically_relative(root).generic_string();
+        }
+        std::lock_guard<std::mutex> lock(found_mutex);
+        found.push_back(std::move(file));
+        return true;
+      });
+
+  std::vector<char> present(files_.size(), 0);
+  std::vector<const Found *> changed;
+  for (const auto &file : found) {
+    auto known = by_path_.find(file.path);
+    if (known != by_path_.end()) {
+      present[known->second] = 1;
+    }
+    if (known == by_path_.end() ||
+        files_[known->second].modified != file.modified ||
+        files_[known->second].size != file.size) {
+      changed.push_back(&file);
+    }
+  }
+  bool modified = !changed.empty();
+  for (auto it = by_path_.begin(); it != by_path_.end();) {
+    if (present[it->second] == 0 &&
+        it->first.compare(0, scope.size(), scope) == 0) {
+      files_[it->second].live = false;
+      ++dead_files_;
+      it = by_path_.erase(it);
+      modified = true;
+    } else {
+      ++it;
+    }
+  }
+
+  std::vector<std::vector<std::uint32_t>> trigrams(changed.size());
+  std::vector<char> indexed(changed.size(), 0);
+  Utils::parallel_for(
+      changed.size(), Utils::walk_threads(), [&](std::size_t i) {
+        thread_local std::vector<std::uint64_t> seen(kTrigramCount / 64);
+        Utils::MappedFile file;
+        if (changed[i]->size <= kMaxIndexedFileSize &&
+            file.open((root / changed[i]->path).string())) {
+          trigrams[i] = trigrams_of(file.view(), seen);
+          indexed[i] = 1;
+        }
+        return true;
+      });
+
+  // Ids only grow, so appending keeps every posting list sorted
+  for (std::size_t i = 0; i < changed.size(); ++i) {
+    const Found &file = *changed[i];
+    auto known = by_path_.find(file.path);
+    if (known != by_path_.end()) {
+      files_[known->second].live = false;
+      ++dead_files_;
+    }
+    auto id = static_cast<std::uint32_t>(files_.size());
+    files_.push_back(
+        {file.path, file.modified, file.size, true, indexed[i] != 0});
+    by_path_[file.path] = id;
+    for (std::uint32_t trigram : trigrams[i]) {
+      postings_[trigram].push_back(id);
+    }
+  }
+
+  if (dead_files_ > by_path_.size()) {
+    compact();
+  }
+  return modified;
+}
+
+void CodeIndex::compact() {
+  constexpr std::uint32_t kGone = static_cast<std::uint32_t>(-1);
+  std::vector<std::uint32_t> renumbered(files_.size(), kGone);
+  std::vector<File> live;
+  for (std::size_t id = 0; id < files_.size(); ++id) {
+    if (files_[id].live) {
+      renumbered[id] = static_cast<std::uint32_t>(live.size());
+      live.push_back(std::move(files_[id]));
+    }
+  }
+  for (auto it = postings_.begin(); it != postings_.end();) {
+    std::vector<std::uint32_t> &ids = it->second;
+    std::size_t kept = 0;
+    for (std::uint32_t id : ids) {
+      if (renumbered[id] != kGone) {
+        ids[kept++] = renumbered[id];
+      }
+    }
+    ids.resize(kept);
+    it = ids.empty() ? postings_.erase(it) : std::next(it);
+  }
+  files_ = std::move(live);
+  by_path_.clear();
+  for (std::size_t id = 0; id < files_.size(); ++id) {
+    by_path_[files_[id].path] = static_cast<std::uint32_t>(id);
+  }
+  dead_files_ = 0;
+}
+
+std::optional<std::vector<std::string>>
+CodeIndex::candidates(const std::string &pattern) const {
+  if (!can_narrow(pattern)) {
+    return std::nullopt;
+  }
+  bool exact = false;
+  std::vector<std::uint32_t> ids;
+  for (const auto &literal :
+       Utils::LiteralSearch::required_literals(pattern, exact)) {
+    // Files holding every trigram of the literal, shortest list first
+    std::vector<const std::vector<std::uint32_t> *> lists;
+    for (std::size_t i = 0; i + 3 <= literal.size(); ++i) {
+      std::uint32_t trigram = (fold(literal[i]) << 16) |
+                              (fold(literal[i + 1]) << 8) |
+                              fold(literal[i + 2]);
+      auto postings = postings_.find(trigram);
+      if (postings == postings_.end()) {
+        lists.clear();
+        break;
+      }
+      lists.push_back(&postings->second);
+    }
+    if (lists.empty()) {
+      continue; // No file holds this literal
+    }
+    std::sort(lists.begin(), lists.end(), [](const auto *a, const auto *b) {
+      return a->size() < b->size();
+    });
+    std::vector<std::uint32_t> matching = *lists.front();
+    std::vector<std::uint32_t> narrowed;
+    for (std::size_t k = 1; k < lists.size() && !matching.empty(); ++k) {
+      narrowed.clear();
+      std::set_intersection(matching.begin(), matching.end(),
+                            lists[k]->begin(), lists[k]->end(),
+                            std::back_inserter(narrowed));
+      matching.swap(narrowed);
+    }
+    ids.insert(ids.end(), matching.begin(), matching.end());
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+  std::vector<std::string> paths;
+  for (std::uint32_t id : ids) {
+    if (files_[id].live) {
+      paths.push_back(files_[id].path);
+    }
+  }
+  for (const auto &file : files_) {
+    if (file.live && !file.indexed) {
+      paths.push_back(file.path);
+    }
+  }
+  return paths;
+}
+
+namespace {
+
+class Writer {
+public:
+  std::string buffer;
+
+  template <typename T> void fixed(T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    buffer.append(bytes, sizeof(T));
+  }
+  void varint(std::uint64_t value) {
+    while (value >= 0x80) {
+      buffer += static_cast<char>((value & 0x7F) | 0x80);
+      value >>= 7;
+    }
+    buffer += static_cast<char>(value);
+  }
+  void text(const std::string &value) {
+    varint(value.size());
+    buffer += value;
+  }
+};
+
+// Reads what Writer wrote; any read past the end marks it failed
+class Reader {
+public:
+  explicit Reader(std::string_view data) : data_(data) {}
+
+  [[nodiscard]] bool failed() const { return failed_; }
+
+  template <typename T> T fixed() {
+    T value{};
+    if (!take(sizeof(T))) {
+      return value;
+    }
+    std::memcpy(&value, data_.data() + position_ - sizeof(T), sizeof(T));
+    return value;
+  }
+  std::uint64_t varint() {
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64 && take(1); shift += 7) {
+      auto byte = static_cast<unsigned char>(data_[position_ - 1]);
+      value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    failed_ = true;
+    return 0;
+  }
+  std::string text() {
+    std::uint64_t length = varint();
+    if (failed_ || !take(length)) {
+      return {};
+    }
+    return std::string(data_.substr(position_ - length, length));
+  }
+
+private:
+  std::string_view data_;
+  std::size_t position_{0};
+  bool failed_{false};
+
+  bool take(std::uint64_t count) {
+    if (failed_ || count > data_.size() - position_) {
+      failed_ = true;
+      return false;
+    }
+    position_ += count;
+    return true;
+  }
+};
+
+} // namespace
+
+bool CodeIndex::save() const {
+  Writer out;
+  out.buffer.append(kMagic, sizeof(kMagic));
+  out.fixed(kFormatVersion);
+  out.text(root_);
+  out.varint(files_.size());
+  for (const auto &file : files_) {
+    out.text(file.path);
+    out.fixed(file.modified);
+    out.fixed(file.size);
+    out.fixed(static_cast<std::uint8_t>((file.live ? 1 : 0) |
+                                        (file.indexed ? 2 : 0)));
+  }
+  std::vector<std::uint32_t> trigrams;
+  for (const auto &[trigram, ids] : postings_) {
+    trigrams.push_back(trigram);
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  out.varint(trigrams.size());
+  for (std::uint32_t trigram : trigrams) {
+    const auto &ids = postings_.at(trigram);
+    out.fixed(trigram);
+    out.varint(ids.size());
+    std::uint32_t previous = 0;
+    for (std::uint32_t id : ids) {
+      out.varint(id - previous); // Ascending, so deltas stay small
+      previous = id;
+    }
+  }
+
+  // Written aside and renamed in, so a crash leaves the old index
+  std::error_code error;
+  std::filesystem::path path(index_path_);
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path(), error);
+  }
+  {
+    std::ofstream file(index_path_ + ".tmp",
+                       std::ios::binary | std::ios::trunc);
+    file.write(out.buffer.data(),
+               static_cast<std::streamsize>(out.buffer.size()));
+    if (!file) {
+      return false;
+    }
+  }
+  std::filesystem::rename(index_path_ + ".tmp", index_path_, error);
+  return !error;
+}
+
+bool CodeIndex::load() {
+  Utils::MappedFile mapped;
+  if (!mapped.open(index_path_)) {
+    return false;
+  }
+  std::string_view data = mapped.view();
+  if (data.size() < sizeof(kMagic) ||
+      std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+    return false;
+  }
+  Reader in(data.substr(sizeof(kMagic)));
+  if (in.fixed<std::uint32_t>() != kFormatVersion || in.text() != root_) {
+    return false;
+  }
+
+  std::vector<File> files(static_cast<std::size_t>(
+      std::min<std::uint64_t>(in.varint(), data.size())));
+  for (auto &file : files) {
+    file.path = in.text();
+    file.modified = in.fixed<std::int64_t>();
+    file.size = in.fixed<std::uint64_t>();
+    auto flags = in.fixed<std::uint8_t>();
+    file.live = (flags & 1) != 0;
+    file.indexed = (flags & 2) != 0;
+  }
+  std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> postings;
+  for (std::uint64_t count = in.varint(); count > 0 && !in.failed();
+       --count) {
+    auto &ids = postings[in.fixed<std::uint32_t>()];
+    std::uint64_t length = std::min<std::uint64_t>(in.varint(), data.size());
+    std::uint64_t id = 0;
+    for (std::uint64_t i = 0; i < length && !in.failed(); ++i) {
+      id += in.varint();
+      if (id >= files.size()) {
+        return false;
+      }
+      ids.push_back(static_cast<std::uint32_t>(id));
+    }
+  }
+  if (in.failed()) {
+    return false; // Truncated; the next refresh rebuilds it
+  }
+
+  files_ = std::move(files);
+  postings_ = std::move(postings);
+  by_path_.clear();
+  dead_files_ = 0;
+  for (std::size_t id = 0; id < files_.size(); ++id) {
+    if (files_[id].live) {
+      by_path_[files_[id].path] = static_cast<std::uint32_t>(id);
+    } else {
+      ++dead_files_;
+    }
+  }
+  return true;
+}
+
+} // namespace Services
@@ -1,13 +1,14 @@
 #include "services/command_service.h"
 
+#include "utils/aho_corasick.h"
 #include "utils/platform.h"
 
 #include <array>
+#include <cctype>
 #include <chrono>
 #include <cstdio>
 #include <cstring>
 #include <future>
-#include <regex>
 #include <stdexcept>
 
 namespace Services {
@@ -16,15 +17,22 @@ const std::array<std::string, 9> CommandService::dangerous_commands = {
     "reboot", "mkfs",    "fdisk",  "dd"};
 
 bool CommandService::is_dangerous_command(const std::string &command) {
-  // Token-based matching to avoid substring false positives
-  for (const auto &danger : dangerous_commands) {
-    std::regex pattern(
-        "\\b" + std::regex_replace(danger, std::regex(" "), "\\s+") + "\\b");
-    if (std::regex_search(command, pattern)) {
-      return true;
+  // Token-based matching to avoid substring false positives: whole words
+  // only, in one pass for all of them
+  static const Utils::AhoCorasick matcher(
+      {dangerous_commands.begin(), dangerous_commands.end()}, true, true);
+
+  // Any run of whitespace separates words like the single space in the list
+  std::string normalized;
+  normalized.reserve(command.size());
+  for (char c : command) {
+    if (!std::isspace(static_cast<unsigned char>(c))) {
+      normalized += c;
+    } else if (normalized.empty() || normalized.back() != ' ') {
+      normalized += ' ';
     }
   }
-  return false;
+  return matcher.contains(normalized);
 }
 
 std::string
@@ -1,15 +1,51 @@
 #include "services/file_service.h"
+#include "utils/atomic_file.h"
+#include "utils/config.h"
+#include "utils/literal_search.h"
+#include "utils/parallel_walk.h"
+#include <atomic>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <limits>
+#include <optional>
+#include <set>
 #include <sstream>
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <regex>
 
 namespace Services {
 static const std::size_t MAX_FILE_SIZE = 5 * 1024 * 1024; // 5 MB limit
+// Files whose line index is kept between range reads
+static const std::size_t MAX_LINE_INDEXES = 16;
+// Spans handed to the writer at a time while replacing
+static const std::size_t REPLACE_WRITE_BATCH = 1024;
+// Changed lines shown per file in a replacement preview, and their width
+static const int PREVIEW_LINES = 5;
+static const std::size_t PREVIEW_LINE_WIDTH = 200;
+// Files a batch replacement stages at once; more than there are cores,
+// since staging mostly waits for fdatasync
+static const std::size_t REPLACE_THREADS = 16;
+// Failed files listed when a batch replacement is refused
+static const std::size_t MAX_REPORTED_FAILURES = 20;
+// Trigram indexes kept in memory, and index files kept on disk
+static const std::size_t MAX_CODE_INDEXES = 4;
+static const std::size_t MAX_CODE_INDEX_FILES = 32;
+// Index files not used for this long are deleted
+static const int CODE_INDEX_MAX_AGE_DAYS = 30;
+
+std::map<std::string, FileService::CachedLineIndex> FileService::line_indexes;
+std::uint64_t FileService::line_index_clock = 0;
+std::mutex FileService::line_index_mutex;
+std::map<std::string, std::shared_ptr<FileService::CodeIndexEntry>>
+    FileService::code_indexes;
+std::uint64_t FileService::code_index_clock = 0;
+std::string FileService::code_index_directory;
+bool FileService::code_index_configured = false;
+std::mutex FileService::code_index_mutex;
 
 std::string FileService::read_file(const std::string &filename) {
   try {
@@ -37,6 +73,27 @@ std::string FileService::read_file(const std::string &filename) {
   }
 }
 
+Utils::LineIndex &
+FileService::line_index_for(const std::string &path,
+                            const Utils::MappedFile::Identity &identity) {
+  CachedLineIndex &cached = line_indexes[path];
+  if (cached.identity != identity) {
+    cached.identity = identity;
+    cached.index = Utils::LineIndex();
+  }
+  cached.last_used = ++line_index_clock;
+
+  if (line_indexes.size() > MAX_LINE_INDEXES) {
+    auto oldest = std::min_element(
+        line_indexes.begin(), line_indexes.end(),
+        [](const auto &a, const auto &b) {
+          return a.second.last_used < b.second.last_used;
+        });
+    line_indexes.erase(oldest);
+  }
+  return cached.index;
+}
+
 std::string FileService::read_file_range(const std::string &filename,
                                          int start_line, int line_count) {
   try {
@@ -44,34 +101,35 @@ std::string FileService::read_file_range(const std::string &filename,
       return "Error: File '" + filename + "' does not exist";
     }
 
-    std::ifstream file(filename);
-    if (!file.is_open()) {
+    Utils::MappedFile file;
+    if (!file.open(filename)) {
       return "Error: Could not open file '" + filename + "'";
     }
-
-    std::vector<std::string> lines;
-    std::string line;
-    while (std::getline(file, line)) {
-      lines.push_back(line);
+    const std::string_view text = file.view();
+
+    std::size_t begin = Utils::LineIndex::npos;
+    std::size_t end = Utils::LineIndex::npos;
+    if (start_line >= 0) {
+      std::lock_guard<std::mutex> lock(line_index_mutex);
+      Utils::LineIndex &index = line_index_for(filename, file.identity());
+      begin = index.line_offset(text, static_cast<std::size_t>(start_line));
+      if (begin != Utils::LineIndex::npos && line_count != -1) {
+        end = index.line_offset(text, static_cast<std::size_t>(start_line) +
+                                          std::max(line_count, 0));
+      }
     }
-
-    if (start_line < 0 || start_line >= static_cast<int>(lines.size())) {
+    if (begin == Utils::LineIndex::npos) {
       return "Error: Start line out of range";
     }
 
-    int end_line =
-        (line_count == -1)
-            ? static_cast<int>(lines.size())
-            : std::min(start_line + line_count, static_cast<int>(lines.size()));
-
-    std::ostringstream result;
-    for (int i = start_line; i < end_line; ++i) {
-      result << lines[i];
-      if (i < end_line - 1)
-        result << "\n";
+    std::string_view range =
+        text.substr(begin, end == Utils::LineIndex::npos
+                               ? std::string_view::npos
+                               : end - begin);
+    if (!range.empty() && range.back() == '\n') {
+      range.remove_suffix(1);
     }
-
-    return result.str();
+    return std::string(range);
   } catch ([[maybe_unused]] const std::exception &e) {
     return std::string("Error reading file range: ") + e.what();
   }
@@ -89,14 +147,10 @@ std::string FileService::write_file(const std::string &filename,
       std::filesystem::create_directories(file_path.parent_path());
     }
 
-    std::ofstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-      return "Error: Could not create/write file '" + filename + "'";
-    }
-
-    file << content;
-    if (!file) {
-      return "Error: Write operation failed";
+    // Readers never see a half-written file, even if we crash
+    Utils::AtomicFile file;
+    if (!file.open(filename) || !file.write(content) || !file.commit()) {
+      return "Error: " + file.error();
     }
     return "File '" + filename + "' written successfully (" +
            std::to_string(content.length()) + " bytes)";
@@ -105,6 +159,42 @@ std::string FileService::write_file(const std::string &filename,
   }
 }
 
+// Where each occurrence of `old_text` starts, found in one scan
+static std::vector<std::size_t> find_occurrences(std::string_view content,
+                                                 const std::string &old_text) {
+  std::vector<std::size_t> hits;
+  Utils::LiteralSearch search({old_text}, true);
+  for (auto match = search.find(content, 0);
+       match.position != Utils::LiteralSearch::npos;
+       match = search.find(content, match.position + old_text.size())) {
+    hits.push_back(match.position);
+  }
+  return hits;
+}
+
+// Writes `content` with the `old_size` bytes at every hit replaced: the
+// spans between hits go straight from `content` to the file, with the new
+// text in between
+static bool write_replaced(Utils::AtomicFile &output, std::string_view content,
+                           const std::vector<std::size_t> &hits,
+                           std::size_t old_size, std::string_view new_text) {
+  std::vector<std::string_view> spans;
+  std::size_t copied = 0;
+  for (std::size_t hit : hits) {
+    spans.push_back(content.substr(copied, hit - copied));
+    spans.push_back(new_text);
+    copied = hit + old_size;
+    if (spans.size() >= REPLACE_WRITE_BATCH) {
+      if (!output.write(spans)) {
+        return false;
+      }
+      spans.clear();
+    }
+  }
+  spans.push_back(content.substr(copied));
+  return output.write(spans);
+}
+
 FileEditResult FileService::replace_text_in_file(const std::string &filename,
                                                  const std::string &old_text,
                                                  const std::string &new_text,
@@ -117,25 +207,22 @@ FileEditResult FileService::replace_text_in_file(const std::string &filename,
       return result;
     }
 
-    // Read file content
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-      result.message = "Error: Could not open file '" + filename + "'";
+    if (old_text.empty()) {
+      result.message = "Error: Text to replace is empty";
       return result;
     }
 
-    std::ostringstream buffer;
-    buffer << file.rdbuf();
-    std::string content = buffer.str();
-    file.close();
-
-    // Count occurrences
-    size_t pos = 0;
-    int count = 0;
-    while ((pos = content.find(old_text, pos)) != std::string::npos) {
-      count++;
-      pos += old_text.length();
+    // Mapped rather than read, so files of any size are streamed through
+    Utils::MappedFile source;
+    if (!source.open(filename)) {
+      result.message = "Error: Could not open file '" + filename + "'";
+      return result;
     }
+    std::string_view content = source.view();
+
+    // Every occurrence is found before anything is written
+    std::vector<std::size_t> hits = find_occurrences(content, old_text);
+    int count = static_cast<int>(hits.size());
 
     if (count == 0) {
       result.message = "Error: Text to replace not found in file";
@@ -149,23 +236,15 @@ FileEditResult FileService::replace_text_in_file(const std::string &filename,
       return result;
     }
 
-    // Perform replacements
-    pos = 0;
-    while ((pos = content.find(old_text, pos)) != std::string::npos) {
-      content.replace(pos, old_text.length(), new_text);
-      pos += new_text.length();
-    }
-
-    // Write back to file
-    std::ofstream out_file(filename);
-    if (!out_file.is_open()) {
-      result.message = "Error: Could not write to file '" + filename + "'";
-      return result;
-    }
-
-    out_file << content;
-    if (!out_file) {
-      result.message = "Error: Write operation failed";
+    // Written from the mapping to a temporary file that then replaces the
+    // original
+    Utils::AtomicFile output;
+    bool written =
+        output.open(filename) &&
+        write_replaced(output, content, hits, old_text.size(), new_text);
+    source.close(); // Windows won't replace a mapped file
+    if (!written || !output.commit()) {
+      result.message = "Error: " + output.error();
       return result;
     }
 
@@ -181,44 +260,577 @@ FileEditResult FileService::replace_text_in_file(const std::string &filename,
   }
 }
 
-std::vector<FileSearchResult>
-FileService::search_in_file(const std::string &filename,
-                            const std::string &pattern, bool case_sensitive) {
-  std::vector<FileSearchResult> results;
+// Whether the relative, '/'-separated `path` matches `pattern`: `*` and
+// `?` stay within a component, `**/` matches any number of directories
+static bool glob_match(std::string_view pattern, std::string_view path) {
+  while (!pattern.empty() && pattern[0] != '*') {
+    if (path.empty() ||
+        (pattern[0] == '?' ? path[0] == '/' : pattern[0] != path[0])) {
+      return false;
+    }
+    pattern.remove_prefix(1);
+    path.remove_prefix(1);
+  }
+  if (pattern.empty()) {
+    return path.empty();
+  }
+  if (pattern == "**") {
+    return true;
+  }
+  if (pattern.rfind("**/", 0) == 0) {
+    for (std::size_t from = 0;;) {
+      if (glob_match(pattern.substr(3), path.substr(from))) {
+        return true;
+      }
+      std::size_t slash = path.find('/', from);
+      if (slash == std::string_view::npos) {
+        return false;
+      }
+      from = slash + 1;
+    }
+  }
+  std::size_t stars = pattern.find_first_not_of('*');
+  std::string_view rest =
+      stars == std::string_view::npos ? "" : pattern.substr(stars);
+  for (std::size_t i = 0; i <= path.size(); ++i) {
+    if (glob_match(rest, path.substr(i))) {
+      return true;
+    }
+    if (i < path.size() && path[i] == '/') {
+      return false;
+    }
+  }
+  return false;
+}
 
-  try {
-    if (!file_exists(filename) || !is_text_file(filename)) {
-      return results;
+// The directory a glob starts from and the pattern for paths below it;
+// the pattern is empty for a glob without wildcards
+static std::pair<std::string, std::string>
+split_glob(const std::string &glob) {
+  std::string generic = std::filesystem::path(glob).generic_string();
+  std::size_t wildcard = generic.find_first_of("*?");
+  if (wildcard == std::string::npos) {
+    return {generic, ""};
+  }
+  std::size_t slash = generic.rfind('/', wildcard);
+  if (slash == std::string::npos) {
+    return {".", generic};
+  }
+  return {slash == 0 ? "/" : generic.substr(0, slash),
+          generic.substr(slash + 1)};
+}
+
+// `text` as an ECMAScript pattern matching only itself
+static std::string escape_regex(const std::string &text) {
+  std::string escaped;
+  for (char c : text) {
+    if (std::string_view("\\^$.|?*+()[]{}").find(c) != std::string::npos) {
+      escaped += '\\';
     }
+    escaped += c;
+  }
+  return escaped;
+}
 
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-      return results;
+// The first lines a replacement changes, with every occurrence on them
+// replaced, as "  <line number>: <new line>"
+static std::string preview_lines(std::string_view content,
+                                 const std::vector<std::size_t> &hits,
+                                 std::size_t old_size,
+                                 const std::string &new_text) {
+  std::string preview;
+  int line_number = 1;
+  std::size_t counted = 0; // Newlines before this offset are counted
+  std::size_t i = 0;
+  for (int shown = 0; i < hits.size() && shown < PREVIEW_LINES; ++shown) {
+    std::size_t previous = hits[i] == 0 ? std::string_view::npos
+                                        : content.rfind('\n', hits[i] - 1);
+    std::size_t start = previous == std::string_view::npos ? 0 : previous + 1;
+    line_number += static_cast<int>(Utils::LineIndex::count_newlines(
+        content.substr(counted, start - counted)));
+    counted = start;
+
+    std::string line;
+    std::size_t copied = start;
+    std::size_t end = start;
+    for (; i < hits.size() && (hits[i] < end || copied == start); ++i) {
+      line.append(content.substr(copied, hits[i] - copied));
+      line += new_text;
+      copied = hits[i] + old_size;
+      end = std::max(end, std::min(content.find('\n', copied), content.size()));
+    }
+    line.append(content.substr(copied, end - copied));
+    if (line.size() > PREVIEW_LINE_WIDTH) {
+      line = line.substr(0, PREVIEW_LINE_WIDTH) + "...";
     }
+    preview += "  " + std::to_string(line_number) + ": " + line + "\n";
+  }
+  if (i < hits.size()) {
+    preview += "  ...\n";
+  }
+  return preview;
+}
+
+namespace {
+
+// One file of a batch replacement, staged before anything is renamed
+struct StagedReplacement {
+  std::string path;
+  int count{0};
+  std::string preview;
+  std::string error;
+  Utils::AtomicFile output;
+};
+
+} // namespace
+
+BatchEditResult FileService::replace_in_files(const std::string &glob,
+                                              const std::string &old_text,
+                                              const std::string &new_text,
+                                              const ReplaceOptions &options) {
+  BatchEditResult result;
+  if (old_text.empty()) {
+    result.message = "Error: Text to replace is empty";
+    return result;
+  }
 
-    std::regex regex_pattern;
-    if (case_sensitive) {
-      regex_pattern = std::regex(pattern);
+  try {
+    auto [root, pattern] = split_glob(glob);
+    std::vector<std::string> files;
+    std::error_code error;
+    if (pattern.empty() && !std::filesystem::is_directory(root, error)) {
+      if (std::filesystem::is_regular_file(root, error)) {
+        files.push_back(root);
+      }
     } else {
-      regex_pattern = std::regex(pattern, std::regex_constants::icase);
+      if (pattern.empty()) {
+        pattern = "**";
+      }
+      const std::filesystem::path base(root);
+      auto report_path = [&](const std::string &relative) {
+        return root == "." ? relative : (base / relative).generic_string();
+      };
+      // Only the files the trigram index leaves need to be read
+      if (auto candidates =
+              indexed_candidates(root, escape_regex(old_text))) {
+        for (const auto &relative : *candidates) {
+          if (glob_match(pattern, relative)) {
+            files.push_back(report_path(relative));
+          }
+        }
+      } else {
+        std::mutex files_mutex;
+        Utils::walk_files(
+            base, Utils::walk_threads(),
+            [&](const std::filesystem::path &path) {
+              return is_text_file(path.string()) &&
+                     glob_match(pattern,
+                                path.lexically_relative(base).generic_string());
+            },
+            [&](const std::filesystem::path &path) {
+              std::string reported =
+                  report_path(path.lexically_relative(base).generic_string());
+              std::lock_guard<std::mutex> lock(files_mutex);
+              files.push_back(std::move(reported));
+              return true;
+            });
+      }
+    }
+    std::sort(files.begin(), files.end());
+
+    // Scan and stage every file; in earnest, the first failure stops the
+    // rest, while a dry run reports them all
+    std::vector<StagedReplacement> staged(files.size());
+    std::atomic<bool> failed{false};
+    Utils::parallel_for(
+        files.size(), REPLACE_THREADS, [&](std::size_t i) {
+          StagedReplacement &file = staged[i];
+          file.path = files[i];
+          try {
+            std::optional<int> wanted;
+            auto listed = options.expected_counts.find(file.path);
+            if (listed != options.expected_counts.end()) {
+              wanted = listed->second;
+            } else if (options.expected_per_file > 0) {
+              wanted = options.expected_per_file;
+            }
+
+            Utils::MappedFile source;
+            if (!source.open(file.path)) {
+              file.error = "could not open file";
+            } else {
+              auto hits = find_occurrences(source.view(), old_text);
+              file.count = static_cast<int>(hits.size());
+              if (wanted && *wanted != file.count) {
+                file.error = "expected " + std::to_string(*wanted) +
+                             " replacements but found " +
+                             std::to_string(file.count);
+              } else if (hits.empty()) {
+                // Nothing to change
+              } else if (options.dry_run) {
+                file.preview = preview_lines(source.view(), hits,
+                                             old_text.size(), new_text);
+              } else if (!file.output.open(file.path) ||
+                         !write_replaced(file.output, source.view(), hits,
+                                         old_text.size(), new_text) ||
+                         !file.output.sync()) {
+                file.error = file.output.error();
+              }
+            }
+          } catch (const std::exception &e) {
+            file.error = e.what();
+          }
+          if (!file.error.empty()) {
+            failed = true;
+          }
+          return options.dry_run || !failed;
+        });
+
+    std::vector<std::string> failures;
+    std::set<std::string> seen;
+    std::map<std::string, std::string> targets; // Resolved target -> path
+    for (const auto &file : staged) {
+      seen.insert(file.path);
+      if (!file.error.empty()) {
+        failures.push_back(file.path + ": " + file.error);
+      } else if (file.count > 0 && !options.dry_run) {
+        // Two paths to one file (a symlink) would overwrite each other
+        auto [it, inserted] = targets.emplace(file.output.target(), file.path);
+        if (!inserted) {
+          failures.push_back(file.path + ": same file as " + it->second);
+        }
+      }
+    }
+    for (const auto &[path, count] : options.expected_counts) {
+      if (count != 0 && seen.count(path) == 0) {
+        failures.push_back(path + ": expected " + std::to_string(count) +
+                           " replacements but the file does not match");
+      }
     }
 
-    std::string line;
-    int line_number = 1;
-
-    while (std::getline(file, line)) {
-      std::smatch match;
-      if (std::regex_search(line, match, regex_pattern)) {
-        FileSearchResult result;
-        result.file_path = filename;
-        result.line_number = line_number;
-        result.line_content = line;
-        result.match_context = line; // For now, context is the same as line
-        results.push_back(result);
+    for (const auto &file : staged) {
+      if (file.count > 0) {
+        result.files.push_back({file.path, file.count, file.preview});
+        result.replacements_made += file.count;
+      }
+    }
+    std::string summary = std::to_string(result.replacements_made) +
+                          " occurrence(s) in " +
+                          std::to_string(result.files.size()) + " file(s)";
+
+    if (!failures.empty()) {
+      result.message = "Error: " + std::to_string(failures.size()) +
+                       " file(s) failed, nothing was changed:\n";
+      for (std::size_t i = 0;
+           i < failures.size() && i < MAX_REPORTED_FAILURES; ++i) {
+        result.message += "  " + failures[i] + "\n";
+      }
+      if (failures.size() > MAX_REPORTED_FAILURES) {
+        result.message += "  ...\n";
       }
-      line_number++;
+      return result; // Staged files are discarded with `staged`
+    }
+    if (result.files.empty()) {
+      result.message =
+          "Error: Text to replace not found in files matching '" + glob + "'";
+      return result;
     }
 
+    if (options.dry_run) {
+      result.success = true;
+      result.message = "Would replace " + summary + ":\n";
+      for (const auto &file : result.files) {
+        result.message += file.file_path + " (" +
+                          std::to_string(file.replacements) + ")\n" +
+                          file.preview;
+      }
+      return result;
+    }
+
+    // Everything is on disk under temporary names; renaming is all that
+    // is left, with each directory flushed once at the end
+    std::set<std::string> directories;
+    std::size_t committed = 0;
+    for (auto &file : staged) {
+      if (file.count == 0) {
+        continue;
+      }
+      if (!file.output.commit(false)) {
+        result.message = "Error: " + file.output.error() + "; " +
+                         std::to_string(committed) +
+                         " file(s) had already been replaced";
+        result.files.resize(committed);
+        break;
+      }
+      directories.insert(
+          std::filesystem::path(file.output.target()).parent_path().string());
+      ++committed;
+    }
+    for (const auto &directory : directories) {
+      Utils::AtomicFile::flush_directory(directory);
+    }
+    if (committed < result.files.size()) {
+      return result;
+    }
+
+    result.success = true;
+    result.message = "Replaced " + summary + ":\n";
+    for (const auto &file : result.files) {
+      result.message +=
+          "  " + file.file_path + ": " + std::to_string(file.replacements) +
+          "\n";
+    }
+    return result;
+  } catch (const std::exception &e) {
+    result.message = std::string("Error during text replacement: ") + e.what();
+    return result;
+  }
+}
+
+namespace {
+
+// A compiled search pattern and the literals that prefilter it
+struct Matcher {
+  std::regex regex;
+  Utils::LiteralSearch literals;
+  bool exact; // A literal hit is already a match
+
+  Matcher(const std::string &pattern, bool case_sensitive,
+          const std::vector<std::string> &required, bool is_exact)
+      : regex(pattern, case_sensitive ? std::regex_constants::ECMAScript
+                                      : std::regex_constants::ECMAScript |
+                                            std::regex_constants::icase),
+        literals(required, case_sensitive), exact(is_exact) {}
+
+  static Matcher compile(const std::string &pattern, bool case_sensitive) {
+    bool exact = false;
+    auto required = Utils::LiteralSearch::required_literals(pattern, exact);
+    return Matcher(pattern, case_sensitive, required, exact);
+  }
+};
+
+} // namespace
+
+// Matching lines of `text`, stopping when `on_match` returns false. With
+// literals, the buffer is scanned for them and only the lines they fall on
+// are tested; line numbers are counted in bulk between hits.
+static bool search_text(std::string_view text, const std::string &path,
+                        const Matcher &matcher,
+                        const FileService::SearchCallback &on_match) {
+  int line_number = 1;
+  std::size_t counted = 0; // Newlines before this offset are counted
+  for (std::size_t from = 0; from < text.size();) {
+    std::size_t start = from;
+    if (!matcher.literals.empty()) {
+      auto hit = matcher.literals.find(text, from);
+      if (hit.position == Utils::LiteralSearch::npos) {
+        break;
+      }
+      std::size_t previous = hit.position == 0
+                                 ? std::string_view::npos
+                                 : text.rfind('\n', hit.position - 1);
+      start = previous == std::string_view::npos ? 0 : previous + 1;
+    }
+    std::size_t end = std::min(text.find('\n', start), text.size());
+    line_number += static_cast<int>(Utils::LineIndex::count_newlines(
+        text.substr(counted, start - counted)));
+    counted = start;
+
+    std::string_view line = text.substr(start, end - start);
+    if (matcher.exact ||
+        std::regex_search(line.begin(), line.end(), matcher.regex)) {
+      FileSearchResult result;
+      result.file_path = path;
+      result.line_number = line_number;
+      result.line_content = std::string(line);
+      result.match_context = result.line_content;
+      if (!on_match(result)) {
+        return false;
+      }
+    }
+    from = end + 1;
+  }
+  return true;
+}
+
+static bool search_file(const std::string &path, const Matcher &matcher,
+                        const FileService::SearchCallback &on_match) {
+  Utils::MappedFile file;
+  if (!file.open(path)) {
+    return true;
+  }
+  return search_text(file.view(), path, matcher, on_match);
+}
+
+// FNV-1a of the directory's canonical path names its index file
+static std::string index_file_name(const std::string &root) {
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : root) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.trigrams",
+                static_cast<unsigned long long>(hash));
+  return name;
+}
+
+// Deletes index files unused for CODE_INDEX_MAX_AGE_DAYS, then the least
+// recently used beyond MAX_CODE_INDEX_FILES; using an index touches it
+static void remove_stale_indexes(const std::string &directory) {
+  using Clock = std::filesystem::file_time_type::clock;
+  std::error_code error;
+  std::vector<std::pair<Clock::time_point, std::filesystem::path>> files;
+  for (const auto &file :
+       std::filesystem::directory_iterator(directory, error)) {
+    std::error_code time_error;
+    auto modified = file.last_write_time(time_error);
+    if (file.path().extension() == ".trigrams" && !time_error) {
+      files.emplace_back(modified, file.path());
+    }
+  }
+  std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) {
+    return a.first > b.first;
+  });
+  const auto cutoff =
+      Clock::now() - std::chrono::hours(24 * CODE_INDEX_MAX_AGE_DAYS);
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    if (i >= MAX_CODE_INDEX_FILES || files[i].first < cutoff) {
+      std::filesystem::remove(files[i].second, error);
+    }
+  }
+}
+
+void FileService::configure_code_index(const std::string &directory,
+                                       bool enable) {
+  {
+    std::lock_guard<std::mutex> lock(code_index_mutex);
+    code_index_directory = enable ? directory : "";
+    code_index_configured = true;
+  }
+  if (enable) {
+    remove_stale_indexes(directory);
+  }
+}
+
+std::optional<std::vector<std::string>>
+FileService::indexed_candidates(const std::string &directory,
+                                const std::string &pattern) {
+  std::string index_directory;
+  bool configured = false;
+  {
+    std::lock_guard<std::mutex> lock(code_index_mutex);
+    configured = code_index_configured;
+    index_directory = code_index_directory;
+  }
+  if (!configured) {
+    std::string setting =
+        Utils::Config::get_env_var("LLAMAWARE_CODE_INDEX", "data/index");
+    configure_code_index(setting, setting != "off");
+    std::lock_guard<std::mutex> lock(code_index_mutex);
+    index_directory = code_index_directory;
+  }
+  if (index_directory.empty() || !CodeIndex::can_narrow(pattern)) {
+    return std::nullopt;
+  }
+  std::error_code error;
+  const std::filesystem::path root =
+      std::filesystem::weakly_canonical(directory, error);
+  if (error) {
+    return std::nullopt;
+  }
+
+  // An index of an enclosing directory covers this one too, so the
+  // nearest one in memory or on disk is reused before a new one is built;
+  // refreshing it then walks only this directory
+  auto index_path_for = [&](const std::filesystem::path &indexed) {
+    return (std::filesystem::path(index_directory) /
+            index_file_name(indexed.string()))
+        .string();
+  };
+  std::filesystem::path index_root = root;
+  for (std::filesystem::path dir = root;; dir = dir.parent_path()) {
+    std::string path = index_path_for(dir);
+    bool cached = false;
+    {
+      std::lock_guard<std::mutex> lock(code_index_mutex);
+      cached = code_indexes.count(path) != 0;
+    }
+    if (cached || std::filesystem::exists(path, error)) {
+      index_root = dir;
+      break;
+    }
+    if (dir == dir.parent_path()) {
+      break;
+    }
+  }
+  const std::string index_path = index_path_for(index_root);
+
+  std::shared_ptr<CodeIndexEntry> entry;
+  {
+    std::lock_guard<std::mutex> lock(code_index_mutex);
+    auto &slot = code_indexes[index_path];
+    if (!slot) {
+      slot = std::make_shared<CodeIndexEntry>();
+      slot->index = std::make_unique<CodeIndex>(index_root.string(),
+                                                index_path);
+    }
+    slot->last_used = ++code_index_clock;
+    entry = slot;
+
+    if (code_indexes.size() > MAX_CODE_INDEXES) {
+      auto oldest = std::min_element(
+          code_indexes.begin(), code_indexes.end(),
+          [](const auto &a, const auto &b) {
+            return a.second->last_used < b.second->last_used;
+          });
+      code_indexes.erase(oldest);
+    }
+  }
+  std::lock_guard<std::mutex> lock(entry->mutex);
+  if (!entry->loaded) {
+    if (entry->index->load()) {
+      // Marks the file as in use for remove_stale_indexes
+      std::filesystem::last_write_time(
+          index_path, std::filesystem::file_time_type::clock::now(), error);
+    }
+    entry->loaded = true;
+  }
+  // Only the searched part of an enclosing tree is brought up to date
+  const std::string subtree =
+      index_root == root ? ""
+                         : root.lexically_relative(index_root).generic_string();
+  if (entry->index->refresh(subtree)) {
+    entry->index->save();
+  }
+  auto candidates = entry->index->candidates(pattern);
+  if (!candidates || subtree.empty()) {
+    return candidates;
+  }
+  const std::string prefix = subtree + "/";
+  std::vector<std::string> inside;
+  for (const auto &path : *candidates) {
+    if (path.compare(0, prefix.size(), prefix) == 0) {
+      inside.push_back(path.substr(prefix.size()));
+    }
+  }
+  return inside;
+}
+
+std::vector<FileSearchResult>
+FileService::search_in_file(const std::string &filename,
+                            const std::string &pattern, bool case_sensitive) {
+  std::vector<FileSearchResult> results;
+
+  try {
+    if (!file_exists(filename) || !is_text_file(filename)) {
+      return results;
+    }
+    Matcher matcher = Matcher::compile(pattern, case_sensitive);
+    search_file(filename, matcher, [&results](const FileSearchResult &match) {
+      results.push_back(match);
+      return true;
+    });
   } catch ([[maybe_unused]] const std::exception &e) {
     // Log error but return partial results
   }
@@ -230,53 +842,94 @@ std::vector<FileSearchResult> FileService::search_in_directory(
     const std::string &directory, const std::string &pattern,
     const std::string &file_filter, bool case_sensitive) {
   std::vector<FileSearchResult> all_results;
+  search_in_directory(directory, pattern, file_filter, case_sensitive,
+                      [&all_results](const FileSearchResult &match) {
+                        all_results.push_back(match);
+                        return true;
+                      });
+  std::sort(all_results.begin(), all_results.end(),
+            [](const FileSearchResult &a, const FileSearchResult &b) {
+              return a.file_path != b.file_path ? a.file_path < b.file_path
+                                                : a.line_number < b.line_number;
+            });
+  return all_results;
+}
 
+bool FileService::search_in_directory(const std::string &directory,
+                                      const std::string &pattern,
+                                      const std::string &file_filter,
+                                      bool case_sensitive,
+                                      const SearchCallback &on_match) {
+  std::error_code error;
+  if (!std::filesystem::is_directory(directory, error)) {
+    return true;
+  }
+
+  std::optional<Matcher> matcher;
+  std::optional<std::regex> filter_regex;
   try {
-    if (!std::filesystem::exists(directory) ||
-        !std::filesystem::is_directory(directory)) {
-      return all_results;
+    matcher.emplace(Matcher::compile(pattern, case_sensitive));
+    // Simple wildcard matching: '*' stands for any character
+    if (file_filter != "*" && file_filter.find('*') != std::string::npos) {
+      std::string pattern_regex = file_filter;
+      std::replace(pattern_regex.begin(), pattern_regex.end(), '*', '.');
+      filter_regex.emplace(".*" + pattern_regex + ".*",
+                           std::regex_constants::icase);
     }
-
-    // Simple file filter matching (supports * wildcard)
-    auto matches_filter = [&file_filter](const std::string &filename) {
-      if (file_filter == "*")
-        return true;
-
-      // Simple wildcard matching
-      if (file_filter.find('*') != std::string::npos) {
-        std::string pattern_regex = file_filter;
-        std::replace(pattern_regex.begin(), pattern_regex.end(), '*', '.');
-        pattern_regex = ".*" + pattern_regex + ".*";
-        try {
-          std::regex filter_regex(pattern_regex, std::regex_constants::icase);
-          return std::regex_match(filename, filter_regex);
-        } catch (...) {
-          return false;
-        }
-      }
-
-      return filename.find(file_filter) != std::string::npos;
-    };
-
-    for (const auto &entry :
-         std::filesystem::recursive_directory_iterator(directory)) {
-      if (entry.is_regular_file()) {
-        std::string filepath = entry.path().string();
-        std::string filename = entry.path().filename().string();
-
-        if (matches_filter(filename) && is_text_file(filepath)) {
-          auto file_results = search_in_file(filepath, pattern, case_sensitive);
-          all_results.insert(all_results.end(), file_results.begin(),
-                             file_results.end());
-        }
+  } catch (const std::regex_error &) {
+    // A filter that is not a valid regex matches no file
+    return matcher.has_value();
+  }
+  auto matches_filter = [&](const std::string &filename) {
+    if (file_filter == "*") {
+      return true;
+    }
+    if (filter_regex) {
+      return std::regex_match(filename, *filter_regex);
+    }
+    return filename.find(file_filter) != std::string::npos;
+  };
+
+  std::atomic<bool> stopped{false};
+  std::mutex output_mutex;
+  auto emit = [&](const FileSearchResult &match) {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    if (stopped || !on_match(match)) {
+      stopped = true;
+    }
+    return !stopped;
+  };
+  auto search = [&](const std::filesystem::path &path) {
+    try {
+      search_file(path.string(), *matcher, emit);
+    } catch ([[maybe_unused]] const std::exception &e) {
+      // Regex stack exhaustion on a pathological line; skip the file
+    }
+    return !stopped;
+  };
+
+  // With a trigram index, only the files that can match are read
+  if (auto candidates = indexed_candidates(directory, pattern)) {
+    std::vector<std::filesystem::path> files;
+    for (const auto &relative : *candidates) {
+      std::filesystem::path path = std::filesystem::path(directory) / relative;
+      if (matches_filter(path.filename().string())) {
+        files.push_back(std::move(path));
       }
     }
-
-  } catch ([[maybe_unused]] const std::exception &e) {
-    // Log error but return partial results
+    Utils::parallel_for(files.size(), Utils::walk_threads(),
+                        [&](std::size_t i) { return search(files[i]); });
+    return true;
   }
 
-  return all_results;
+  Utils::walk_files(
+      directory, Utils::walk_threads(),
+      [&](const std::filesystem::path &path) {
+        return matches_filter(path.filename().string()) &&
+               is_text_file(path.string());
+      },
+      search);
+  return true;
 }
 
 bool FileService::file_exists(const std::string &filename) {
@@ -1,15 +1,87 @@
 #include "services/github_service.h"
+#include "services/issue_mirror.h"
 #include "services/web_service.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <map>
 #include <nlohmann/json.hpp>
-#include <regex>
 #include <sstream>
 #include <string>
 #include <vector>
 
 namespace Services {
 
+std::map<std::string, GitHubService::MirrorState> GitHubService::mirrors;
+std::mutex GitHubService::mirror_mutex;
+
+// Largest page the REST API serves
+static constexpr int kIssuesPerPage = 100;
+// Enough for 50k issues and pull requests in one first sync
+static constexpr int kMaxSyncPages = 500;
+// Plain listings (get_issues, get_labels, ...) stop after 10k items
+static constexpr int kMaxListPages = 100;
+// Requests one operation keeps in flight against the API
+static constexpr std::size_t kMaxConcurrentRequests = 8;
+
+// Runs `tasks` with at most `limit` at a time and rethrows the first
+// exception once all are done. The workers are dedicated threads, since
+// callers may themselves be running on the shared thread pool.
+static void run_bounded(const std::vector<std::function<void()>> &tasks,
+                        std::size_t limit = kMaxConcurrentRequests) {
+  std::vector<std::exception_ptr> errors(tasks.size());
+  std::atomic<std::size_t> next{0};
+  std::vector<std::future<void>> workers;
+  for (std::size_t w = 0; w < std::min(limit, tasks.size()); ++w) {
+    workers.push_back(std::async(std::launch::async, [&] {
+      for (std::size_t i = next++; i < tasks.size(); i = next++) {
+        try {
+          tasks[i]();
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      }
+    }));
+  }
+  for (auto &worker : workers) {
+    worker.get();
+  }
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+// Related-issue lookups within this long of a sync skip the next one
+static constexpr std::chrono::seconds kMirrorFreshness{60};
+
+static GitHubIssue issue_from_json(const nlohmann::json &item) {
+  GitHubIssue issue;
+  issue.number = item["number"];
+  issue.title = item["title"];
+  issue.body = item["body"].is_string() ? item["body"].get<std::string>() : "";
+  issue.state = item["state"];
+
+  for (const auto &label : item["labels"]) {
+    issue.labels.push_back(label["name"]);
+  }
+
+  if (!item["assignee"].is_null()) {
+    issue.assignees.push_back(item["assignee"]["login"]);
+  }
+
+  if (!item["milestone"].is_null()) {
+    issue.milestone = item["milestone"]["number"];
+  }
+
+  issue.updated_at = item.value("updated_at", "");
+  issue.pull_request = item.contains("pull_request");
+  return issue;
+}
+
 std::string GitHubService::get_github_token() {
   const char *token = std::getenv("GITHUB_TOKEN");
   if (token != nullptr) {
@@ -46,6 +118,65 @@ WebResponse GitHubService::make_github_request(const std::string &endpoint,
   return WebService::fetch_with_headers(url, headers);
 }
 
+int GitHubService::last_page(const std::string &link_header) {
+  size_t rel = link_header.find("rel=\"last\"");
+  if (rel == std::string::npos) {
+    return 1;
+  }
+  size_t open = link_header.rfind('<', rel);
+  size_t close = link_header.find('>', open);
+  if (open == std::string::npos || close == std::string::npos ||
+      close > rel) {
+    return 1;
+  }
+  std::string url = link_header.substr(open + 1, close - open - 1);
+  // "page=" as a parameter of its own, not the end of "per_page="
+  for (size_t pos = url.find("page="); pos != std::string::npos;
+       pos = url.find("page=", pos + 5)) {
+    if (pos > 0 && (url[pos - 1] == '?' || url[pos - 1] == '&')) {
+      return std::max(1, std::atoi(url.c_str() + pos + 5));
+    }
+  }
+  return 1;
+}
+
+std::vector<WebResponse>
+GitHubService::fetch_pages(const std::string &endpoint, int max_pages) {
+  const std::string base =
+      endpoint + (endpoint.find('?') == std::string::npos ? "?" : "&") +
+      "per_page=" + std::to_string(kIssuesPerPage) + "&page=";
+
+  std::vector<WebResponse> pages{make_github_request(base + "1")};
+  if (!pages.front().success) {
+    return pages;
+  }
+  auto link = pages.front().headers.find("Link");
+  int last = std::min(
+      link == pages.front().headers.end() ? 1 : last_page(link->second),
+      max_pages);
+  if (last <= 1) {
+    return pages;
+  }
+
+  pages.resize(static_cast<std::size_t>(last));
+  std::vector<std::function<void()>> tasks;
+  for (int page = 2; page <= last; ++page) {
+    tasks.push_back([&pages, &base, page] {
+      pages[static_cast<std::size_t>(page - 1)] =
+          make_github_request(base + std::to_string(page));
+    });
+  }
+  run_bounded(tasks);
+
+  for (std::size_t i = 1; i < pages.size(); ++i) {
+    if (!pages[i].success) {
+      pages.resize(i + 1);
+      break;
+    }
+  }
+  return pages;
+}
+
 std::string GitHubService::get_repo_info(const std::string &owner,
                                          const std::string &repo) {
   std::string endpoint = "/repos/" + owner + "/" + repo;
@@ -77,38 +208,19 @@ std::vector<GitHubIssue> GitHubService::get_issues(const std::string &owner,
   std::string endpoint =
       "/repos/" + owner + "/" + repo + "/issues?state=" + state;
 
-  WebResponse response = make_github_request(endpoint, "GET", "");
-
-  if (!response.success) {
-    throw std::runtime_error("Failed to fetch issues: " +
-                             response.error_message);
-  }
-
-  try {
-    nlohmann::json json = nlohmann::json::parse(response.content);
-    for (const auto &item : json) {
-      GitHubIssue issue;
-      issue.number = item["number"];
-      issue.title = item["title"];
-      issue.body = item.value("body", "");
-      issue.state = item["state"];
-
-      for (const auto &label : item["labels"]) {
-        issue.labels.push_back(label["name"]);
-      }
-
-      if (!item["assignee"].is_null()) {
-        issue.assignees.push_back(item["assignee"]["login"]);
-      }
-
-      if (!item["milestone"].is_null()) {
-        issue.milestone = item["milestone"]["number"];
+  for (const auto &page : fetch_pages(endpoint, kMaxListPages)) {
+    if (!page.success) {
+      throw std::runtime_error("Failed to fetch issues: " +
+                               page.error_message);
+    }
+    try {
+      for (const auto &item : nlohmann::json::parse(page.content)) {
+        issues.push_back(issue_from_json(item));
       }
-
-      issues.push_back(issue);
+    } catch (const std::exception &e) {
+      throw std::runtime_error("Error parsing issues: " +
+                               std::string(e.what()));
     }
-  } catch (const std::exception &e) {
-    throw std::runtime_error("Error parsing issues: " + std::string(e.what()));
   }
 
   return issues;
@@ -184,27 +296,25 @@ GitHubService::get_pull_requests(const std::string &owner,
   std::string endpoint =
       "/repos/" + owner + "/" + repo + "/pulls?state=" + state;
 
-  WebResponse response = make_github_request(endpoint, "GET", "");
-
-  if (!response.success) {
-    throw std::runtime_error("Failed to fetch PRs: " + response.error_message);
-  }
-
-  try {
-    nlohmann::json json = nlohmann::json::parse(response.content);
-    for (const auto &item : json) {
-      GitHubPR pr;
-      pr.number = item["number"];
-      pr.title = item["title"];
-      pr.body = item.value("body", "");
-      pr.state = item["state"];
-      pr.head_branch = item["head"]["ref"];
-      pr.base_branch = item["base"]["ref"];
-      pr.mergeable = item.value("mergeable", false);
-      prs.push_back(pr);
+  for (const auto &page : fetch_pages(endpoint, kMaxListPages)) {
+    if (!page.success) {
+      throw std::runtime_error("Failed to fetch PRs: " + page.error_message);
+    }
+    try {
+      for (const auto &item : nlohmann::json::parse(page.content)) {
+        GitHubPR pr;
+        pr.number = item["number"];
+        pr.title = item["title"];
+        pr.body = item.value("body", "");
+        pr.state = item["state"];
+        pr.head_branch = item["head"]["ref"];
+        pr.base_branch = item["base"]["ref"];
+        pr.mergeable = item.value("mergeable", false);
+        prs.push_back(pr);
+      }
+    } catch (const std::exception &e) {
+      throw std::runtime_error("Error parsing PRs: " + std::string(e.what()));
     }
-  } catch (const std::exception &e) {
-    throw std::runtime_error("Error parsing PRs: " + std::string(e.what()));
   }
 
   return prs;
@@ -258,21 +368,19 @@ GitHubService::get_milestones(const std::string &owner,
   std::vector<std::string> milestones;
   std::string endpoint = "/repos/" + owner + "/" + repo + "/milestones";
 
-  WebResponse response = make_github_request(endpoint, "GET", "");
-
-  if (!response.success) {
-    throw std::runtime_error("Failed to fetch milestones: " +
-                             response.error_message);
-  }
-
-  try {
-    nlohmann::json json = nlohmann::json::parse(response.content);
-    for (const auto &item : json) {
-      milestones.push_back(item["title"]);
+  for (const auto &page : fetch_pages(endpoint, kMaxListPages)) {
+    if (!page.success) {
+      throw std::runtime_error("Failed to fetch milestones: " +
+                               page.error_message);
+    }
+    try {
+      for (const auto &item : nlohmann::json::parse(page.content)) {
+        milestones.push_back(item["title"]);
+      }
+    } catch (const std::exception &e) {
+      throw std::runtime_error("Error parsing milestones: " +
+                               std::string(e.what()));
     }
-  } catch (const std::exception &e) {
-    throw std::runtime_error("Error parsing milestones: " +
-                             std::string(e.what()));
   }
 
   return milestones;
@@ -305,20 +413,19 @@ std::vector<std::string> GitHubService::get_labels(const std::string &owner,
   std::vector<std::string> labels;
   std::string endpoint = "/repos/" + owner + "/" + repo + "/labels";
 
-  WebResponse response = make_github_request(endpoint, "GET", "");
-
-  if (!response.success) {
-    throw std::runtime_error("Failed to fetch labels: " +
-                             response.error_message);
-  }
-
-  try {
-    nlohmann::json json = nlohmann::json::parse(response.content);
-    for (const auto &item : json) {
-      labels.push_back(item["name"]);
+  for (const auto &page : fetch_pages(endpoint, kMaxListPages)) {
+    if (!page.success) {
+      throw std::runtime_error("Failed to fetch labels: " +
+                               page.error_message);
+    }
+    try {
+      for (const auto &item : nlohmann::json::parse(page.content)) {
+        labels.push_back(item["name"]);
+      }
+    } catch (const std::exception &e) {
+      throw std::runtime_error("Error parsing labels: " +
+                               std::string(e.what()));
     }
-  } catch (const std::exception &e) {
-    throw std::runtime_error("Error parsing labels: " + std::string(e.what()));
   }
 
   return labels;
@@ -358,21 +465,28 @@ bool GitHubService::create_webhook(const std::string &owner,
 
 std::string GitHubService::run_health_check(const std::string &owner,
                                             const std::string &repo) {
+  // The sections are independent requests; fetch them side by side
+  std::string info;
+  std::vector<GitHubIssue> issues;
+  std::vector<GitHubPR> prs;
+  std::vector<std::string> milestones;
+  run_bounded({[&] { info = get_repo_info(owner, repo); },
+               [&] { issues = get_issues(owner, repo, "open"); },
+               [&] { prs = get_pull_requests(owner, repo, "open"); },
+               [&] { milestones = get_milestones(owner, repo); }});
+
   std::stringstream ss;
   ss << "# Health Check Report for " << owner << "/" << repo << "\n\n";
 
   ss << "## Repository Information\n";
-  ss << get_repo_info(owner, repo) << "\n";
+  ss << info << "\n";
 
-  auto issues = get_issues(owner, repo, "open");
   ss << "## Issues\n";
   ss << "Open issues: " << issues.size() << "\n\n";
 
-  auto prs = get_pull_requests(owner, repo, "open");
   ss << "## Pull Requests\n";
   ss << "Open PRs: " << prs.size() << "\n\n";
 
-  auto milestones = get_milestones(owner, repo);
   ss << "## Milestones\n";
   ss << "Active milestones: " << milestones.size() << "\n";
   for (const auto &milestone : milestones) {
@@ -382,48 +496,92 @@ std::string GitHubService::run_health_check(const std::string &owner,
   return ss.str();
 }
 
-std::string GitHubService::find_related_issues(const std::string &owner,
-                                               const std::string &repo,
-                                               const std::string &text) {
-  auto issues = get_issues(owner, repo, "all");
-  std::stringstream ss;
-  ss << "Related issues found:\n";
-
-  std::regex word_regex("\\b\\w+\\b");
-  std::vector<std::string> keywords;
-  auto words_begin = std::sregex_iterator(text.begin(), text.end(), word_regex);
-  auto words_end = std::sregex_iterator();
+GitHubService::MirrorState &
+GitHubService::mirror_for(const std::string &owner, const std::string &repo) {
+  MirrorState &state = mirrors[owner + "/" + repo];
+  if (!state.mirror) {
+    state.mirror = std::make_unique<IssueMirror>(owner, repo);
+    state.mirror->load();
+  }
+  return state;
+}
 
-  for (std::sregex_iterator i = words_begin; i != words_end; ++i) {
-    std::string word = (*i).str();
-    if (word.length() > 3) {
-      keywords.push_back(word);
-    }
+std::string GitHubService::sync_mirror(const std::string &owner,
+                                       const std::string &repo,
+                                       MirrorState &state) {
+  IssueMirror &mirror = *state.mirror;
+  // Oldest updates first, so an interrupted sync resumes where it stopped
+  const std::string since = mirror.last_updated();
+  std::string endpoint = "/repos/" + owner + "/" + repo +
+                         "/issues?state=all&sort=updated&direction=asc";
+  if (!since.empty()) {
+    endpoint += "&since=" + since;
   }
 
-  int found_count = 0;
-  for (const auto &issue : issues) {
-    bool related = false;
-    for (const auto &keyword : keywords) {
-      if (issue.title.find(keyword) != std::string::npos ||
-          issue.body.find(keyword) != std::string::npos) {
-        related = true;
-        break;
+  std::size_t updated = 0;
+  for (const auto &page : fetch_pages(endpoint, kMaxSyncPages)) {
+    if (!page.success) {
+      return "Error: Failed to sync issues: " + page.error_message;
+    }
+    std::vector<GitHubIssue> issues;
+    try {
+      for (const auto &item : nlohmann::json::parse(page.content)) {
+        issues.push_back(issue_from_json(item));
       }
+    } catch (const std::exception &e) {
+      return "Error: Failed to parse issues: " + std::string(e.what());
     }
+    mirror.apply(issues);
+    updated += issues.size();
+  }
+  state.synced_at = std::chrono::steady_clock::now();
+  return "Synced " + std::to_string(updated) + " updated issues; " +
+         std::to_string(mirror.size()) + " mirrored";
+}
+
+std::string GitHubService::sync_issue_mirror(const std::string &owner,
+                                             const std::string &repo) {
+  if (!IssueMirror::is_valid_name(owner) ||
+      !IssueMirror::is_valid_name(repo)) {
+    return "Error: Invalid repository name";
+  }
+  std::lock_guard<std::mutex> lock(mirror_mutex);
+  return sync_mirror(owner, repo, mirror_for(owner, repo));
+}
 
-    if (related) {
-      ss << "- #" << issue.number << ": " << issue.title << "\n";
-      found_count++;
-      if (found_count >= 5)
-        break;
+std::string GitHubService::find_related_issues(const std::string &owner,
+                                               const std::string &repo,
+                                               const std::string &text) {
+  if (!IssueMirror::is_valid_name(owner) ||
+      !IssueMirror::is_valid_name(repo)) {
+    return "Error: Invalid repository name";
+  }
+  std::lock_guard<std::mutex> lock(mirror_mutex);
+  MirrorState &state = mirror_for(owner, repo);
+  if (std::chrono::steady_clock::now() - state.synced_at > kMirrorFreshness) {
+    std::string synced = sync_mirror(owner, repo, state);
+    if (synced.rfind("Error", 0) == 0 && state.mirror->size() == 0) {
+      return synced;
     }
+    // Otherwise a failed sync still leaves the mirror as of the last one
   }
 
-  if (found_count == 0) {
+  std::stringstream ss;
+  ss << "Related issues found:\n";
+  auto related = state.mirror->related(text, 5);
+  for (const GitHubIssue *issue : related) {
+    ss << "- #" << issue->number << ": " << issue->title;
+    if (issue->pull_request) {
+      ss << " (pull request)";
+    }
+    if (issue->state == "closed") {
+      ss << " [closed]";
+    }
+    ss << "\n";
+  }
+  if (related.empty()) {
     ss << "No related issues found.";
   }
-
   return ss.str();
 }
 
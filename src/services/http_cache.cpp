@@ -0,0 +1,341 @@
+#include "services/http_cache.h"
+#include "services/http_cassette.h"
+#include "services/rate_limiter.h"
+#include "utils/config.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <curl/curl.h>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+
+namespace Services {
+
+std::string HttpCache::directory = "data/http_cache";
+bool HttpCache::enabled = true;
+bool HttpCache::configured = false;
+std::mutex HttpCache::cache_mutex;
+
+// Heuristic freshness from Last-Modified is capped at a day (RFC 9111 4.2.2)
+static constexpr long long kMaxHeuristicLifetime = 24 * 60 * 60;
+// Stale entries not revalidated for this long are deleted on startup
+static constexpr long long kMaxStaleAge = 7 * 24 * 60 * 60;
+// Bodies larger than this are passed through but not kept
+static constexpr std::size_t kMaxStoredBody = 8 * 1024 * 1024;
+
+static long long unix_now() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// FNV-1a of the cache key; file names must not change between builds
+static std::string key_digest(const std::string &key) {
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : key) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  char digest[17];
+  std::snprintf(digest, sizeof(digest), "%016llx",
+                static_cast<unsigned long long>(hash));
+  return digest;
+}
+
+static std::string header_value(const HeaderMap &headers,
+                                const std::string &name) {
+  auto it = headers.find(name);
+  return it == headers.end() ? std::string() : it->second;
+}
+
+// Lowercased Cache-Control directives, e.g. {"max-age=60", "private"}
+static std::vector<std::string> cache_directives(const HeaderMap &headers) {
+  std::vector<std::string> directives;
+  std::istringstream stream(header_value(headers, "Cache-Control"));
+  for (std::string directive; std::getline(stream, directive, ',');) {
+    directive.erase(0, directive.find_first_not_of(" \t"));
+    directive.erase(directive.find_last_not_of(" \t") + 1);
+    std::transform(directive.begin(), directive.end(), directive.begin(),
+                   ::tolower);
+    if (!directive.empty()) {
+      directives.push_back(directive);
+    }
+  }
+  return directives;
+}
+
+static bool has_directive(const std::vector<std::string> &directives,
+                          const std::string &name) {
+  return std::find(directives.begin(), directives.end(), name) !=
+         directives.end();
+}
+
+// HTTP-date in Unix seconds, or -1
+static long long http_date(const std::string &value) {
+  return value.empty() ? -1 : static_cast<long long>(
+                                  curl_getdate(value.c_str(), nullptr));
+}
+
+static long long age_header(const HeaderMap &headers) {
+  try {
+    return std::max(0LL, std::stoll(header_value(headers, "Age")));
+  } catch (const std::exception &) {
+    return 0;
+  }
+}
+
+long long HttpCache::freshness_lifetime(const HeaderMap &headers,
+                                        long long now) {
+  auto directives = cache_directives(headers);
+  if (has_directive(directives, "no-cache") ||
+      has_directive(directives, "no-store")) {
+    return 0;
+  }
+  for (const auto &directive : directives) {
+    if (directive.rfind("max-age=", 0) == 0) {
+      try {
+        return std::max(0LL, std::stoll(directive.substr(8)));
+      } catch (const std::exception &) {
+        return 0; // Invalid max-age means stale
+      }
+    }
+  }
+
+  long long date = http_date(header_value(headers, "Date"));
+  if (date < 0) {
+    date = now;
+  }
+  std::string expires = header_value(headers, "Expires");
+  if (!expires.empty()) {
+    return std::max(0LL, http_date(expires) - date);
+  }
+  long long last_modified = http_date(header_value(headers, "Last-Modified"));
+  if (last_modified >= 0 && last_modified < date) {
+    return std::min((date - last_modified) / 10, kMaxHeuristicLifetime);
+  }
+  return 0;
+}
+
+// Requests that may be answered differently get different entries; the
+// credential is part of the key so tokens never see each other's data
+static std::string cache_key(const std::string &url,
+                             const HeaderMap &headers) {
+  return key_digest("GET " + url + "\n" + header_value(headers, "Accept") +
+                    "\n" + header_value(headers, "Authorization"));
+}
+
+static bool is_storable(const WebResponse &response) {
+  auto directives = cache_directives(response.headers);
+  long long now = unix_now();
+  return response.success && response.status_code == 200 &&
+         !response.partial && response.content.size() <= kMaxStoredBody &&
+         !has_directive(directives, "no-store") &&
+         header_value(response.headers, "Vary") != "*" &&
+         (HttpCache::freshness_lifetime(response.headers, now) > 0 ||
+          !header_value(response.headers, "ETag").empty() ||
+          !header_value(response.headers, "Last-Modified").empty());
+}
+
+void HttpCache::configure(const std::string &new_directory, bool enable) {
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    directory = new_directory;
+    enabled = enable;
+    configured = true;
+  }
+  if (enable) {
+    remove_expired();
+  }
+}
+
+void HttpCache::ensure_configured() {
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (configured) {
+      return;
+    }
+  }
+  std::string setting =
+      Utils::Config::get_env_var("LLAMAWARE_HTTP_CACHE", "data/http_cache");
+  if (setting == "off") {
+    configure(directory, false);
+  } else {
+    configure(setting, true);
+  }
+}
+
+bool HttpCache::is_enabled() {
+  ensure_configured();
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  return enabled;
+}
+
+std::string HttpCache::path_for(const std::string &key) {
+  return (std::filesystem::path(directory) / key).string();
+}
+
+std::optional<HttpCache::Entry> HttpCache::load(const std::string &key) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  std::string base = path_for(key);
+  std::ifstream meta_file(base + ".json");
+  std::ifstream body_file(base + ".body", std::ios::binary);
+  if (!meta_file.is_open() || !body_file.is_open()) {
+    return std::nullopt;
+  }
+  try {
+    auto meta = nlohmann::json::parse(meta_file);
+    Entry entry;
+    entry.url = meta.value("url", "");
+    entry.stored_at = meta.value("stored_at", 0LL);
+    entry.initial_age = meta.value("initial_age", 0LL);
+    entry.lifetime = meta.value("lifetime", 0LL);
+    WebResponse &response = entry.response;
+    response.status_code = meta.value("status", 200);
+    response.content_type = meta.value("content_type", "");
+    response.success = true;
+    for (const auto &[name, value] : meta["headers"].items()) {
+      response.headers[name] = value.get<std::string>();
+    }
+    std::ostringstream body;
+    body << body_file.rdbuf();
+    response.content = body.str();
+    return entry;
+  } catch (const std::exception &) {
+    return std::nullopt; // Damaged entry; it is overwritten on the next miss
+  }
+}
+
+void HttpCache::store(const std::string &key, const Entry &entry) {
+  nlohmann::json meta = {{"url", entry.url},
+                         {"status", entry.response.status_code},
+                         {"content_type", entry.response.content_type},
+                         {"stored_at", entry.stored_at},
+                         {"initial_age", entry.initial_age},
+                         {"lifetime", entry.lifetime},
+                         {"headers", nlohmann::json::object()}};
+  for (const auto &[name, value] : entry.response.headers) {
+    if (name != "X-Cache") {
+      meta["headers"][name] = value;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  std::string base = path_for(key);
+  // Write both files aside and rename them in, so readers never see a
+  // half-written entry
+  {
+    std::ofstream body(base + ".body.tmp", std::ios::binary | std::ios::trunc);
+    body << entry.response.content;
+    std::ofstream meta_file(base + ".json.tmp", std::ios::trunc);
+    meta_file << meta.dump(-1, ' ', false,
+                           nlohmann::json::error_handler_t::replace);
+    if (!body || !meta_file) {
+      return;
+    }
+  }
+  std::filesystem::rename(base + ".body.tmp", base + ".body", error);
+  if (!error) {
+    std::filesystem::rename(base + ".json.tmp", base + ".json", error);
+  }
+}
+
+void HttpCache::remove_expired() {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  std::error_code error;
+  long long now = unix_now();
+  for (const auto &file :
+       std::filesystem::directory_iterator(directory, error)) {
+    if (file.path().extension() != ".json") {
+      continue;
+    }
+    long long expires_at = 0;
+    try {
+      std::ifstream meta_file(file.path());
+      auto meta = nlohmann::json::parse(meta_file);
+      expires_at = meta.value("stored_at", 0LL) + meta.value("lifetime", 0LL);
+    } catch (const std::exception &) {
+      // Unreadable entries go too
+    }
+    if (now - expires_at > kMaxStaleAge) {
+      std::filesystem::path body = file.path();
+      body.replace_extension(".body");
+      std::filesystem::remove(body, error);
+      std::filesystem::remove(file.path(), error);
+    }
+  }
+}
+
+WebResponse HttpCache::fetch(const std::string &url, const HeaderMap &headers,
+                             const Perform &perform) {
+  if (!is_enabled() || HttpCassette::active()) {
+    return perform(headers);
+  }
+
+  const std::string key = cache_key(url, headers);
+  const long long now = unix_now();
+  std::optional<Entry> entry = load(key);
+  if (entry && entry->url != url) {
+    entry.reset(); // Digest collision
+  }
+
+  if (entry) {
+    long long age = entry->initial_age + std::max(0LL, now - entry->stored_at);
+    bool reload = has_directive(cache_directives(headers), "no-cache");
+    if (!reload && age < entry->lifetime) {
+      WebResponse response = entry->response;
+      response.headers["X-Cache"] = "HIT";
+      response.from_cache = true;
+      return response;
+    }
+  }
+
+  HeaderMap request_headers = headers;
+  if (entry) {
+    std::string etag = header_value(entry->response.headers, "ETag");
+    std::string last_modified =
+        header_value(entry->response.headers, "Last-Modified");
+    if (!etag.empty()) {
+      request_headers["If-None-Match"] = etag;
+    }
+    if (!last_modified.empty()) {
+      request_headers["If-Modified-Since"] = last_modified;
+    }
+  }
+
+  WebResponse response = perform(request_headers);
+
+  if (entry && response.status_code == 304) {
+    // Not modified: refresh the stored headers and serve the stored body.
+    // Providers such as GitHub do not bill these against the quota.
+    RateLimiter::refund_request(url, headers);
+    for (const auto &[name, value] : response.headers) {
+      entry->response.headers[name] = value;
+    }
+    entry->stored_at = now;
+    entry->initial_age = age_header(response.headers);
+    entry->lifetime = freshness_lifetime(entry->response.headers, now);
+    store(key, *entry);
+    WebResponse served = entry->response;
+    served.headers["X-Cache"] = "REVALIDATED";
+    served.from_cache = true;
+    return served;
+  }
+
+  if (is_storable(response)) {
+    Entry fresh;
+    fresh.url = url;
+    fresh.response = response;
+    fresh.stored_at = now;
+    fresh.initial_age = age_header(response.headers);
+    fresh.lifetime = freshness_lifetime(response.headers, now);
+    store(key, fresh);
+  }
+  return response;
+}
+
+} // namespace Services
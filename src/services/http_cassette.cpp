@@ -0,0 +1,304 @@
+#include "services/http_cassette.h"
+#include "utils/config.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <thread>
+
+namespace Services {
+
+CassetteMode HttpCassette::mode = CassetteMode::Off;
+ReplayLatency HttpCassette::latency = ReplayLatency::Original;
+std::map<std::string, std::deque<HttpCassette::Interaction>>
+    HttpCassette::recorded;
+std::ofstream HttpCassette::recording;
+std::mutex HttpCassette::cassette_mutex;
+bool HttpCassette::configured = false;
+
+// Query parameters whose values never go into a cassette
+static const std::vector<std::string> kSecretParameters = {
+    "api_key", "apikey", "key", "token", "access_token", "secret", "password"};
+
+// FNV-1a; unlike std::hash it is stable across platforms and builds, so
+// cassettes recorded on one machine replay on another
+static std::uint64_t fingerprint(const std::string &data) {
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+std::string HttpCassette::redact_url(const std::string &url) {
+  size_t query = url.find('?');
+  if (query == std::string::npos) {
+    return url;
+  }
+
+  std::string redacted = url.substr(0, query + 1);
+  size_t pos = query + 1;
+  while (pos <= url.size()) {
+    size_t end = url.find('&', pos);
+    if (end == std::string::npos) {
+      end = url.size();
+    }
+    std::string parameter = url.substr(pos, end - pos);
+    size_t equals = parameter.find('=');
+    std::string name = parameter.substr(0, equals);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (equals != std::string::npos &&
+        std::find(kSecretParameters.begin(), kSecretParameters.end(), name) !=
+            kSecretParameters.end()) {
+      parameter = parameter.substr(0, equals + 1) + "REDACTED";
+    }
+    redacted += parameter;
+    if (end < url.size()) {
+      redacted += '&';
+    }
+    pos = end + 1;
+  }
+  return redacted;
+}
+
+std::string HttpCassette::key_for(const std::string &method,
+                                  const std::string &url,
+                                  const std::string &body) {
+  char digest[17];
+  std::snprintf(digest, sizeof(digest), "%016llx",
+                static_cast<unsigned long long>(fingerprint(body)));
+  return method + " " + redact_url(url) + " " + digest;
+}
+
+bool HttpCassette::configure_locked(CassetteMode new_mode,
+                                    const std::string &path,
+                                    ReplayLatency new_latency) {
+  configured = true;
+  mode = CassetteMode::Off;
+  latency = new_latency;
+  recorded.clear();
+  if (recording.is_open()) {
+    recording.close();
+  }
+
+  if (new_mode == CassetteMode::Record) {
+    recording.open(path, std::ios::out | std::ios::trunc);
+    if (!recording.is_open()) {
+      return false;
+    }
+  } else if (new_mode == CassetteMode::Replay) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+      return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+      try {
+        auto entry = nlohmann::json::parse(line);
+        Interaction interaction;
+        WebResponse &response = interaction.response;
+        response.status_code = entry.value("status", 0);
+        response.content = entry.value("body", "");
+        response.content_type = entry.value("content_type", "");
+        response.success = entry.value("success", false);
+        response.error_message = entry.value("error", "");
+        for (const auto &[name, value] : entry["headers"].items()) {
+          response.headers[name] = value.get<std::string>();
+        }
+        interaction.elapsed_ms = entry.value("elapsed_ms", 0LL);
+        for (const auto &chunk : entry["chunks"]) {
+          interaction.chunks.push_back(
+              {chunk[0].get<long long>(), chunk[1].get<std::size_t>()});
+        }
+        recorded[entry.value("key", "")].push_back(std::move(interaction));
+      } catch (const std::exception &) {
+        // Skip malformed lines, e.g. a partial write at the end
+      }
+    }
+  }
+  mode = new_mode;
+  return true;
+}
+
+bool HttpCassette::configure(CassetteMode new_mode, const std::string &path,
+                             ReplayLatency new_latency) {
+  std::lock_guard<std::mutex> lock(cassette_mutex);
+  return configure_locked(new_mode, path, new_latency);
+}
+
+void HttpCassette::ensure_configured() {
+  if (configured) {
+    return;
+  }
+  std::string path = Utils::Config::get_env_var("LLAMAWARE_CASSETTE", "");
+  std::string mode_name =
+      Utils::Config::get_env_var("LLAMAWARE_CASSETTE_MODE", "replay");
+  ReplayLatency replay_latency =
+      Utils::Config::get_env_var("LLAMAWARE_CASSETTE_LATENCY", "original") ==
+              "zero"
+          ? ReplayLatency::Zero
+          : ReplayLatency::Original;
+
+  if (path.empty()) {
+    configured = true;
+    return;
+  }
+  CassetteMode new_mode =
+      mode_name == "record" ? CassetteMode::Record : CassetteMode::Replay;
+  if (!configure_locked(new_mode, path, replay_latency)) {
+    std::cerr << "Could not open HTTP cassette: " << path << std::endl;
+  }
+}
+
+bool HttpCassette::active() {
+  std::lock_guard<std::mutex> lock(cassette_mutex);
+  ensure_configured();
+  return mode != CassetteMode::Off;
+}
+
+bool HttpCassette::is_replaying() {
+  std::lock_guard<std::mutex> lock(cassette_mutex);
+  ensure_configured();
+  return mode == CassetteMode::Replay;
+}
+
+bool HttpCassette::is_instant() {
+  std::lock_guard<std::mutex> lock(cassette_mutex);
+  ensure_configured();
+  return mode == CassetteMode::Replay && latency == ReplayLatency::Zero;
+}
+
+bool HttpCassette::next_interaction(const std::string &key,
+                                    Interaction &out) {
+  std::lock_guard<std::mutex> lock(cassette_mutex);
+  auto it = recorded.find(key);
+  if (it == recorded.end() || it->second.empty()) {
+    return false;
+  }
+  out = it->second.front();
+  if (it->second.size() > 1) {
+    it->second.pop_front(); // The last response keeps repeating
+  }
+  return true;
+}
+
+void HttpCassette::save(const std::string &key,
+                        const Interaction &interaction) {
+  const WebResponse &response = interaction.response;
+  nlohmann::json entry = {{"key", key},
+                          {"status", response.status_code},
+                          {"success", response.success},
+                          {"content_type", response.content_type},
+                          {"error", response.error_message},
+                          {"elapsed_ms", interaction.elapsed_ms},
+                          {"headers", nlohmann::json::object()},
+                          {"chunks", nlohmann::json::array()},
+                          {"body", response.content}};
+  for (const auto &[name, value] : response.headers) {
+    entry["headers"][name] = value;
+  }
+  for (const auto &chunk : interaction.chunks) {
+    entry["chunks"].push_back({chunk.offset_ms, chunk.length});
+  }
+  std::string line =
+      entry.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+
+  std::lock_guard<std::mutex> lock(cassette_mutex);
+  if (recording.is_open()) {
+    recording << line << '\n';
+    recording.flush(); // Keep the cassette usable if the run is cut short
+  }
+}
+
+void HttpCassette::wait_until(std::chrono::steady_clock::time_point start,
+                              long long offset_ms) {
+  if (latency == ReplayLatency::Original) {
+    std::this_thread::sleep_until(start + std::chrono::milliseconds(offset_ms));
+  }
+}
+
+static WebResponse missing_response(const std::string &key) {
+  return {0, "", "", {}, false, "No recorded response for " + key};
+}
+
+WebResponse HttpCassette::exchange(const std::string &method,
+                                   const std::string &url,
+                                   const std::string &body,
+                                   const Perform &perform) {
+  if (!active()) {
+    return perform();
+  }
+  const std::string key = key_for(method, url, body);
+  auto start = std::chrono::steady_clock::now();
+
+  if (is_replaying()) {
+    Interaction interaction;
+    if (!next_interaction(key, interaction)) {
+      return missing_response(key);
+    }
+    wait_until(start, interaction.elapsed_ms);
+    return interaction.response;
+  }
+
+  Interaction interaction;
+  interaction.response = perform();
+  interaction.elapsed_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+  save(key, interaction);
+  return interaction.response;
+}
+
+WebResponse HttpCassette::exchange_stream(const std::string &method,
+                                          const std::string &url,
+                                          const std::string &body,
+                                          const StreamCallback &on_chunk,
+                                          const PerformStream &perform) {
+  if (!active()) {
+    return perform(on_chunk);
+  }
+  const std::string key = key_for(method, url, body);
+  auto start = std::chrono::steady_clock::now();
+
+  if (is_replaying()) {
+    Interaction interaction;
+    if (!next_interaction(key, interaction)) {
+      return missing_response(key);
+    }
+    std::string_view content = interaction.response.content;
+    for (const auto &chunk : interaction.chunks) {
+      wait_until(start, chunk.offset_ms);
+      on_chunk(content.substr(0, chunk.length));
+      content.remove_prefix(std::min(chunk.length, content.size()));
+    }
+    wait_until(start, interaction.elapsed_ms);
+    interaction.response.content.clear();
+    return interaction.response;
+  }
+
+  Interaction interaction;
+  std::string content;
+  interaction.response = perform([&](std::string_view chunk) {
+    interaction.chunks.push_back(
+        {std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - start)
+             .count(),
+         chunk.size()});
+    content.append(chunk);
+    on_chunk(chunk);
+  });
+  interaction.elapsed_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+
+  WebResponse response = interaction.response;
+  interaction.response.content = std::move(content);
+  save(key, interaction);
+  return response;
+}
+
+} // namespace Services
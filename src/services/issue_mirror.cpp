@@ -0,0 +1,137 @@
+#include "services/issue_mirror.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+namespace Services {
+
+// Compact once the file holds this many times more lines than issues
+static constexpr std::size_t kCompactionRatio = 2;
+
+static nlohmann::json to_json(const GitHubIssue &issue) {
+  return {{"number", issue.number},         {"title", issue.title},
+          {"body", issue.body},             {"state", issue.state},
+          {"labels", issue.labels},         {"assignees", issue.assignees},
+          {"milestone", issue.milestone},   {"updated_at", issue.updated_at},
+          {"pull_request", issue.pull_request}};
+}
+
+static GitHubIssue from_json(const nlohmann::json &json) {
+  GitHubIssue issue;
+  issue.number = json.value("number", 0);
+  issue.title = json.value("title", "");
+  issue.body = json.value("body", "");
+  issue.state = json.value("state", "");
+  issue.labels = json.value("labels", std::vector<std::string>{});
+  issue.assignees = json.value("assignees", std::vector<std::string>{});
+  issue.milestone = json.value("milestone", 0);
+  issue.updated_at = json.value("updated_at", "");
+  issue.pull_request = json.value("pull_request", false);
+  return issue;
+}
+
+static std::string to_line(const GitHubIssue &issue) {
+  return to_json(issue).dump(-1, ' ', false,
+                             nlohmann::json::error_handler_t::replace);
+}
+
+IssueMirror::IssueMirror(const std::string &owner, const std::string &repo,
+                         const std::string &root)
+    : directory_((std::filesystem::path(root) / owner / repo).string()) {}
+
+bool IssueMirror::is_valid_name(const std::string &name) {
+  if (name.empty() || name == "." || name == "..") {
+    return false;
+  }
+  return std::all_of(name.begin(), name.end(), [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '-' ||
+           c == '_' || c == '.';
+  });
+}
+
+void IssueMirror::index_issue(const GitHubIssue &issue) {
+  // The title counts twice; it says more about the issue than the body
+  index_.add(static_cast<std::uint32_t>(issue.number),
+             issue.title + "\n" + issue.title + "\n" + issue.body);
+  if (issue.updated_at > last_updated_) {
+    last_updated_ = issue.updated_at;
+  }
+}
+
+bool IssueMirror::load() {
+  std::ifstream file(directory_ + "/issues.jsonl");
+  if (!file.is_open()) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    try {
+      GitHubIssue issue = from_json(nlohmann::json::parse(line));
+      issues_[issue.number] = std::move(issue);
+      ++stored_lines_;
+    } catch (const std::exception &) {
+      // A line cut short by an interrupted sync; the next sync refetches it
+    }
+  }
+  for (const auto &[number, issue] : issues_) {
+    index_issue(issue);
+  }
+  return !issues_.empty();
+}
+
+void IssueMirror::apply(const std::vector<GitHubIssue> &issues) {
+  if (issues.empty()) {
+    return;
+  }
+  std::error_code error;
+  std::filesystem::create_directories(directory_, error);
+  {
+    std::ofstream file(directory_ + "/issues.jsonl", std::ios::app);
+    for (const auto &issue : issues) {
+      file << to_line(issue) << '\n';
+    }
+  }
+  stored_lines_ += issues.size();
+
+  for (const auto &issue : issues) {
+    issues_[issue.number] = issue;
+    index_issue(issue);
+  }
+  if (stored_lines_ > kCompactionRatio * issues_.size()) {
+    compact();
+  }
+}
+
+void IssueMirror::compact() {
+  const std::string path = directory_ + "/issues.jsonl";
+  {
+    std::ofstream file(path + ".tmp", std::ios::trunc);
+    for (const auto &[number, issue] : issues_) {
+      file << to_line(issue) << '\n';
+    }
+    if (!file) {
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(path + ".tmp", path, error);
+  if (!error) {
+    stored_lines_ = issues_.size();
+  }
+}
+
+std::vector<const GitHubIssue *>
+IssueMirror::related(const std::string &text, std::size_t limit) const {
+  std::vector<const GitHubIssue *> result;
+  for (const auto &[number, score] : index_.search(text, limit)) {
+    auto it = issues_.find(static_cast<int>(number));
+    if (it != issues_.end()) {
+      result.push_back(&it->second);
+    }
+  }
+  return result;
+}
+
+} // namespace Services
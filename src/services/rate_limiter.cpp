@@ -0,0 +1,206 @@
+#include "services/rate_limiter.h"
+#include "services/auth_service.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace Services {
+
+std::map<std::string, RateLimitConfig> RateLimiter::host_limits;
+std::map<std::string, RateLimiter::Bucket> RateLimiter::buckets;
+std::mutex RateLimiter::limiter_mutex;
+std::once_flag RateLimiter::configured;
+
+// Limits for hosts that are not AI providers and so have no AuthProvider
+static std::map<std::string, RateLimitConfig> builtin_limits() {
+  // GitHub allows 5000 authenticated requests per hour, but only 60 per
+  // hour per address without one
+  return {{"api.github.com", {0.0, 80.0, 0.0, 60.0}}};
+}
+
+std::string RateLimiter::credential_of(const HeaderMap &headers) {
+  // Buckets are keyed by a digest so credentials are never kept in memory
+  for (const char *name : {"Authorization", "X-API-Key"}) {
+    auto it = headers.find(name);
+    if (it != headers.end() && !it->second.empty()) {
+      std::ostringstream digest;
+      digest << std::hex << std::hash<std::string>{}(it->second);
+      return digest.str();
+    }
+  }
+  return "anonymous";
+}
+
+RateLimiter::Bucket &RateLimiter::bucket_for(const std::string &key,
+                                             double per_window,
+                                             double window_seconds) {
+  auto [it, inserted] = buckets.try_emplace(key);
+  Bucket &bucket = it->second;
+  if (inserted) {
+    // One window's worth of burst, starting full
+    bucket.capacity = per_window;
+    bucket.available = per_window;
+    bucket.refill_per_second = per_window / window_seconds;
+    bucket.updated = std::chrono::steady_clock::now();
+  }
+  return bucket;
+}
+
+RateLimiter::Bucket *RateLimiter::request_bucket(const std::string &host,
+                                                 const RateLimitConfig &limits,
+                                                 const HeaderMap &headers) {
+  const std::string credential = credential_of(headers);
+  const std::string key = "key:" + host + ":" + credential + ":requests";
+  if (credential == "anonymous" && limits.anonymous_requests_per_hour > 0.0) {
+    return &bucket_for(key, limits.anonymous_requests_per_hour, 3600.0);
+  }
+  if (limits.requests_per_minute > 0.0) {
+    return &bucket_for(key, limits.requests_per_minute);
+  }
+  return nullptr;
+}
+
+void RateLimiter::refill(Bucket &bucket,
+                         std::chrono::steady_clock::time_point now) {
+  std::chrono::duration<double> elapsed = now - bucket.updated;
+  bucket.available = std::min(bucket.capacity,
+                              bucket.available +
+                                  elapsed.count() * bucket.refill_per_second);
+  bucket.updated = now;
+}
+
+void RateLimiter::ensure_configured() { std::call_once(configured, reload); }
+
+void RateLimiter::reload() {
+  std::map<std::string, RateLimitConfig> limits = builtin_limits();
+  for (const auto &[host, config] : AuthService::load_rate_limits()) {
+    limits[host] = config;
+  }
+
+  std::lock_guard<std::mutex> lock(limiter_mutex);
+  host_limits = std::move(limits);
+  buckets.clear();
+}
+
+void RateLimiter::configure_host(const std::string &host,
+                                 const RateLimitConfig &config) {
+  ensure_configured();
+  std::lock_guard<std::mutex> lock(limiter_mutex);
+  host_limits[host] = config;
+  // Drop this host's buckets so they are rebuilt with the new rates
+  for (auto it = buckets.begin(); it != buckets.end();) {
+    bool for_host = it->first == "host:" + host ||
+                    it->first.rfind("key:" + host + ":", 0) == 0;
+    it = for_host ? buckets.erase(it) : std::next(it);
+  }
+}
+
+std::optional<WebResponse>
+RateLimiter::acquire(const std::string &url, const HeaderMap &headers,
+                     double tokens, std::chrono::milliseconds max_wait) {
+  ensure_configured();
+  const std::string host = WebService::get_host(url);
+  const std::string key = "key:" + host + ":" + credential_of(headers);
+  const auto deadline = std::chrono::steady_clock::now() + max_wait;
+
+  while (true) {
+    std::chrono::duration<double> wait{0.0};
+    {
+      std::lock_guard<std::mutex> lock(limiter_mutex);
+      auto limits_it = host_limits.find(host);
+      if (limits_it == host_limits.end()) {
+        return std::nullopt; // Unthrottled host
+      }
+      const RateLimitConfig &limits = limits_it->second;
+
+      struct Charge {
+        Bucket *bucket;
+        double amount;
+      };
+      std::vector<Charge> charges;
+      if (limits.host_requests_per_minute > 0.0) {
+        charges.push_back(
+            {&bucket_for("host:" + host, limits.host_requests_per_minute),
+             1.0});
+      }
+      if (Bucket *requests = request_bucket(host, limits, headers)) {
+        charges.push_back({requests, 1.0});
+      }
+      if (limits.tokens_per_minute > 0.0 && tokens > 0.0) {
+        Bucket &bucket = bucket_for(key + ":tokens", limits.tokens_per_minute);
+        // A request larger than the whole budget waits for a full bucket
+        charges.push_back({&bucket, std::min(tokens, bucket.capacity)});
+      }
+
+      // Take from every bucket only once all of them can cover the request
+      auto now = std::chrono::steady_clock::now();
+      double wait_seconds = 0.0;
+      for (const Charge &charge : charges) {
+        refill(*charge.bucket, now);
+        if (charge.bucket->available < charge.amount) {
+          wait_seconds = std::max(wait_seconds,
+                                  (charge.amount - charge.bucket->available) /
+                                      charge.bucket->refill_per_second);
+        }
+      }
+      if (wait_seconds <= 0.0) {
+        for (const Charge &charge : charges) {
+          charge.bucket->available -= charge.amount;
+        }
+        return std::nullopt;
+      }
+      wait = std::chrono::duration<double>(wait_seconds);
+      if (now + wait > deadline) {
+        // Refused like a server would, so RetryScheduler does not retry
+        auto seconds = static_cast<long long>(std::ceil(wait_seconds));
+        WebResponse refused{429, "", "", {}, false,
+                            "Rate limit for " + host + " used up; retry in " +
+                                std::to_string(seconds) + "s"};
+        refused.headers["Retry-After"] = std::to_string(seconds);
+        return refused;
+      }
+    }
+    std::this_thread::sleep_for(wait);
+  }
+}
+
+void RateLimiter::consume_tokens(const std::string &url,
+                                 const HeaderMap &headers, double tokens) {
+  ensure_configured();
+  const std::string host = WebService::get_host(url);
+
+  std::lock_guard<std::mutex> lock(limiter_mutex);
+  auto limits_it = host_limits.find(host);
+  if (limits_it == host_limits.end() ||
+      limits_it->second.tokens_per_minute <= 0.0) {
+    return;
+  }
+  Bucket &bucket =
+      bucket_for("key:" + host + ":" + credential_of(headers) + ":tokens",
+                 limits_it->second.tokens_per_minute);
+  refill(bucket, std::chrono::steady_clock::now());
+  bucket.available = std::min(bucket.capacity, bucket.available - tokens);
+}
+
+void RateLimiter::refund_request(const std::string &url,
+                                 const HeaderMap &headers) {
+  ensure_configured();
+  const std::string host = WebService::get_host(url);
+
+  std::lock_guard<std::mutex> lock(limiter_mutex);
+  auto limits_it = host_limits.find(host);
+  if (limits_it == host_limits.end()) {
+    return;
+  }
+  Bucket *bucket = request_bucket(host, limits_it->second, headers);
+  if (bucket == nullptr) {
+    return;
+  }
+  refill(*bucket, std::chrono::steady_clock::now());
+  bucket->available = std::min(bucket->capacity, bucket->available + 1.0);
+}
+
+} // namespace Services
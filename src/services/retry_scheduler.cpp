@@ -0,0 +1,257 @@
+#include "services/retry_scheduler.h"
+#include "services/http_cassette.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <ctime>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace Services {
+
+// Shared retry budget: each retry spends a token, each success refunds a
+// fraction, so retries stop once failures clearly outnumber successes
+static constexpr double kMaxRetryTokens = 10.0;
+static constexpr double kRetryTokenRefund = 0.1;
+
+// Values above this are absolute epoch seconds rather than a delay
+static constexpr double kEpochThresholdSeconds = 1e9;
+
+std::map<std::string, RetryScheduler::HostState> RetryScheduler::hosts;
+double RetryScheduler::retry_tokens = kMaxRetryTokens;
+std::mutex RetryScheduler::retry_mutex;
+
+static std::mt19937_64 &random_engine() {
+  thread_local std::mt19937_64 engine{std::random_device{}()};
+  return engine;
+}
+
+static std::chrono::milliseconds random_between(std::chrono::milliseconds low,
+                                                std::chrono::milliseconds high) {
+  std::uniform_int_distribution<long long> distribution(low.count(),
+                                                        high.count());
+  return std::chrono::milliseconds(distribution(random_engine()));
+}
+
+// Parses "30", "1.5", "20ms", "6m0s" or "1h2m3.5s" into milliseconds
+static std::optional<double> parse_duration_ms(std::string_view text) {
+  double total_ms = 0.0;
+  bool parsed_any = false;
+
+  while (!text.empty()) {
+    double value = 0.0;
+    auto [ptr, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc()) {
+      return std::nullopt;
+    }
+    text.remove_prefix(static_cast<std::size_t>(ptr - text.data()));
+
+    std::size_t unit_length = 0;
+    while (unit_length < text.size() &&
+           std::isalpha(static_cast<unsigned char>(text[unit_length]))) {
+      ++unit_length;
+    }
+    std::string_view unit = text.substr(0, unit_length);
+    text.remove_prefix(unit_length);
+
+    if (unit.empty() || unit == "s") {
+      total_ms += value * 1000.0;
+    } else if (unit == "ms") {
+      total_ms += value;
+    } else if (unit == "m") {
+      total_ms += value * 60000.0;
+    } else if (unit == "h") {
+      total_ms += value * 3600000.0;
+    } else {
+      return std::nullopt;
+    }
+    parsed_any = true;
+  }
+  return parsed_any ? std::optional<double>(total_ms) : std::nullopt;
+}
+
+// Parses an IMF-fixdate ("Wed, 21 Oct 2015 07:28:00 GMT") into a delay
+static std::optional<double> parse_http_date_ms(const std::string &text) {
+  std::tm tm{};
+  std::istringstream stream(text);
+  stream.imbue(std::locale::classic());
+  stream >> std::get_time(&tm, "%a, %d %b %Y %H:%M:%S");
+  if (stream.fail()) {
+    return std::nullopt;
+  }
+#ifdef _WIN32
+  std::time_t when = _mkgmtime(&tm);
+#else
+  std::time_t when = timegm(&tm);
+#endif
+  return std::difftime(when, std::time(nullptr)) * 1000.0;
+}
+
+bool RetryScheduler::acquire_retry_token() {
+  std::lock_guard<std::mutex> lock(retry_mutex);
+  if (retry_tokens < 1.0) {
+    return false;
+  }
+  retry_tokens -= 1.0;
+  return true;
+}
+
+void RetryScheduler::record_success() {
+  std::lock_guard<std::mutex> lock(retry_mutex);
+  retry_tokens = std::min(kMaxRetryTokens, retry_tokens + kRetryTokenRefund);
+}
+
+bool RetryScheduler::is_retryable(const WebResponse &response) {
+  switch (response.status_code) {
+  case 0: // No HTTP response at all (DNS, connect or TLS failure)
+    // A replayed cassette either has the response or never will
+    return !response.success && !HttpCassette::is_replaying();
+  case 408:
+  case 429:
+  case 502:
+  case 503:
+  case 504:
+    return true;
+  case 403: { // GitHub reports an exhausted rate limit as 403
+    auto remaining = response.headers.find("x-ratelimit-remaining");
+    return remaining != response.headers.end() && remaining->second == "0";
+  }
+  default:
+    return false;
+  }
+}
+
+std::optional<std::chrono::milliseconds>
+RetryScheduler::server_delay(const WebResponse &response) {
+  const HeaderMap &headers = response.headers;
+  std::optional<double> delay_ms;
+
+  auto retry_after = headers.find("Retry-After");
+  if (retry_after != headers.end()) {
+    delay_ms = parse_duration_ms(retry_after->second);
+    if (!delay_ms) {
+      delay_ms = parse_http_date_ms(retry_after->second);
+    }
+  } else if (response.status_code == 429 || response.status_code == 403) {
+    // OpenAI-style "x-ratelimit-reset-requests: 1m2s" and GitHub-style
+    // "x-ratelimit-reset: <epoch seconds>". Providers send these on every
+    // response, so only the resets of exhausted limits count.
+    const std::string reset = "x-ratelimit-reset";
+    for (const auto &[key, value] : headers) {
+      std::string name = key;
+      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+      if (name.rfind(reset, 0) != 0) {
+        continue;
+      }
+      auto remaining =
+          headers.find("x-ratelimit-remaining" + name.substr(reset.size()));
+      if (remaining == headers.end() || remaining->second != "0") {
+        continue;
+      }
+      std::optional<double> parsed = parse_duration_ms(value);
+      if (parsed && *parsed / 1000.0 > kEpochThresholdSeconds) {
+        parsed = *parsed - static_cast<double>(std::time(nullptr)) * 1000.0;
+      }
+      if (parsed) {
+        delay_ms = std::max(delay_ms.value_or(0.0), *parsed);
+      }
+    }
+  }
+
+  if (!delay_ms) {
+    return std::nullopt;
+  }
+  return std::chrono::milliseconds(
+      static_cast<long long>(std::max(0.0, *delay_ms)));
+}
+
+std::chrono::milliseconds
+RetryScheduler::next_backoff(std::chrono::milliseconds previous,
+                             const RetryPolicy &policy) {
+  auto upper = std::max(policy.base_delay, previous * 3);
+  return std::min(policy.max_delay, random_between(policy.base_delay, upper));
+}
+
+WebResponse RetryScheduler::execute(const std::string &url,
+                                    const std::function<WebResponse()> &attempt,
+                                    const RetryPolicy &policy) {
+  const std::string host = WebService::get_host(url);
+  std::chrono::milliseconds backoff = policy.base_delay;
+  WebResponse response;
+
+  for (int attempt_number = 1;; ++attempt_number) {
+    // Honour a back-off another request to this host was told to observe,
+    // spreading the waiters out so they do not all fire at the deadline
+    std::chrono::steady_clock::time_point blocked_until;
+    {
+      std::lock_guard<std::mutex> lock(retry_mutex);
+      blocked_until = hosts[host].blocked_until;
+    }
+    // Instant replays reproduce the retry sequence without the waits
+    const bool instant = HttpCassette::is_instant();
+    auto now = std::chrono::steady_clock::now();
+    if (blocked_until > now && !instant) {
+      auto wait =
+          std::chrono::duration_cast<std::chrono::milliseconds>(blocked_until -
+                                                                now);
+      if (wait > policy.max_delay) {
+        response = {429, "", "", {}, false,
+                    "Rate limited by " + host + "; retry in " +
+                        std::to_string(wait.count() / 1000) + "s"};
+        return response;
+      }
+      std::this_thread::sleep_for(
+          wait + random_between(std::chrono::milliseconds(0),
+                                policy.base_delay));
+    }
+
+    response = attempt();
+    if (!is_retryable(response)) {
+      if (response.success) {
+        record_success();
+      }
+      return response;
+    }
+    if (attempt_number >= policy.max_attempts) {
+      return response;
+    }
+
+    std::chrono::milliseconds wait;
+    std::optional<std::chrono::milliseconds> requested =
+        server_delay(response);
+    if (requested) {
+      if (*requested > policy.max_delay) {
+        return response; // Not worth blocking the caller that long
+      }
+      wait = std::max(*requested, policy.base_delay);
+    } else {
+      backoff = next_backoff(backoff, policy);
+      wait = backoff;
+    }
+
+    if (!acquire_retry_token()) {
+      return response;
+    }
+    if (requested) {
+      std::lock_guard<std::mutex> lock(retry_mutex);
+      auto &state = hosts[host];
+      state.blocked_until = std::max(
+          state.blocked_until, std::chrono::steady_clock::now() + wait);
+      continue; // The host block above performs the wait
+    }
+    if (!instant) {
+      std::this_thread::sleep_for(wait);
+    }
+  }
+}
+
+void RetryScheduler::reset() {
+  std::lock_guard<std::mutex> lock(retry_mutex);
+  hosts.clear();
+  retry_tokens = kMaxRetryTokens;
+}
+
+} // namespace Services
@@ -0,0 +1,199 @@
+#include "services/summary_service.h"
+#include "core/agent_mode.h"
+#include "services/ai_service.h"
+#include "utils/thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <future>
+
+namespace Services {
+
+// Same rough estimate the rate limiter uses for prompt sizes
+static constexpr std::size_t kCharsPerToken = 4;
+
+// Local models run with a small default context window and serve requests
+// largely one at a time, so they get smaller chunks and less parallelism
+static constexpr std::size_t kLocalChunkTokens = 1500;
+static constexpr std::size_t kRemoteChunkTokens = 4000;
+static constexpr std::size_t kLocalParallel = 2;
+static constexpr std::size_t kRemoteParallel = 4;
+
+// Reduce rounds before the partial summaries are combined regardless
+static constexpr int kMaxReduceRounds = 3;
+
+std::vector<std::string_view>
+SummaryService::split_chunks(std::string_view text, std::size_t max_chars) {
+  std::vector<std::string_view> chunks;
+  max_chars = std::max<std::size_t>(max_chars, 1);
+
+  while (!text.empty()) {
+    if (text.size() <= max_chars) {
+      chunks.push_back(text);
+      break;
+    }
+    std::string_view window = text.substr(0, max_chars);
+    // Prefer the last natural break in the second half of the window
+    std::size_t cut = std::string_view::npos;
+    for (std::string_view separator : {"\n\n", "\n", " "}) {
+      std::size_t found = window.rfind(separator);
+      if (found != std::string_view::npos && found >= max_chars / 2) {
+        cut = found + separator.size();
+        break;
+      }
+    }
+    if (cut == std::string_view::npos) {
+      cut = max_chars;
+      // Do not split a UTF-8 sequence
+      while (cut > 1 &&
+             (static_cast<unsigned char>(text[cut]) & 0xC0) == 0x80) {
+        --cut;
+      }
+    }
+    chunks.push_back(text.substr(0, cut));
+    text.remove_prefix(cut);
+  }
+  return chunks;
+}
+
+// Sends every prompt with at most `parallel` requests in flight; each
+// worker has its own AIService since the service keeps per-call state
+static std::vector<std::string>
+run_prompts(Core::AgentMode mode, const std::string &api_key,
+            const std::vector<std::string> &prompts, std::size_t parallel,
+            std::atomic<long long> &total_tokens) {
+  std::vector<std::string> outputs(prompts.size());
+  std::atomic<std::size_t> next{0};
+
+  std::vector<std::future<void>> workers;
+  std::size_t worker_count = std::min(parallel, prompts.size());
+  for (std::size_t w = 0; w < worker_count; ++w) {
+    workers.push_back(Utils::ThreadPool::shared().submit([&] {
+      AIService ai(mode, api_key);
+      for (std::size_t i = next++; i < prompts.size(); i = next++) {
+        outputs[i] = ai.chat(prompts[i], std::string());
+        total_tokens += ai.get_last_usage().total_tokens();
+      }
+    }));
+  }
+  for (auto &worker : workers) {
+    worker.get();
+  }
+  return outputs;
+}
+
+static bool is_error(const std::string &output) {
+  return output.empty() || output.rfind("Error:", 0) == 0;
+}
+
+SummaryResult SummaryService::summarize(Core::AgentMode mode,
+                                        const std::string &api_key,
+                                        const std::string &label,
+                                        std::string_view text,
+                                        const SummaryOptions &options) {
+  bool local = AIService(mode, api_key).supports_session();
+  std::size_t chunk_tokens = options.chunk_tokens
+                                 ? options.chunk_tokens
+                                 : (local ? kLocalChunkTokens
+                                          : kRemoteChunkTokens);
+  std::size_t parallel = options.max_parallel
+                             ? options.max_parallel
+                             : (local ? kLocalParallel : kRemoteParallel);
+  std::size_t chunk_chars = chunk_tokens * kCharsPerToken;
+  std::string focus =
+      options.focus.empty()
+          ? std::string()
+          : "\nFocus on what helps with this request: " + options.focus;
+
+  SummaryResult result;
+  std::atomic<long long> total_tokens{0};
+
+  // Map: summarize every chunk independently
+  std::vector<std::string_view> chunks = split_chunks(text, chunk_chars);
+  std::size_t dropped = 0;
+  if (chunks.size() > options.max_chunks) {
+    for (std::size_t i = options.max_chunks; i < chunks.size(); ++i) {
+      dropped += chunks[i].size();
+    }
+    chunks.resize(options.max_chunks);
+  }
+  result.chunks = chunks.size();
+
+  std::vector<std::string> prompts;
+  prompts.reserve(chunks.size());
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    std::string prompt =
+        chunks.size() == 1
+            ? "Summarize " + label + "."
+            : "Summarize part " + std::to_string(i + 1) + " of " +
+                  std::to_string(chunks.size()) + " of " + label + ".";
+    prompt += " Keep concrete facts, names, numbers and code identifiers; "
+              "omit boilerplate." +
+              focus + "\n\n";
+    prompt.append(chunks[i]);
+    prompts.push_back(std::move(prompt));
+  }
+  std::vector<std::string> summaries =
+      run_prompts(mode, api_key, prompts, parallel, total_tokens);
+  result.failed_chunks = static_cast<std::size_t>(
+      std::count_if(summaries.begin(), summaries.end(), is_error));
+  bool lost_combines = false; // A failed reduce step drops its group
+
+  // Reduce: combine partial summaries, in chunks while they are too long
+  for (int round = 0; summaries.size() > 1; ++round) {
+    std::string combined;
+    std::size_t usable = 0;
+    for (std::size_t i = 0; i < summaries.size(); ++i) {
+      if (is_error(summaries[i])) {
+        continue;
+      }
+      combined += "Part " + std::to_string(i + 1) + ":\n" + summaries[i] +
+                  "\n\n";
+      ++usable;
+    }
+    if (usable == 0) {
+      summaries = {summaries.front()};
+      break;
+    }
+
+    std::vector<std::string_view> groups =
+        round < kMaxReduceRounds
+            ? split_chunks(combined, chunk_chars)
+            : std::vector<std::string_view>{combined};
+    prompts.clear();
+    for (std::string_view group : groups) {
+      std::string prompt = "Combine these summaries of consecutive parts of " +
+                           label + " into one coherent summary." + focus +
+                           "\n\n";
+      prompt.append(group);
+      prompts.push_back(std::move(prompt));
+    }
+    summaries = run_prompts(mode, api_key, prompts, parallel, total_tokens);
+    if (summaries.size() > 1) {
+      lost_combines = lost_combines || std::any_of(summaries.begin(),
+                                                   summaries.end(), is_error);
+    }
+  }
+
+  result.total_tokens = total_tokens;
+  result.summary = summaries.empty() ? "Error: nothing to summarize"
+                                     : summaries.front();
+  result.success = !is_error(result.summary);
+  if (result.success && result.failed_chunks > 0) {
+    result.summary += "\n\n[" + std::to_string(result.failed_chunks) +
+                      " of " + std::to_string(result.chunks) +
+                      " chunks could not be summarized and are not covered]";
+  }
+  if (result.success && lost_combines) {
+    result.summary += "\n\n[Some partial summaries could not be combined "
+                      "and are not covered]";
+  }
+  if (result.success && dropped > 0) {
+    result.summary += "\n\n[" + std::to_string(dropped) +
+                      " characters beyond the first " +
+                      std::to_string(result.chunks) +
+                      " chunks were not summarized]";
+  }
+  return result;
+}
+
+} // namespace Services
@@ -0,0 +1,142 @@
+#include "services/telemetry_service.h"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+
+namespace Services {
+
+std::map<std::string, ProviderTelemetry> TelemetryService::providers;
+std::mutex TelemetryService::telemetry_mutex;
+
+std::string TelemetryService::get_telemetry_path() {
+  return "data/telemetry.json";
+}
+
+void TelemetryService::record_turn(const TurnMetrics &metrics) {
+  std::lock_guard<std::mutex> lock(telemetry_mutex);
+  auto &entry = providers[metrics.provider];
+
+  entry.requests++;
+  if (!metrics.success) {
+    entry.failures++;
+    return;
+  }
+
+  entry.usage.prompt_tokens += metrics.usage.prompt_tokens;
+  entry.usage.completion_tokens += metrics.usage.completion_tokens;
+  entry.ttft_ms.record(metrics.ttft_ms);
+  entry.total_ms.record(metrics.total_ms);
+  if (metrics.tokens_per_second > 0.0) {
+    entry.tokens_per_second.record(metrics.tokens_per_second);
+  }
+}
+
+void TelemetryService::record_prompt_cache_hit(const std::string &provider) {
+  std::lock_guard<std::mutex> lock(telemetry_mutex);
+  providers[provider].prompt_cache_hits++;
+}
+
+TokenUsage TelemetryService::get_total_usage() {
+  std::lock_guard<std::mutex> lock(telemetry_mutex);
+  TokenUsage total;
+  for (const auto &[name, entry] : providers) {
+    total.prompt_tokens += entry.usage.prompt_tokens;
+    total.completion_tokens += entry.usage.completion_tokens;
+  }
+  return total;
+}
+
+void TelemetryService::reset() {
+  std::lock_guard<std::mutex> lock(telemetry_mutex);
+  providers.clear();
+}
+
+static nlohmann::json histogram_to_json(const Utils::Histogram &histogram) {
+  return {{"count", histogram.count()},
+          {"min", histogram.min()},
+          {"mean", histogram.mean()},
+          {"p50", histogram.percentile(50.0)},
+          {"p90", histogram.percentile(90.0)},
+          {"p99", histogram.percentile(99.0)},
+          {"max", histogram.max()}};
+}
+
+std::string TelemetryService::format_summary() {
+  std::lock_guard<std::mutex> lock(telemetry_mutex);
+  if (providers.empty()) {
+    return "  No model requests recorded yet.\n";
+  }
+
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(1);
+  for (const auto &[name, entry] : providers) {
+    ss << "  Provider: " << name << "\n";
+    ss << "    Requests: " << entry.requests << " (" << entry.failures
+       << " failed)\n";
+    ss << "    Tokens: " << entry.usage.prompt_tokens << " prompt / "
+       << entry.usage.completion_tokens << " completion\n";
+    if (entry.prompt_cache_hits > 0) {
+      ss << "    Prompt cache hits: " << entry.prompt_cache_hits << "\n";
+    }
+    if (entry.total_ms.count() == 0) {
+      continue;
+    }
+    ss << "    TTFT ms:    p50 " << entry.ttft_ms.percentile(50.0) << "  p90 "
+       << entry.ttft_ms.percentile(90.0) << "  p99 "
+       << entry.ttft_ms.percentile(99.0) << "\n";
+    ss << "    Latency ms: p50 " << entry.total_ms.percentile(50.0) << "  p90 "
+       << entry.total_ms.percentile(90.0) << "  p99 "
+       << entry.total_ms.percentile(99.0) << "\n";
+    if (entry.tokens_per_second.count() > 0) {
+      ss << "    Tokens/s:   p50 " << entry.tokens_per_second.percentile(50.0)
+         << "  p10 " << entry.tokens_per_second.percentile(10.0) << "  mean "
+         << entry.tokens_per_second.mean() << "\n";
+    }
+  }
+  return ss.str();
+}
+
+std::string TelemetryService::to_json_string() {
+  std::lock_guard<std::mutex> lock(telemetry_mutex);
+  nlohmann::json root;
+  root["providers"] = nlohmann::json::object();
+
+  for (const auto &[name, entry] : providers) {
+    nlohmann::json provider_json;
+    provider_json["requests"] = entry.requests;
+    provider_json["failures"] = entry.failures;
+    provider_json["prompt_cache_hits"] = entry.prompt_cache_hits;
+    provider_json["prompt_tokens"] = entry.usage.prompt_tokens;
+    provider_json["completion_tokens"] = entry.usage.completion_tokens;
+    provider_json["ttft_ms"] = histogram_to_json(entry.ttft_ms);
+    provider_json["total_ms"] = histogram_to_json(entry.total_ms);
+    provider_json["tokens_per_second"] =
+        histogram_to_json(entry.tokens_per_second);
+    root["providers"][name] = provider_json;
+  }
+
+  return root.dump(2);
+}
+
+bool TelemetryService::export_json(const std::string &export_path) {
+  try {
+    std::string path = export_path.empty() ? get_telemetry_path() : export_path;
+    std::filesystem::path file_path(path);
+    if (file_path.has_parent_path()) {
+      std::filesystem::create_directories(file_path.parent_path());
+    }
+
+    std::ofstream file(path);
+    file << to_json_string();
+    return static_cast<bool>(file);
+
+  } catch (const std::exception &e) {
+    std::cerr << "Failed to export telemetry: " << e.what() << std::endl;
+    return false;
+  }
+}
+
+} // namespace Services
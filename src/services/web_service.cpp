@@ -1,21 +1,45 @@
 #include "services/web_service.h"
+#include "services/http_cache.h"
+#include "services/http_cassette.h"
+#include "services/rate_limiter.h"
+#include "services/retry_scheduler.h"
 #include "utils/config.h"
+#include "utils/html_text.h"
 #include <algorithm>
 #include <cpr/cpr.h>
+#include <future>
 #include <curl/curl.h>
 #include <iostream>
+#include <mutex>
 #include <nlohmann/json.hpp>
+#include <optional>
 #include <sstream>
 #include <vector>
 
 const long kDefaultTimeoutSeconds = 30;
+// A streamed reply may take minutes in all; it is only abandoned once no
+// byte has arrived for this long (a local model's prompt evaluation
+// included)
+const long kStreamStallSeconds = 120;
 const size_t kMaxContentLength = 8000;
+// Chat requests queue for a whole minute's token budget rather than fail
+const std::chrono::seconds kChatQueueLimit{120};
+// Buffered response bodies beyond this abort the transfer
+const size_t kMaxResponseBytes = 32 * 1024 * 1024;
+// Bytes fetch_text reads at most, however little text they hold
+const size_t kMaxTextFetchBytes = 8 * 1024 * 1024;
+// Main-content selection needs the page around the article too, so it
+// extracts this many times the text it returns before stopping
+const size_t kMainContentReadFactor = 4;
 
 // Callback function for writing response data
 static size_t WriteCallback(void *contents, size_t size, size_t nmemb,
                             void *userp) {
   size_t real_size = size * nmemb;
   std::string *response = static_cast<std::string *>(userp);
+  if (response->size() + real_size > kMaxResponseBytes) {
+    return 0; // Servers that sent no Content-Length get cut off here
+  }
   // Reserve space to avoid frequent reallocations
   if (response->capacity() < response->size() + real_size) {
     response->reserve(response->size() + real_size + 4096);
@@ -33,7 +57,187 @@ static size_t HeaderCallback(char *buffer, size_t size, size_t nitems,
   return real_size;
 }
 
+// Callback function forwarding response data to a StreamCallback
+static size_t StreamWriteCallback(void *contents, size_t size, size_t nmemb,
+                                  void *userp) {
+  size_t real_size = size * nmemb;
+  const auto *on_chunk = static_cast<const Services::StreamCallback *>(userp);
+  try {
+    (*on_chunk)(std::string_view(static_cast<char *>(contents), real_size));
+  } catch (...) {
+    return 0; // Abort the transfer rather than unwind through libcurl
+  }
+  return real_size;
+}
+
+// Where a streamed GET's chunks go, and when the download stops
+struct CappedStream {
+  CURL *curl;
+  const Services::StreamCallback *on_chunk;
+  const bool *enough;       // Set by the consumer through on_chunk
+  std::string *content_type;
+  std::size_t remaining;    // Bytes left under the cap
+  bool stopped{false};
+};
+
+// Callback function forwarding response data up to a cap, then aborting
+static size_t CappedStreamWriteCallback(void *contents, size_t size,
+                                        size_t nmemb, void *userp) {
+  size_t real_size = size * nmemb;
+  auto *stream = static_cast<CappedStream *>(userp);
+  if (stream->content_type->empty()) {
+    char *content_type = nullptr;
+    curl_easy_getinfo(stream->curl, CURLINFO_CONTENT_TYPE, &content_type);
+    *stream->content_type = content_type ? content_type : "";
+  }
+  size_t accepted = std::min(real_size, stream->remaining);
+  try {
+    (*stream->on_chunk)(
+        std::string_view(static_cast<char *>(contents), accepted));
+  } catch (...) {
+    return 0;
+  }
+  stream->remaining -= accepted;
+  if (*stream->enough || stream->remaining == 0) {
+    stream->stopped = true;
+    return 0; // Ends the transfer with CURLE_WRITE_ERROR
+  }
+  return real_size;
+}
+
+// Callback function serializing a JsonRope into libcurl's upload buffer
+static size_t RopeReadCallback(char *buffer, size_t size, size_t nitems,
+                               void *userdata) {
+  auto *body = static_cast<Utils::JsonRope *>(userdata);
+  return body->read(buffer, size * nitems);
+}
+
+// Callback function letting libcurl restart an upload (redirects, auth)
+static int RopeSeekCallback(void *userdata, curl_off_t offset, int origin) {
+  if (offset != 0 || origin != SEEK_SET) {
+    return CURL_SEEKFUNC_CANTSEEK;
+  }
+  static_cast<Utils::JsonRope *>(userdata)->rewind();
+  return CURL_SEEKFUNC_OK;
+}
+
+// Callback function aborting a transfer once its cancel flag is raised
+static int CancelProgressCallback(void *clientp, curl_off_t, curl_off_t,
+                                  curl_off_t, curl_off_t) {
+  return static_cast<const std::atomic<bool> *>(clientp)->load() ? 1 : 0;
+}
+
+// Locks guarding the shared connection pool across threads
+static std::mutex share_locks[CURL_LOCK_DATA_LAST];
+
+static void ShareLockCallback(CURL *, curl_lock_data data, curl_lock_access,
+                              void *) {
+  share_locks[data].lock();
+}
+
+static void ShareUnlockCallback(CURL *, curl_lock_data data, void *) {
+  share_locks[data].unlock();
+}
+
+// DNS cache, open connections and TLS sessions shared by chat requests, so a
+// connection opened by warm_up() is picked up by the first real request
+static CURLSH *get_connection_pool() {
+  static CURLSH *share = [] {
+    CURLSH *handle = curl_share_init();
+    if (handle) {
+      curl_share_setopt(handle, CURLSHOPT_LOCKFUNC, ShareLockCallback);
+      curl_share_setopt(handle, CURLSHOPT_UNLOCKFUNC, ShareUnlockCallback);
+      curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+      curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+      curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+    return handle;
+  }();
+  return share;
+}
+
+// Splits a raw header block into `headers`; later values win, so after
+// redirects the final response's headers are the ones kept
+static void parse_headers(const std::string &raw, HeaderMap &headers) {
+  std::istringstream header_stream(raw);
+  std::string header_line;
+  while (std::getline(header_stream, header_line)) {
+    size_t colon_pos = header_line.find(':');
+    if (colon_pos != std::string::npos) {
+      std::string key = header_line.substr(0, colon_pos);
+      std::string value = header_line.substr(colon_pos + 1);
+      key.erase(0, key.find_first_not_of(" \t"));
+      key.erase(key.find_last_not_of(" \t") + 1);
+      value.erase(0, value.find_first_not_of(" \t"));
+      value.erase(value.find_last_not_of(" \t\r") + 1);
+      headers[key] = value;
+    }
+  }
+}
+
 namespace Services {
+void WebService::initialize_connection_pool() {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  get_connection_pool();
+}
+
+WebResponse WebService::warm_up(const std::string &url,
+                                const std::string &json_body,
+                                const std::atomic<bool> &cancelled) {
+  if (HttpCassette::is_replaying()) {
+    return {200, "", "", {}, true, ""}; // Nothing to connect to
+  }
+
+  WebResponse response;
+  response.status_code = 0;
+  response.success = false;
+
+  CURL *curl = curl_easy_init();
+  if (!curl) {
+    response.error_message = "Failed to initialize cURL";
+    return response;
+  }
+
+  struct curl_slist *header_list = nullptr;
+  std::string discarded;
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_SHARE, get_connection_pool());
+  if (json_body.empty()) {
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+  } else {
+    header_list =
+        curl_slist_append(header_list, "Content-Type: application/json");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_body.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                     static_cast<curl_off_t>(json_body.size()));
+  }
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &discarded);
+  curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+  curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, CancelProgressCallback);
+  curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &cancelled);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, "Llamaware-Agent/1.0");
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, kDefaultTimeoutSeconds);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+  CURLcode res = curl_easy_perform(curl);
+
+  long http_code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  response.status_code = static_cast<int>(http_code);
+  // Any HTTP answer means the connection is established and pooled
+  response.success = (res == CURLE_OK);
+  if (res != CURLE_OK) {
+    response.error_message =
+        "cURL error: " + std::string(curl_easy_strerror(res));
+  }
+
+  curl_slist_free_all(header_list);
+  curl_easy_cleanup(curl);
+  return response;
+}
+
 std::string WebService::get_api_key() {
   return Utils::Config::get_env_var("SERPAPI_KEY");
 }
@@ -66,39 +270,21 @@ std::string WebService::search(const std::string &query) {
     std::string search_url = "https://api.duckduckgo.com/?q=" + encoded_query +
                              "&api_key=" + api_key;
 
-    std::string response_str;
-    std::string response_headers;
-
-    CURL *search_curl = curl_easy_init();
-    if (search_curl) {
-      curl_easy_setopt(search_curl, CURLOPT_URL, search_url.c_str());
-      curl_easy_setopt(search_curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-      curl_easy_setopt(search_curl, CURLOPT_WRITEDATA, &response_str);
-      curl_easy_setopt(search_curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
-      curl_easy_setopt(search_curl, CURLOPT_HEADERDATA, &response_headers);
-      curl_easy_setopt(search_curl, CURLOPT_TIMEOUT, 5L); // 5s timeout
-      curl_easy_setopt(search_curl, CURLOPT_USERAGENT, "Llamaware-Agent/1.0");
-
-      CURLcode res = curl_easy_perform(search_curl);
-      if (res != CURLE_OK) {
-        std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res)
-                  << std::endl;
-        return "Error: Failed to perform web search";
-      }
-
-      long http_code = 0;
-      curl_easy_getinfo(search_curl, CURLINFO_RESPONSE_CODE, &http_code);
-      if (http_code != 200) {
-        std::cerr << "HTTP request failed with code: " << http_code
-                  << std::endl;
-        return "Error: Failed to perform web search (HTTP " +
-               std::to_string(http_code) + ")";
-      }
-
-      curl_easy_cleanup(search_curl);
-    } else {
-      return "Error: Failed to initialize cURL";
+    // Through fetch_with_headers so searches are retried, rate limited
+    // and recorded like every other request
+    WebResponse response = fetch_with_headers(search_url, {});
+    if (response.status_code == 0) {
+      std::cerr << "Web search failed: " << response.error_message
+                << std::endl;
+      return "Error: Failed to perform web search";
     }
+    if (response.status_code != 200) {
+      std::cerr << "HTTP request failed with code: " << response.status_code
+                << std::endl;
+      return "Error: Failed to perform web search (HTTP " +
+             std::to_string(response.status_code) + ")";
+    }
+    const std::string &response_str = response.content;
 
     // Parse JSON response
     try {
@@ -148,86 +334,75 @@ bool WebService::is_valid_url(const std::string &url) {
   return false;
 }
 
-std::string WebService::extract_text_content(const std::string &html) {
-  std::string text = html;
+std::string WebService::get_host(const std::string &url) {
+  std::size_t start = url.find("://");
+  start = start == std::string::npos ? 0 : start + 3;
+  std::size_t end = url.find_first_of("/?#", start);
+  std::string authority = url.substr(
+      start, end == std::string::npos ? std::string::npos : end - start);
+  std::size_t at = authority.rfind('@'); // Drop user:password@
+  return at == std::string::npos ? authority : authority.substr(at + 1);
+}
 
-  // Remove script and style tags and their content
-  size_t pos = 0;
-  while ((pos = text.find("<script", pos)) != std::string::npos) {
-    size_t end = text.find("</script>", pos);
-    if (end != std::string::npos) {
-      text.erase(pos, end - pos + 9);
-    } else {
-      break;
-    }
-  }
+std::map<std::string, std::shared_future<WebResponse>> WebService::in_flight;
+std::mutex WebService::in_flight_mutex;
 
-  pos = 0;
-  while ((pos = text.find("<style", pos)) != std::string::npos) {
-    size_t end = text.find("</style>", pos);
-    if (end != std::string::npos) {
-      text.erase(pos, end - pos + 8);
-    } else {
-      break;
-    }
+std::string WebService::request_key(std::string_view variant,
+                                    const std::string &url,
+                                    const HeaderMap &headers) {
+  std::string key = std::string(variant) + " GET " + url;
+  for (const auto &[name, value] : headers) {
+    key += "\n" + name + ": " + value;
   }
+  return key;
+}
 
-  // Remove HTML tags
-  pos = 0;
-  while ((pos = text.find('<', pos)) != std::string::npos) {
-    size_t end = text.find('>', pos);
-    if (end != std::string::npos) {
-      text.erase(pos, end - pos + 1);
-    } else {
-      break;
+WebResponse WebService::single_flight(
+    const std::string &key, const std::function<WebResponse()> &perform) {
+  std::promise<WebResponse> promise;
+  {
+    std::unique_lock<std::mutex> lock(in_flight_mutex);
+    auto it = in_flight.find(key);
+    if (it != in_flight.end()) {
+      std::shared_future<WebResponse> pending = it->second;
+      lock.unlock();
+      return pending.get();
     }
+    in_flight.emplace(key, promise.get_future().share());
   }
 
-  return sanitize_content(text);
-}
-
-std::string WebService::sanitize_content(const std::string &content) {
-  std::string sanitized = content;
-
-  // Replace HTML entities
-  size_t pos = 0;
-  while ((pos = sanitized.find("&amp;", pos)) != std::string::npos) {
-    sanitized.replace(pos, 5, "&");
-    pos += 1;
-  }
-  while ((pos = sanitized.find("&lt;", pos)) != std::string::npos) {
-    sanitized.replace(pos, 4, "<");
-    pos += 1;
-  }
-  while ((pos = sanitized.find("&gt;", pos)) != std::string::npos) {
-    sanitized.replace(pos, 4, ">");
-    pos += 1;
-  }
-  while ((pos = sanitized.find("&quot;", pos)) != std::string::npos) {
-    sanitized.replace(pos, 6, "\"");
-    pos += 1;
-  }
-  while ((pos = sanitized.find("&#39;", pos)) != std::string::npos) {
-    sanitized.replace(pos, 5, "'");
-    pos += 1;
+  WebResponse response;
+  try {
+    response = perform();
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(in_flight_mutex);
+      in_flight.erase(key);
+    }
+    promise.set_exception(std::current_exception());
+    throw;
   }
-
-  // Clean up whitespace
-  pos = 0;
-  while ((pos = sanitized.find("\n\n\n", pos)) != std::string::npos) {
-    sanitized.replace(pos, 3, "\n\n");
+  // Unregister first: later callers start a new transfer instead of
+  // getting this response once it may be outdated
+  {
+    std::lock_guard<std::mutex> lock(in_flight_mutex);
+    in_flight.erase(key);
   }
-
-  // Trim leading/trailing whitespace
-  size_t start = sanitized.find_first_not_of(" \t\n\r");
-  if (start == std::string::npos)
-    return "";
-
-  size_t end = sanitized.find_last_not_of(" \t\n\r");
-  return sanitized.substr(start, end - start + 1);
+  promise.set_value(response);
+  return response;
 }
 
 WebResponse WebService::fetch_url(const std::string &url) {
+  return single_flight(request_key("fetch_url", url, {}), [&] {
+    return HttpCache::fetch(url, {}, [&](const HeaderMap &headers) {
+      return HttpCassette::exchange(
+          "GET", url, "", [&] { return fetch_url_live(url, headers); });
+    });
+  });
+}
+
+WebResponse WebService::fetch_url_live(const std::string &url,
+                                       const HeaderMap &headers) {
   WebResponse response;
   response.success = false;
 
@@ -237,24 +412,36 @@ WebResponse WebService::fetch_url(const std::string &url) {
     return response;
   }
 
+  if (auto refused = RateLimiter::acquire(url, headers)) {
+    return *refused;
+  }
   CURL *curl = curl_easy_init();
   if (!curl) {
     response.error_message = "Failed to initialize cURL";
     return response;
   }
 
+  struct curl_slist *header_list = nullptr;
   try {
     std::string response_body;
     std::string response_headers;
     long http_code = 0;
 
+    for (const auto &[key, value] : headers) {
+      std::string header = key + ": " + value;
+      header_list = curl_slist_append(header_list, header.c_str());
+    }
+
     // Set up curl options
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "Llamaware-Agent/1.0");
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L); // 10s timeout
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_body);
+    curl_easy_setopt(curl, CURLOPT_MAXFILESIZE_LARGE,
+                     static_cast<curl_off_t>(kMaxResponseBytes));
     curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
     curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response_headers);
 
@@ -265,6 +452,7 @@ WebResponse WebService::fetch_url(const std::string &url) {
       response.error_message =
           "cURL error: " + std::string(curl_easy_strerror(res));
       curl_easy_cleanup(curl);
+      curl_slist_free_all(header_list);
       return response;
     }
 
@@ -331,35 +519,375 @@ WebResponse WebService::fetch_url(const std::string &url) {
     response.success = false;
   }
 
+  curl_slist_free_all(header_list);
   return response;
 }
 
-std::string WebService::fetch_text(const std::string &url) {
-  WebResponse response = fetch_url(url);
+WebResponse WebService::fetch_url_stream(const std::string &url,
+                                         const FetchCallback &on_chunk,
+                                         std::size_t max_bytes,
+                                         const HeaderMap &headers) {
+  bool enough = false;
+  std::string content_type;
+  std::string body; // Kept for the cache in case it is read to the end
+  StreamCallback forward = [&](std::string_view chunk) {
+    if (!enough) {
+      body.append(chunk);
+      enough = !on_chunk(chunk, content_type);
+    }
+  };
+  WebResponse response;
+  if (!HttpCassette::active()) {
+    response = fetch_url_stream_live(url, headers, forward, enough, max_bytes,
+                                     content_type);
+  } else {
+    // Replayed chunks stop reaching `on_chunk` once it has enough
+    response = HttpCassette::exchange_stream(
+        "GET", url, "", forward, [&](const StreamCallback &callback) {
+          return fetch_url_stream_live(url, headers, callback, enough,
+                                       max_bytes, content_type);
+        });
+  }
+  response.partial = response.partial || enough;
+  if (!response.partial) {
+    response.content = std::move(body);
+  }
+  return response;
+}
+
+WebResponse WebService::fetch_url_stream_live(const std::string &url,
+                                              const HeaderMap &headers,
+                                              const StreamCallback &on_chunk,
+                                              const bool &enough,
+                                              std::size_t max_bytes,
+                                              std::string &content_type) {
+  WebResponse response;
+  response.status_code = 0;
+  response.success = false;
+
+  if (!is_valid_url(url)) {
+    response.error_message = "Invalid URL format";
+    return response;
+  }
 
+  if (auto refused = RateLimiter::acquire(url, headers)) {
+    return *refused;
+  }
+  CURL *curl = curl_easy_init();
+  if (!curl) {
+    response.error_message = "Failed to initialize cURL";
+    return response;
+  }
+
+  struct curl_slist *header_list = nullptr;
+  for (const auto &[key, value] : headers) {
+    std::string header = key + ": " + value;
+    header_list = curl_slist_append(header_list, header.c_str());
+  }
+  std::string response_headers;
+  CappedStream stream{curl, &on_chunk, &enough, &content_type, max_bytes};
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+  curl_easy_setopt(curl, CURLOPT_SHARE, get_connection_pool());
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, "Llamaware-Agent/1.0");
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CappedStreamWriteCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &stream);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response_headers);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+  CURLcode res = curl_easy_perform(curl);
+  if (res == CURLE_WRITE_ERROR && stream.stopped) {
+    res = CURLE_OK; // We hung up, not the server
+  }
+
+  long http_code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  char *type = nullptr;
+  curl_easy_getinfo(curl, CURLINFO_CONTENT_TYPE, &type);
+
+  response.status_code = static_cast<int>(http_code);
+  response.content_type = type ? type : "";
+  response.success = (res == CURLE_OK && http_code >= 200 && http_code < 300);
+  if (res != CURLE_OK) {
+    response.error_message =
+        "cURL error: " + std::string(curl_easy_strerror(res));
+  } else if (!response.success) {
+    response.error_message = "HTTP " + std::to_string(http_code);
+  }
+  response.partial = stream.stopped;
+  curl_easy_cleanup(curl);
+  curl_slist_free_all(header_list);
+
+  parse_headers(response_headers, response.headers);
+  return response;
+}
+
+static std::string truncate_text(std::string text, std::size_t max_length) {
+  if (text.length() > max_length) {
+    text = text.substr(0, max_length) +
+           "\n\n[Content truncated - showing first " +
+           std::to_string(max_length) + " characters]";
+  }
+  return text;
+}
+
+// A missing Content-Type is decided from the first bytes, as browsers do
+static bool is_html(const std::string &content_type, std::string_view body) {
+  if (!content_type.empty()) {
+    return content_type.find("html") != std::string::npos;
+  }
+  std::size_t start = body.find_first_not_of(" \t\r\n");
+  if (start == std::string_view::npos || body[start] != '<') {
+    return false;
+  }
+  std::string head(body.substr(start, 16));
+  std::transform(head.begin(), head.end(), head.begin(), ::tolower);
+  return head.rfind("<!doctype html", 0) == 0 || head.rfind("<html", 0) == 0 ||
+         head.rfind("<head", 0) == 0 || head.rfind("<body", 0) == 0 ||
+         head.rfind("<!--", 0) == 0;
+}
+
+// Readable text of `url`, carried as the content of a successful response
+// so that callers sharing a single-flight transfer get it too
+static WebResponse read_text(const std::string &url, std::size_t max_length,
+                             bool main_content_only) {
+  const std::size_t text_budget =
+      main_content_only ? max_length * kMainContentReadFactor : max_length;
+  enum class Kind : std::uint8_t { Unknown, Html, Plain };
+  // Built in place: the extractors keep pointers into themselves
+  struct Reader {
+    Kind kind{Kind::Unknown};
+    Utils::MainContentExtractor main_content;
+    Utils::HtmlTextExtractor full_text;
+    std::string plain;
+  };
+  std::optional<Reader> reader;
+
+  auto on_chunk = [&](std::string_view chunk,
+                      const std::string &content_type) {
+    if (reader->kind == Kind::Unknown) {
+      reader->kind = is_html(content_type, chunk) ? Kind::Html : Kind::Plain;
+    }
+    if (reader->kind == Kind::Plain) {
+      reader->plain.append(
+          chunk.substr(0, max_length + 1 - reader->plain.size()));
+      return reader->plain.size() <= max_length;
+    }
+    if (main_content_only) {
+      reader->main_content.feed(chunk);
+      return reader->main_content.emitted_chars() < text_budget;
+    }
+    reader->full_text.feed(chunk);
+    return reader->full_text.emitted_chars() < text_budget;
+  };
+
+  WebResponse response =
+      HttpCache::fetch(url, {}, [&](const HeaderMap &sent) {
+        return RetryScheduler::execute(url, [&] {
+          reader.emplace(); // A retried transfer starts the page over
+          return WebService::fetch_url_stream(url, on_chunk,
+                                              kMaxTextFetchBytes, sent);
+        });
+      });
+
+  if (response.from_cache) {
+    // Served from the cache, so nothing was streamed
+    response.content =
+        WebService::response_text(response, max_length, main_content_only);
+    return response;
+  }
+  if (!response.success) {
+    return response;
+  }
+  std::string text;
+  if (reader->kind == Kind::Plain) {
+    text = std::move(reader->plain);
+  } else if (main_content_only) {
+    reader->main_content.finish();
+    text = reader->main_content.text();
+  } else {
+    reader->full_text.finish();
+    text = reader->full_text.text();
+  }
+  response.content = truncate_text(std::move(text), max_length);
+  return response;
+}
+
+std::string WebService::fetch_text(const std::string &url,
+                                   std::size_t max_length,
+                                   bool main_content_only) {
+  const std::string variant = "fetch_text " + std::to_string(max_length) +
+                              (main_content_only ? " main" : " full");
+  WebResponse response = single_flight(request_key(variant, url, {}), [&] {
+    return read_text(url, max_length, main_content_only);
+  });
   if (!response.success) {
     return "Error fetching URL: " + response.error_message;
   }
+  return response.content;
+}
 
-  // Check if content is HTML and extract text
-  if (response.content_type.find("text/html") != std::string::npos) {
-    std::string extracted = extract_text_content(response.content);
-    if (extracted.length() > kMaxContentLength) {
-      extracted = extracted.substr(0, kMaxContentLength) +
-                  "\n\n[Content truncated - showing first " +
-                  std::to_string(kMaxContentLength) + " characters]";
+std::string WebService::response_text(const WebResponse &response,
+                                      std::size_t max_length,
+                                      bool main_content_only) {
+  if (!response.success) {
+    return "Error fetching URL: " + response.error_message;
+  }
+  std::string text;
+  if (!is_html(response.content_type, response.content)) {
+    text = response.content;
+  } else if (main_content_only) {
+    text = Utils::MainContentExtractor::extract(response.content);
+  } else {
+    text = Utils::HtmlTextExtractor::extract(response.content);
+  }
+  return truncate_text(std::move(text), max_length);
+}
+
+std::vector<WebResponse>
+WebService::fetch_many(const std::vector<std::string> &urls,
+                       const FetchManyOptions &options) {
+  std::vector<WebResponse> responses(urls.size());
+  for (auto &response : responses) {
+    response.status_code = 0;
+    response.success = false;
+  }
+  if (urls.empty()) {
+    return responses;
+  }
+
+  // Cassettes work per request; replay them side by side instead
+  if (HttpCassette::active()) {
+    std::vector<std::future<WebResponse>> pending;
+    for (const auto &url : urls) {
+      pending.push_back(
+          std::async(std::launch::async, [&url] { return fetch_url(url); }));
+    }
+    for (std::size_t i = 0; i < urls.size(); ++i) {
+      responses[i] = pending[i].get();
     }
-    return extracted;
+    return responses;
   }
 
-  // For plain text or other content types
-  if (response.content.length() > kMaxContentLength) {
-    return response.content.substr(0, kMaxContentLength) +
-           "\n\n[Content truncated - showing first " +
-           std::to_string(kMaxContentLength) + " characters]";
+  CURLM *multi = curl_multi_init();
+  if (!multi) {
+    for (auto &response : responses) {
+      response.error_message = "Failed to initialize cURL";
+    }
+    return responses;
+  }
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    static_cast<long>(options.max_per_host));
+  curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                    static_cast<long>(options.max_connections));
+
+  struct Transfer {
+    CURL *curl{nullptr};
+    std::string body;
+    std::string headers;
+    bool done{false};
+    CURLcode result{CURLE_OK};
+  };
+  std::vector<Transfer> transfers(urls.size());
+  const auto deadline = std::chrono::steady_clock::now() + options.deadline;
+
+  for (std::size_t i = 0; i < urls.size(); ++i) {
+    if (!is_valid_url(urls[i])) {
+      responses[i].error_message = "Invalid URL format";
+      continue;
+    }
+    if (auto refused = RateLimiter::acquire(urls[i], {})) {
+      responses[i] = *refused;
+      continue;
+    }
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+      responses[i].error_message = "Failed to initialize cURL";
+      continue;
+    }
+    Transfer &transfer = transfers[i];
+    transfer.curl = curl;
+    curl_easy_setopt(curl, CURLOPT_URL, urls[i].c_str());
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Llamaware-Agent/1.0");
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer.body);
+    curl_easy_setopt(curl, CURLOPT_MAXFILESIZE_LARGE,
+                     static_cast<curl_off_t>(kMaxResponseBytes));
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer.headers);
+    // "" offers every encoding this libcurl decodes (gzip, br, ...)
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    // Wait for an HTTP/2 connection to the host rather than open another;
+    // plain http:// stays on HTTP/1.1, where waiting would serialize
+    if (urls[i].rfind("https://", 0) == 0) {
+      curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    }
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS,
+                     static_cast<long>(options.deadline.count()));
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, &transfer);
+    curl_multi_add_handle(multi, curl);
   }
 
-  return response.content;
+  int running = 0;
+  while (true) {
+    curl_multi_perform(multi, &running);
+    int queued = 0;
+    while (CURLMsg *message = curl_multi_info_read(multi, &queued)) {
+      if (message->msg == CURLMSG_DONE) {
+        Transfer *transfer = nullptr;
+        curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transfer);
+        transfer->done = true;
+        transfer->result = message->data.result;
+      }
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (running == 0 || left.count() <= 0) {
+      break;
+    }
+    curl_multi_poll(multi, nullptr, 0,
+                    static_cast<int>(std::min<long long>(left.count(), 1000)),
+                    nullptr);
+  }
+
+  for (std::size_t i = 0; i < urls.size(); ++i) {
+    Transfer &transfer = transfers[i];
+    if (!transfer.curl) {
+      continue;
+    }
+    WebResponse &response = responses[i];
+    long http_code = 0;
+    curl_easy_getinfo(transfer.curl, CURLINFO_RESPONSE_CODE, &http_code);
+    char *content_type = nullptr;
+    curl_easy_getinfo(transfer.curl, CURLINFO_CONTENT_TYPE, &content_type);
+    response.status_code = static_cast<int>(http_code);
+    response.content_type = content_type ? content_type : "";
+
+    if (!transfer.done) {
+      response.error_message = "Deadline exceeded";
+    } else if (transfer.result != CURLE_OK) {
+      response.error_message =
+          "cURL error: " + std::string(curl_easy_strerror(transfer.result));
+    } else if (http_code < 200 || http_code >= 300) {
+      response.error_message = "HTTP " + std::to_string(http_code);
+    } else {
+      response.success = true;
+    }
+    response.content = std::move(transfer.body);
+    parse_headers(transfer.headers, response.headers);
+
+    curl_multi_remove_handle(multi, transfer.curl);
+    curl_easy_cleanup(transfer.curl);
+  }
+  curl_multi_cleanup(multi);
+  return responses;
 }
 
 std::string WebService::fetch_json(const std::string &url) {
@@ -387,6 +915,22 @@ std::string WebService::fetch_json(const std::string &url) {
 
 WebResponse WebService::fetch_with_headers(const std::string &url,
                                            const HeaderMap &headers) {
+  return single_flight(request_key("fetch_with_headers", url, headers), [&] {
+    return HttpCache::fetch(url, headers, [&](const HeaderMap &sent) {
+      return RetryScheduler::execute(url, [&] {
+        return HttpCassette::exchange("GET", url, "", [&] {
+          return fetch_with_headers_once(url, sent);
+        });
+      });
+    });
+  });
+}
+
+WebResponse WebService::fetch_with_headers_once(const std::string &url,
+                                                const HeaderMap &headers) {
+  if (auto refused = RateLimiter::acquire(url, headers)) {
+    return *refused;
+  }
   CURL *curl = curl_easy_init();
   WebResponse response;
 
@@ -469,6 +1013,21 @@ WebResponse WebService::fetch_with_headers(const std::string &url,
 WebResponse WebService::post_json(const std::string &url,
                                   const std::string &json_body,
                                   const HeaderMap &headers) {
+  return RetryScheduler::execute(url, [&] {
+    return HttpCassette::exchange("POST", url, json_body, [&] {
+      return post_json_once(url, json_body, headers);
+    });
+  });
+}
+
+WebResponse WebService::post_json_once(const std::string &url,
+                                       const std::string &json_body,
+                                       const HeaderMap &headers) {
+  if (auto refused = RateLimiter::acquire(
+          url, headers, RateLimiter::estimate_tokens(json_body.size()),
+          kChatQueueLimit)) {
+    return *refused;
+  }
   WebResponse response;
   response.success = false;
 
@@ -520,4 +1079,100 @@ WebResponse WebService::post_json(const std::string &url,
 
   return response;
 }
+
+WebResponse WebService::post_json_stream(const std::string &url,
+                                         Utils::JsonRope &body,
+                                         const HeaderMap &headers,
+                                         const StreamCallback &on_chunk) {
+  if (!HttpCassette::active()) {
+    return post_json_stream_live(url, body, headers, on_chunk);
+  }
+  return HttpCassette::exchange_stream(
+      "POST", url, body.to_string(), on_chunk,
+      [&](const StreamCallback &callback) {
+        return post_json_stream_live(url, body, headers, callback);
+      });
+}
+
+WebResponse WebService::post_json_stream_live(const std::string &url,
+                                              Utils::JsonRope &body,
+                                              const HeaderMap &headers,
+                                              const StreamCallback &on_chunk) {
+  const std::size_t body_size = body.size();
+  if (auto refused = RateLimiter::acquire(
+          url, headers, RateLimiter::estimate_tokens(body_size),
+          kChatQueueLimit)) {
+    return *refused;
+  }
+
+  WebResponse response;
+  response.status_code = 0;
+  response.success = false;
+
+  CURL *curl = curl_easy_init();
+  if (!curl) {
+    response.error_message = "Failed to initialize cURL";
+    return response;
+  }
+
+  std::string response_headers;
+  struct curl_slist *header_list = nullptr;
+  for (const auto &[key, value] : headers) {
+    std::string header = key + ": " + value;
+    header_list = curl_slist_append(header_list, header.c_str());
+  }
+  if (headers.find("Content-Type") == headers.end()) {
+    header_list =
+        curl_slist_append(header_list, "Content-Type: application/json");
+  }
+  // Large uploads would otherwise stall on "Expect: 100-continue"
+  header_list = curl_slist_append(header_list, "Expect:");
+
+  // The body is serialized straight into libcurl's upload buffer; its size is
+  // computed up front so the request carries Content-Length, not chunking.
+  body.rewind();
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_SHARE, get_connection_pool());
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+  curl_easy_setopt(curl, CURLOPT_POST, 1L);
+  curl_easy_setopt(curl, CURLOPT_READFUNCTION, RopeReadCallback);
+  curl_easy_setopt(curl, CURLOPT_READDATA, &body);
+  curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, RopeSeekCallback);
+  curl_easy_setopt(curl, CURLOPT_SEEKDATA, &body);
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                   static_cast<curl_off_t>(body_size));
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamWriteCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &on_chunk);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response_headers);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, "Llamaware-Agent/1.0");
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, kDefaultTimeoutSeconds);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, kStreamStallSeconds);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+  CURLcode res = curl_easy_perform(curl);
+
+  long http_code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  char *content_type = nullptr;
+  curl_easy_getinfo(curl, CURLINFO_CONTENT_TYPE, &content_type);
+
+  response.status_code = static_cast<int>(http_code);
+  response.content_type = content_type ? content_type : "";
+  response.success = (res == CURLE_OK && http_code >= 200 && http_code < 300);
+
+  if (res != CURLE_OK) {
+    response.error_message =
+        "cURL error: " + std::string(curl_easy_strerror(res));
+  } else if (!response.success) {
+    response.error_message = "HTTP " + std::to_string(http_code);
+  }
+
+  curl_slist_free_all(header_list);
+  curl_easy_cleanup(curl);
+
+  parse_headers(response_headers, response.headers);
+  return response;
+}
 } // namespace Services
@@ -0,0 +1,167 @@
+#include "utils/aho_corasick.h"
+#include <bit>
+#include <deque>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LLAMAWARE_AHO_CORASICK_SSE2 1
+#endif
+
+namespace Utils {
+
+// Most bytes the SSE2 skip compares against at once
+static constexpr std::size_t kMaxStartBytes = 8;
+static constexpr std::uint32_t kMissing = static_cast<std::uint32_t>(-1);
+
+static unsigned char lower(unsigned char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+}
+
+static bool is_word(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+// Regex \b at `position`: a word byte on exactly one side of it
+static bool is_boundary(std::string_view text, std::size_t position) {
+  bool before = position > 0 &&
+                is_word(static_cast<unsigned char>(text[position - 1]));
+  bool after = position < text.size() &&
+               is_word(static_cast<unsigned char>(text[position]));
+  return before != after;
+}
+
+AhoCorasick::AhoCorasick(const std::vector<std::string> &patterns,
+                         bool case_sensitive, bool whole_words)
+    : whole_words_(whole_words) {
+  auto fold = [case_sensitive](char c) {
+    auto byte = static_cast<unsigned char>(c);
+    return case_sensitive ? byte : lower(byte);
+  };
+  for (const auto &pattern : patterns) {
+    for (char c : pattern) {
+      unsigned char byte = fold(c);
+      if (classes_[byte] == 0) {
+        classes_[byte] = static_cast<std::uint8_t>(class_count_++);
+      }
+    }
+  }
+  if (!case_sensitive) {
+    for (int c = 'A'; c <= 'Z'; ++c) {
+      classes_[c] = classes_[lower(static_cast<unsigned char>(c))];
+    }
+  }
+
+  // Trie of the patterns
+  auto add_state = [this] {
+    transitions_.resize(transitions_.size() + class_count_, kMissing);
+    output_.push_back(-1);
+    dictionary_link_.push_back(0);
+    return static_cast<std::uint32_t>(output_.size() - 1);
+  };
+  add_state();
+  lengths_.resize(patterns.size(), 0);
+  for (std::size_t index = 0; index < patterns.size(); ++index) {
+    const std::string &pattern = patterns[index];
+    if (pattern.empty()) {
+      continue;
+    }
+    std::uint32_t state = 0;
+    for (char c : pattern) {
+      std::size_t slot = state * class_count_ + classes_[fold(c)];
+      if (transitions_[slot] == kMissing) {
+        std::uint32_t next = add_state();
+        transitions_[slot] = next;
+      }
+      state = transitions_[slot];
+    }
+    if (output_[state] < 0) {
+      output_[state] = static_cast<std::int32_t>(index);
+    }
+    lengths_[index] = pattern.size();
+  }
+
+  // Breadth-first, turn the trie into a full automaton: missing edges take
+  // the edge of the longest proper suffix that is also a trie state
+  std::vector<std::uint32_t> failure(output_.size(), 0);
+  std::deque<std::uint32_t> queue{0};
+  while (!queue.empty()) {
+    std::uint32_t state = queue.front();
+    queue.pop_front();
+    for (std::size_t c = 0; c < class_count_; ++c) {
+      std::uint32_t &next = transitions_[state * class_count_ + c];
+      std::uint32_t fallback =
+          state == 0 ? 0 : transitions_[failure[state] * class_count_ + c];
+      if (next == kMissing) {
+        next = fallback;
+        continue;
+      }
+      failure[next] = fallback;
+      dictionary_link_[next] = output_[fallback] >= 0
+                                   ? fallback
+                                   : dictionary_link_[fallback];
+      queue.push_back(next);
+    }
+  }
+
+  for (int c = 0; c < 256; ++c) {
+    if (transitions_[classes_[c]] != 0) {
+      start_bytes_.push_back(static_cast<char>(c));
+    }
+  }
+  if (start_bytes_.size() > kMaxStartBytes) {
+    start_bytes_.clear(); // Too many to be worth skipping for
+  }
+}
+
+std::size_t AhoCorasick::skip_to_start(std::string_view text,
+                                       std::size_t from) const {
+#ifdef LLAMAWARE_AHO_CORASICK_SSE2
+  __m128i wanted[kMaxStartBytes];
+  for (std::size_t i = 0; i < start_bytes_.size(); ++i) {
+    wanted[i] = _mm_set1_epi8(start_bytes_[i]);
+  }
+  for (; from + 16 <= text.size(); from += 16) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + from));
+    __m128i hits = _mm_setzero_si128();
+    for (std::size_t i = 0; i < start_bytes_.size(); ++i) {
+      hits = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, wanted[i]));
+    }
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+    if (mask != 0) {
+      return from + static_cast<std::size_t>(std::countr_zero(mask));
+    }
+  }
+#endif
+  return from; // The byte loop takes it from here
+}
+
+AhoCorasick::Match AhoCorasick::find(std::string_view text,
+                                     std::size_t from) const {
+  std::uint32_t state = 0;
+  for (std::size_t i = from; i < text.size(); ++i) {
+    if (state == 0 && !start_bytes_.empty()) {
+      i = skip_to_start(text, i);
+      if (i == text.size()) {
+        break;
+      }
+    }
+    auto byte = static_cast<unsigned char>(text[i]);
+    state = transitions_[state * class_count_ + classes_[byte]];
+
+    std::uint32_t candidate =
+        output_[state] >= 0 ? state : dictionary_link_[state];
+    for (; candidate != 0; candidate = dictionary_link_[candidate]) {
+      auto pattern = static_cast<std::size_t>(output_[candidate]);
+      std::size_t start = i + 1 - lengths_[pattern];
+      if (!whole_words_ ||
+          (is_boundary(text, start) && is_boundary(text, i + 1))) {
+        return {start, lengths_[pattern], pattern};
+      }
+    }
+  }
+  return {npos, 0, 0};
+}
+
+} // namespace Utils
@@ -0,0 +1,313 @@
+#include "utils/atomic_file.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace Utils {
+
+// Attempts at a temporary name nobody else has taken
+static constexpr int kMaxNameAttempts = 100;
+
+static std::atomic<unsigned> temp_counter{0};
+
+// `.name.<pid>-<n>.tmp` next to `target`
+static std::string temp_name(const std::filesystem::path &target,
+                             unsigned long pid) {
+  std::string name = "." + target.filename().string() + "." +
+                     std::to_string(pid) + "-" +
+                     std::to_string(temp_counter++) + ".tmp";
+  return (target.parent_path() / name).string();
+}
+
+// The file a symlink points to, so that it is replaced rather than the link
+static std::string resolve_target(const std::string &target) {
+  std::error_code error;
+  if (std::filesystem::is_symlink(target, error)) {
+    auto resolved = std::filesystem::canonical(target, error);
+    if (!error) {
+      return resolved.string();
+    }
+  }
+  return target;
+}
+
+AtomicFile::~AtomicFile() { discard(); }
+
+AtomicFile::AtomicFile(AtomicFile &&other) noexcept {
+  *this = std::move(other);
+}
+
+AtomicFile &AtomicFile::operator=(AtomicFile &&other) noexcept {
+  if (this != &other) {
+    discard();
+    target_ = std::move(other.target_);
+    temp_path_ = std::exchange(other.temp_path_, {});
+    error_ = std::move(other.error_);
+    synced_ = std::exchange(other.synced_, false);
+#ifdef _WIN32
+    handle_ = std::exchange(other.handle_, nullptr);
+#else
+    fd_ = std::exchange(other.fd_, -1);
+#endif
+  }
+  return *this;
+}
+
+bool AtomicFile::write(std::string_view data) {
+  return write(std::vector<std::string_view>{data});
+}
+
+#ifdef _WIN32
+
+bool AtomicFile::fail(const std::string &what) {
+  error_ = what + " '" + target_ + "': " +
+           std::system_category().message(static_cast<int>(GetLastError()));
+  discard();
+  return false;
+}
+
+bool AtomicFile::open(const std::string &target) {
+  discard();
+  error_.clear();
+  target_ = resolve_target(target);
+  for (int attempt = 0; attempt < kMaxNameAttempts; ++attempt) {
+    temp_path_ = temp_name(target_, GetCurrentProcessId());
+    HANDLE file = CreateFileA(temp_path_.c_str(), GENERIC_WRITE, 0, nullptr,
+                              CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+      handle_ = file;
+      return true;
+    }
+    if (GetLastError() != ERROR_FILE_EXISTS) {
+      temp_path_.clear();
+      return fail("Could not create a temporary file for");
+    }
+  }
+  temp_path_.clear();
+  return fail("Could not name a temporary file for");
+}
+
+bool AtomicFile::write(const std::vector<std::string_view> &spans) {
+  if (handle_ == nullptr) {
+    error_ = "Not open";
+    return false;
+  }
+  for (std::string_view span : spans) {
+    while (!span.empty()) {
+      DWORD chunk = static_cast<DWORD>(
+          std::min<std::size_t>(span.size(), 1u << 30));
+      DWORD written = 0;
+      if (!WriteFile(handle_, span.data(), chunk, &written, nullptr)) {
+        return fail("Could not write");
+      }
+      span.remove_prefix(written);
+    }
+  }
+  return true;
+}
+
+bool AtomicFile::sync() {
+  if (handle_ == nullptr) {
+    if (!synced_) {
+      error_ = "Not open";
+    }
+    return synced_;
+  }
+  if (!FlushFileBuffers(handle_)) {
+    return fail("Could not flush");
+  }
+  CloseHandle(handle_);
+  handle_ = nullptr;
+  synced_ = true;
+  return true;
+}
+
+bool AtomicFile::commit(bool /*flush_directory*/) {
+  if (!synced_ && !sync()) {
+    return false;
+  }
+  if (!MoveFileExA(temp_path_.c_str(), target_.c_str(),
+                   MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+    return fail("Could not replace");
+  }
+  temp_path_.clear();
+  synced_ = false;
+  return true;
+}
+
+void AtomicFile::flush_directory(const std::string & /*directory*/) {}
+
+void AtomicFile::discard() {
+  if (handle_ != nullptr) {
+    CloseHandle(handle_);
+    handle_ = nullptr;
+  }
+  if (!temp_path_.empty()) {
+    DeleteFileA(temp_path_.c_str());
+    temp_path_.clear();
+  }
+  synced_ = false;
+}
+
+#else
+
+// iovecs per writev call; IOV_MAX on Linux and macOS
+static constexpr int kMaxWriteBatch = 1024;
+
+bool AtomicFile::fail(const std::string &what) {
+  error_ =
+      what + " '" + target_ + "': " + std::system_category().message(errno);
+  discard();
+  return false;
+}
+
+bool AtomicFile::open(const std::string &target) {
+  discard();
+  error_.clear();
+  target_ = resolve_target(target);
+  for (int attempt = 0; attempt < kMaxNameAttempts; ++attempt) {
+    temp_path_ = temp_name(target_, static_cast<unsigned long>(getpid()));
+    fd_ = ::open(temp_path_.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                 0666);
+    if (fd_ >= 0) {
+      break;
+    }
+    if (errno != EEXIST) {
+      temp_path_.clear();
+      return fail("Could not create a temporary file for");
+    }
+  }
+  if (fd_ < 0) {
+    temp_path_.clear();
+    return fail("Could not name a temporary file for");
+  }
+  struct stat info;
+  if (::stat(target_.c_str(), &info) == 0) {
+    fchmod(fd_, info.st_mode & 07777);
+  }
+  return true;
+}
+
+bool AtomicFile::write(const std::vector<std::string_view> &spans) {
+  if (fd_ < 0) {
+    error_ = "Not open";
+    return false;
+  }
+  std::size_t index = 0;
+  std::size_t offset = 0; // Bytes of spans[index] already written
+  while (index < spans.size()) {
+    struct iovec batch[kMaxWriteBatch];
+    int count = 0;
+    for (std::size_t i = index; i < spans.size() && count < kMaxWriteBatch;
+         ++i) {
+      std::size_t skip = i == index ? offset : 0;
+      if (spans[i].size() > skip) {
+        batch[count].iov_base = const_cast<char *>(spans[i].data() + skip);
+        batch[count].iov_len = spans[i].size() - skip;
+        ++count;
+      }
+    }
+    if (count == 0) {
+      break;
+    }
+    ssize_t written = ::writev(fd_, batch, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return fail("Could not write");
+    }
+    auto left = static_cast<std::size_t>(written);
+    while (index < spans.size() && left >= spans[index].size() - offset) {
+      left -= spans[index].size() - offset;
+      ++index;
+      offset = 0;
+    }
+    offset += left;
+  }
+  return true;
+}
+
+bool AtomicFile::sync() {
+  if (fd_ < 0) {
+    if (!synced_) {
+      error_ = "Not open";
+    }
+    return synced_;
+  }
+#ifdef __APPLE__
+  // fsync only reaches the drive's cache on macOS
+  int result = fcntl(fd_, F_FULLFSYNC);
+  if (result != 0) {
+    result = fsync(fd_);
+  }
+#else
+  int result = fdatasync(fd_);
+#endif
+  if (result != 0) {
+    return fail("Could not flush");
+  }
+  int closed = ::close(fd_);
+  fd_ = -1;
+  if (closed != 0) {
+    return fail("Could not close");
+  }
+  synced_ = true;
+  return true;
+}
+
+bool AtomicFile::commit(bool flush_directory) {
+  if (!synced_ && !sync()) {
+    return false;
+  }
+  if (std::rename(temp_path_.c_str(), target_.c_str()) != 0) {
+    return fail("Could not replace");
+  }
+  temp_path_.clear();
+  synced_ = false;
+
+  // The rename itself is only durable once the directory is flushed
+  if (flush_directory) {
+    AtomicFile::flush_directory(
+        std::filesystem::path(target_).parent_path().string());
+  }
+  return true;
+}
+
+void AtomicFile::flush_directory(const std::string &directory) {
+  int dir_fd = ::open(directory.empty() ? "." : directory.c_str(),
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    ::close(dir_fd);
+  }
+}
+
+void AtomicFile::discard() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  if (!temp_path_.empty()) {
+    ::unlink(temp_path_.c_str());
+    temp_path_.clear();
+  }
+  synced_ = false;
+}
+
+#endif
+
+} // namespace Utils
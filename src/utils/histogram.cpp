@@ -0,0 +1,88 @@
+#include "utils/histogram.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace Utils {
+
+std::size_t Histogram::bucket_index(std::uint64_t value) {
+  if (value < sub_bucket_count) {
+    return static_cast<std::size_t>(value);
+  }
+  // Drop low-order bits so the mantissa keeps `precision_bits` of precision
+  unsigned msb = static_cast<unsigned>(std::bit_width(value)) - 1;
+  unsigned shift = msb - (precision_bits - 1);
+  std::uint64_t mantissa = value >> shift;
+  return static_cast<std::size_t>(shift * half_bucket_count + mantissa);
+}
+
+std::uint64_t Histogram::bucket_midpoint(std::size_t index) {
+  if (index < sub_bucket_count) {
+    return index;
+  }
+  std::uint64_t shift = index / half_bucket_count - 1;
+  std::uint64_t mantissa = index - shift * half_bucket_count;
+  std::uint64_t low = mantissa << shift;
+  return low + ((1ULL << shift) >> 1);
+}
+
+void Histogram::record(double value) {
+  if (!std::isfinite(value) || value < 0.0) {
+    return;
+  }
+
+  auto scaled = static_cast<std::uint64_t>(std::llround(value * scale_));
+  std::size_t index = bucket_index(scaled);
+  if (index >= counts_.size()) {
+    counts_.resize(index + 1, 0);
+  }
+  counts_[index]++;
+
+  if (total_count_ == 0) {
+    min_ = max_ = scaled;
+  } else {
+    min_ = std::min(min_, scaled);
+    max_ = std::max(max_, scaled);
+  }
+  total_count_++;
+  sum_ += value;
+}
+
+void Histogram::reset() {
+  counts_.clear();
+  total_count_ = 0;
+  min_ = max_ = 0;
+  sum_ = 0.0;
+}
+
+double Histogram::min() const { return static_cast<double>(min_) / scale_; }
+
+double Histogram::max() const { return static_cast<double>(max_) / scale_; }
+
+double Histogram::mean() const {
+  return total_count_ == 0 ? 0.0 : sum_ / static_cast<double>(total_count_);
+}
+
+double Histogram::percentile(double p) const {
+  if (total_count_ == 0) {
+    return 0.0;
+  }
+
+  p = std::clamp(p, 0.0, 100.0);
+  auto target = static_cast<std::uint64_t>(
+      std::ceil(p / 100.0 * static_cast<double>(total_count_)));
+  target = std::max<std::uint64_t>(target, 1);
+
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < counts_.size(); ++i) {
+    seen += counts_[i];
+    if (seen >= target) {
+      // Clamp to the observed range so p0/p100 report exact extremes
+      std::uint64_t value = std::clamp(bucket_midpoint(i), min_, max_);
+      return static_cast<double>(value) / scale_;
+    }
+  }
+  return max();
+}
+
+} // namespace Utils
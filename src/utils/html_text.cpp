@@ -0,0 +1,765 @@
+#include "utils/html_text.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LLAMAWARE_HTML_SSE2 1
+#endif
+
+namespace Utils {
+
+// Longest reference body worth buffering ("thetasym", "#x10FFFF", ...)
+static constexpr std::size_t kMaxEntityLength = 32;
+// Tag text kept for parsing; the name always fits, long attributes do not
+static constexpr std::size_t kMaxTagLength = 512;
+static constexpr std::uint32_t kReplacementCharacter = 0xFFFD;
+
+// HTML 4 / XHTML named references plus a few common HTML5 additions,
+// sorted by name for binary search
+static constexpr std::pair<std::string_view, std::uint32_t> kNamedEntities[] = {
+    {"AElig", 0xC6}, {"Aacute", 0xC1}, {"Acirc", 0xC2}, {"Agrave", 0xC0},
+    {"Alpha", 0x391}, {"Aring", 0xC5}, {"Atilde", 0xC3}, {"Auml", 0xC4},
+    {"Beta", 0x392}, {"Ccedil", 0xC7}, {"Chi", 0x3A7}, {"Dagger", 0x2021},
+    {"Delta", 0x394}, {"ETH", 0xD0}, {"Eacute", 0xC9}, {"Ecirc", 0xCA},
+    {"Egrave", 0xC8}, {"Epsilon", 0x395}, {"Eta", 0x397}, {"Euml", 0xCB},
+    {"Gamma", 0x393}, {"Iacute", 0xCD}, {"Icirc", 0xCE}, {"Igrave", 0xCC},
+    {"Iota", 0x399}, {"Iuml", 0xCF}, {"Kappa", 0x39A}, {"Lambda", 0x39B},
+    {"Mu", 0x39C}, {"Ntilde", 0xD1}, {"Nu", 0x39D}, {"OElig", 0x152},
+    {"Oacute", 0xD3}, {"Ocirc", 0xD4}, {"Ograve", 0xD2}, {"Omega", 0x3A9},
+    {"Omicron", 0x39F}, {"Oslash", 0xD8}, {"Otilde", 0xD5}, {"Ouml", 0xD6},
+    {"Phi", 0x3A6}, {"Pi", 0x3A0}, {"Prime", 0x2033}, {"Psi", 0x3A8},
+    {"Rho", 0x3A1}, {"Scaron", 0x160}, {"Sigma", 0x3A3}, {"THORN", 0xDE},
+    {"Tau", 0x3A4}, {"Theta", 0x398}, {"Uacute", 0xDA}, {"Ucirc", 0xDB},
+    {"Ugrave", 0xD9}, {"Upsilon", 0x3A5}, {"Uuml", 0xDC}, {"Xi", 0x39E},
+    {"Yacute", 0xDD}, {"Yuml", 0x178}, {"Zeta", 0x396}, {"aacute", 0xE1},
+    {"acirc", 0xE2}, {"acute", 0xB4}, {"aelig", 0xE6}, {"agrave", 0xE0},
+    {"alefsym", 0x2135}, {"alpha", 0x3B1}, {"amp", 0x26}, {"and", 0x2227},
+    {"ang", 0x2220}, {"apos", 0x27}, {"aring", 0xE5}, {"asymp", 0x2248},
+    {"atilde", 0xE3}, {"auml", 0xE4}, {"bdquo", 0x201E}, {"beta", 0x3B2},
+    {"brvbar", 0xA6}, {"bull", 0x2022}, {"cap", 0x2229}, {"ccedil", 0xE7},
+    {"cedil", 0xB8}, {"cent", 0xA2}, {"check", 0x2713}, {"chi", 0x3C7},
+    {"circ", 0x2C6}, {"clubs", 0x2663}, {"colon", 0x3A}, {"comma", 0x2C},
+    {"cong", 0x2245}, {"copy", 0xA9}, {"crarr", 0x21B5}, {"cup", 0x222A},
+    {"curren", 0xA4}, {"dArr", 0x21D3}, {"dagger", 0x2020}, {"darr", 0x2193},
+    {"deg", 0xB0}, {"delta", 0x3B4}, {"diams", 0x2666}, {"divide", 0xF7},
+    {"dollar", 0x24}, {"eacute", 0xE9}, {"ecirc", 0xEA}, {"egrave", 0xE8},
+    {"empty", 0x2205}, {"emsp", 0x2003}, {"ensp", 0x2002}, {"epsilon", 0x3B5},
+    {"equals", 0x3D}, {"equiv", 0x2261}, {"eta", 0x3B7}, {"eth", 0xF0},
+    {"euml", 0xEB}, {"euro", 0x20AC}, {"excl", 0x21}, {"exist", 0x2203},
+    {"fnof", 0x192}, {"forall", 0x2200}, {"frac12", 0xBD}, {"frac14", 0xBC},
+    {"frac34", 0xBE}, {"frasl", 0x2044}, {"gamma", 0x3B3}, {"ge", 0x2265},
+    {"grave", 0x60}, {"gt", 0x3E}, {"hArr", 0x21D4}, {"harr", 0x2194},
+    {"hearts", 0x2665}, {"hellip", 0x2026}, {"hyphen", 0x2010},
+    {"iacute", 0xED}, {"icirc", 0xEE}, {"iexcl", 0xA1}, {"igrave", 0xEC},
+    {"image", 0x2111}, {"infin", 0x221E}, {"int", 0x222B}, {"iota", 0x3B9},
+    {"iquest", 0xBF}, {"isin", 0x2208}, {"iuml", 0xEF}, {"kappa", 0x3BA},
+    {"lArr", 0x21D0}, {"lambda", 0x3BB}, {"lang", 0x27E8}, {"laquo", 0xAB},
+    {"larr", 0x2190}, {"lbrace", 0x7B}, {"lbrack", 0x5B}, {"lceil", 0x2308},
+    {"ldquo", 0x201C}, {"le", 0x2264}, {"lfloor", 0x230A}, {"lowast", 0x2217},
+    {"loz", 0x25CA}, {"lpar", 0x28}, {"lrm", 0x200E}, {"lsaquo", 0x2039},
+    {"lsquo", 0x2018}, {"lt", 0x3C}, {"macr", 0xAF}, {"mdash", 0x2014},
+    {"micro", 0xB5}, {"middot", 0xB7}, {"minus", 0x2212}, {"mu", 0x3BC},
+    {"nabla", 0x2207}, {"nbsp", 0xA0}, {"ndash", 0x2013}, {"ne", 0x2260},
+    {"newline", 0xA}, {"ni", 0x220B}, {"not", 0xAC}, {"notin", 0x2209},
+    {"nsub", 0x2284}, {"ntilde", 0xF1}, {"nu", 0x3BD}, {"num", 0x23},
+    {"oacute", 0xF3}, {"ocirc", 0xF4}, {"oelig", 0x153}, {"ograve", 0xF2},
+    {"oline", 0x203E}, {"omega", 0x3C9}, {"omicron", 0x3BF}, {"oplus", 0x2295},
+    {"or", 0x2228}, {"ordf", 0xAA}, {"ordm", 0xBA}, {"oslash", 0xF8},
+    {"otilde", 0xF5}, {"otimes", 0x2297}, {"ouml", 0xF6}, {"para", 0xB6},
+    {"part", 0x2202}, {"percnt", 0x25}, {"period", 0x2E}, {"permil", 0x2030},
+    {"perp", 0x22A5}, {"phi", 0x3C6}, {"pi", 0x3C0}, {"piv", 0x3D6},
+    {"plus", 0x2B}, {"plusmn", 0xB1}, {"pound", 0xA3}, {"prime", 0x2032},
+    {"prod", 0x220F}, {"prop", 0x221D}, {"psi", 0x3C8}, {"quest", 0x3F},
+    {"quot", 0x22}, {"rArr", 0x21D2}, {"radic", 0x221A}, {"rang", 0x27E9},
+    {"raquo", 0xBB}, {"rarr", 0x2192}, {"rbrace", 0x7D}, {"rbrack", 0x5D},
+    {"rceil", 0x2309}, {"rdquo", 0x201D}, {"real", 0x211C}, {"reg", 0xAE},
+    {"rfloor", 0x230B}, {"rho", 0x3C1}, {"rlm", 0x200F}, {"rpar", 0x29},
+    {"rsaquo", 0x203A}, {"rsquo", 0x2019}, {"sbquo", 0x201A}, {"scaron", 0x161},
+    {"sdot", 0x22C5}, {"sect", 0xA7}, {"semi", 0x3B}, {"shy", 0xAD},
+    {"sigma", 0x3C3}, {"sigmaf", 0x3C2}, {"sim", 0x223C}, {"sol", 0x2F},
+    {"spades", 0x2660}, {"sub", 0x2282}, {"sube", 0x2286}, {"sum", 0x2211},
+    {"sup", 0x2283}, {"sup1", 0xB9}, {"sup2", 0xB2}, {"sup3", 0xB3},
+    {"supe", 0x2287}, {"szlig", 0xDF}, {"tau", 0x3C4}, {"there4", 0x2234},
+    {"theta", 0x3B8}, {"thetasym", 0x3D1}, {"thinsp", 0x2009}, {"thorn", 0xFE},
+    {"tilde", 0x2DC}, {"times", 0xD7}, {"trade", 0x2122}, {"uArr", 0x21D1},
+    {"uacute", 0xFA}, {"uarr", 0x2191}, {"ucirc", 0xFB}, {"ugrave", 0xF9},
+    {"uml", 0xA8}, {"upsih", 0x3D2}, {"upsilon", 0x3C5}, {"uuml", 0xFC},
+    {"verbar", 0x7C}, {"weierp", 0x2118}, {"xi", 0x3BE}, {"yacute", 0xFD},
+    {"yen", 0xA5}, {"yuml", 0xFF}, {"zeta", 0x3B6}, {"zwj", 0x200D},
+    {"zwnj", 0x200C},
+};
+
+// Numeric references 0x80-0x9F mean Windows-1252, as in browsers
+static constexpr std::array<std::uint16_t, 32> kWindows1252 = {
+    0x20AC, 0xFFFD, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0xFFFD, 0x017D, 0xFFFD,
+    0xFFFD, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0xFFFD, 0x017E, 0x0178};
+
+// Elements whose whole content is dropped
+static constexpr std::string_view kSkippedElements[] = {
+    "noscript", "script", "style", "svg", "template"};
+
+// Elements that start and end a block of text
+static constexpr std::string_view kBlockElements[] = {
+    "address", "article", "aside",  "blockquote", "body",    "caption",
+    "dd",      "details", "div",    "dl",         "dt",      "fieldset",
+    "figcaption", "figure", "footer", "form",     "header",  "hr",
+    "html",    "li",      "main",   "nav",        "ol",      "p",
+    "pre",     "section", "summary", "table",     "tbody",   "tfoot",
+    "thead",   "title",   "tr",     "ul"};
+
+// Block elements that group other blocks and take part in content scoring
+static constexpr std::string_view kContainerElements[] = {
+    "article", "aside", "body",  "div", "footer", "form", "header",
+    "main",    "nav",   "ol",    "section", "table", "ul"};
+static constexpr std::string_view kBoilerplateElements[] = {
+    "aside", "footer", "form", "nav"};
+
+// Class/id fragments of page chrome, and of the actual content
+static constexpr std::string_view kBoilerplateHints[] = {
+    "ad-",      "advert",  "banner",  "breadcrumb", "comment", "consent",
+    "cookie",   "footer",  "masthead", "menu",      "modal",   "nav",
+    "newsletter", "popup", "promo",   "related",    "share",   "sidebar",
+    "skip",     "social",  "subscribe"};
+static constexpr std::string_view kContentHints[] = {
+    "article", "blog", "content", "entry", "main", "post", "story", "text"};
+
+static bool contains(const auto &names, std::string_view name) {
+  return std::find(std::begin(names), std::end(names), name) !=
+         std::end(names);
+}
+
+static bool mentions_any(std::string_view text, const auto &fragments) {
+  for (std::string_view fragment : fragments) {
+    if (text.find(fragment) != std::string_view::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Lowercased value of `name` in a tag's attribute text, or ""
+static std::string attribute_value(std::string_view attributes,
+                                   std::string_view name) {
+  std::string lower(attributes);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  std::size_t pos = 0;
+  while ((pos = lower.find(name, pos)) != std::string::npos) {
+    std::size_t after = pos + name.size();
+    bool starts_word = pos == 0 || lower[pos - 1] == ' ' ||
+                       lower[pos - 1] == '\t' || lower[pos - 1] == '\n';
+    if (!starts_word || after >= lower.size() || lower[after] != '=') {
+      pos = after;
+      continue;
+    }
+    std::size_t start = after + 1;
+    if (start < lower.size() && (lower[start] == '"' || lower[start] == '\'')) {
+      std::size_t end = lower.find(lower[start], start + 1);
+      return lower.substr(start + 1, end == std::string::npos
+                                         ? std::string::npos
+                                         : end - start - 1);
+    }
+    std::size_t end = lower.find_first_of(" \t\n/", start);
+    return lower.substr(start, end == std::string::npos ? std::string::npos
+                                                        : end - start);
+  }
+  return "";
+}
+
+static bool is_space(char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f';
+}
+
+// Index of the first `a` or `b` at or after `from`, or text.size()
+static std::size_t find_either(std::string_view text, std::size_t from,
+                               char a, char b) {
+#ifdef LLAMAWARE_HTML_SSE2
+  const __m128i first = _mm_set1_epi8(a);
+  const __m128i second = _mm_set1_epi8(b);
+  while (from + 16 <= text.size()) {
+    __m128i block = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(text.data() + from));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(block, first), _mm_cmpeq_epi8(block, second))));
+    if (mask != 0) {
+      return from + static_cast<std::size_t>(std::countr_zero(mask));
+    }
+    from += 16;
+  }
+#endif
+  for (; from < text.size(); ++from) {
+    if (text[from] == a || text[from] == b) {
+      return from;
+    }
+  }
+  return text.size();
+}
+
+static void append_utf8(std::uint32_t cp, std::string &out) {
+  if (cp < 0x80) {
+    out += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    out += static_cast<char>(0xC0 | (cp >> 6));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    out += static_cast<char>(0xE0 | (cp >> 12));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (cp >> 18));
+    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  }
+}
+
+bool HtmlTextExtractor::append_entity(std::string_view name,
+                                      std::string &out) {
+  if (name.size() > 1 && name[0] == '#') {
+    bool hex = name[1] == 'x' || name[1] == 'X';
+    std::string_view digits = name.substr(hex ? 2 : 1);
+    if (digits.empty()) {
+      return false;
+    }
+    std::uint32_t cp = 0;
+    for (char c : digits) {
+      int digit;
+      if (c >= '0' && c <= '9') {
+        digit = c - '0';
+      } else if (hex && std::isxdigit(static_cast<unsigned char>(c))) {
+        digit = std::tolower(static_cast<unsigned char>(c)) - 'a' + 10;
+      } else {
+        return false;
+      }
+      cp = std::min<std::uint32_t>(cp * (hex ? 16 : 10) + digit, 0x110000);
+    }
+    if (cp >= 0x80 && cp <= 0x9F) {
+      cp = kWindows1252[cp - 0x80];
+    } else if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+      cp = kReplacementCharacter;
+    }
+    append_utf8(cp, out);
+    return true;
+  }
+
+  auto it = std::lower_bound(std::begin(kNamedEntities),
+                             std::end(kNamedEntities), name,
+                             [](const auto &entry, std::string_view key) {
+                               return entry.first < key;
+                             });
+  if (it == std::end(kNamedEntities) || it->first != name) {
+    return false;
+  }
+  append_utf8(it->second, out);
+  return true;
+}
+
+std::string HtmlTextExtractor::decode_entities(std::string_view text) {
+  std::string decoded;
+  decoded.reserve(text.size());
+  std::size_t pos = 0;
+  while (pos < text.size()) {
+    std::size_t amp = text.find('&', pos);
+    if (amp == std::string_view::npos) {
+      decoded.append(text.substr(pos));
+      break;
+    }
+    decoded.append(text.substr(pos, amp - pos));
+    std::size_t semicolon = text.find(';', amp + 1);
+    if (semicolon != std::string_view::npos &&
+        semicolon - amp - 1 <= kMaxEntityLength &&
+        append_entity(text.substr(amp + 1, semicolon - amp - 1), decoded)) {
+      pos = semicolon + 1;
+    } else {
+      decoded += '&';
+      pos = amp + 1;
+    }
+  }
+  return decoded;
+}
+
+HtmlTextExtractor::HtmlTextExtractor(BlockCallback on_block)
+    : on_block_(std::move(on_block)) {}
+
+void HtmlTextExtractor::append_char(char c) {
+  block_.text += c;
+  ++emitted_;
+  if (link_depth_ > 0) {
+    ++block_.link_chars;
+  }
+}
+
+void HtmlTextExtractor::text_run(std::string_view run) {
+  if (pre_depth_ > 0) {
+    for (char c : run) {
+      append_char(c);
+    }
+    return;
+  }
+  // Collapse whitespace: a run of it becomes one space between words
+  for (char c : run) {
+    if (is_space(c)) {
+      pending_space_ = true;
+      continue;
+    }
+    if (pending_space_ && !block_.text.empty() &&
+        block_.text.back() != '\n') {
+      append_char(' ');
+    }
+    pending_space_ = false;
+    append_char(c);
+  }
+}
+
+void HtmlTextExtractor::flush_block() {
+  pending_space_ = false;
+  while (!block_.text.empty() && is_space(block_.text.back())) {
+    block_.text.pop_back();
+  }
+  if (block_.text.empty()) {
+    block_ = {};
+    block_.preformatted = pre_depth_ > 0;
+    return;
+  }
+
+  HtmlBlock block = std::move(block_);
+  block_ = {};
+  for (const auto &container : containers_) {
+    block.containers.push_back(container.id);
+  }
+  block.boilerplate = !containers_.empty() && containers_.back().boilerplate;
+  block_.preformatted = pre_depth_ > 0;
+  if (on_block_) {
+    on_block_(std::move(block));
+    return;
+  }
+
+  render_block(block, text_, last_list_item_);
+}
+
+void render_block(const HtmlBlock &block, std::string &out,
+                  bool &last_list_item) {
+  if (!out.empty()) {
+    out += block.list_item && last_list_item ? "\n" : "\n\n";
+  }
+  last_list_item = block.list_item;
+  if (block.heading > 0) {
+    out.append(static_cast<std::size_t>(block.heading), '#');
+    out += ' ';
+  } else if (block.list_item) {
+    out += "- ";
+  }
+  if (block.preformatted) {
+    out += "```\n" + block.text + "\n```";
+  } else {
+    out += block.text;
+  }
+}
+
+void HtmlTextExtractor::handle_tag() {
+  std::string_view tag = tag_;
+  bool closing = !tag.empty() && tag[0] == '/';
+  if (closing) {
+    tag.remove_prefix(1);
+  }
+  std::size_t name_end = 0;
+  while (name_end < tag.size() &&
+         std::isalnum(static_cast<unsigned char>(tag[name_end]))) {
+    ++name_end;
+  }
+  std::string name(tag.substr(0, name_end));
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  bool self_closing = !tag.empty() && tag.back() == '/';
+
+  if (contains(kSkippedElements, name)) {
+    if (!closing && !self_closing) {
+      state_ = State::RawText;
+      raw_end_ = "</" + name;
+      raw_match_ = 0;
+    }
+    return;
+  }
+  if (name == "a") {
+    link_depth_ = closing ? std::max(0, link_depth_ - 1) : link_depth_ + 1;
+    return;
+  }
+  if (name == "br") {
+    if (pre_depth_ == 0) {
+      pending_space_ = false;
+      append_char('\n');
+    }
+    return;
+  }
+  if (name.size() == 2 && name[0] == 'h' && name[1] >= '1' &&
+      name[1] <= '6') {
+    flush_block();
+    block_.heading = closing ? 0 : name[1] - '0';
+    return;
+  }
+  if ((name == "td" || name == "th") && !closing) {
+    if (!block_.text.empty()) { // Cells of a row share one block
+      pending_space_ = true;
+      text_run("|");
+      pending_space_ = true;
+    }
+    return;
+  }
+  if (!contains(kBlockElements, name)) {
+    return; // Inline element; its text joins the current block
+  }
+
+  flush_block();
+  if (contains(kContainerElements, name)) {
+    if (closing) {
+      close_container(name);
+    } else if (!self_closing) {
+      open_container(name, tag.substr(name_end));
+    }
+  }
+  if (name == "pre") {
+    pre_depth_ = closing ? std::max(0, pre_depth_ - 1) : pre_depth_ + 1;
+    block_.preformatted = pre_depth_ > 0;
+  } else if (name == "li" && !closing) {
+    block_.list_item = true;
+  }
+}
+
+void HtmlTextExtractor::open_container(const std::string &name,
+                                       std::string_view attributes) {
+  Container container;
+  container.name = name;
+  container.id = next_container_id_++;
+  bool inherited = !containers_.empty() && containers_.back().boilerplate;
+  bool in_content = !containers_.empty() && containers_.back().content;
+
+  std::string hints = attribute_value(attributes, "class") + " " +
+                      attribute_value(attributes, "id");
+  bool content_hint = mentions_any(hints, kContentHints);
+  container.content = in_content || content_hint || name == "article" ||
+                      name == "main";
+  // An article's own <header> carries its title, not site chrome
+  bool chrome = contains(kBoilerplateElements, name) ||
+                (name == "header" && !in_content) ||
+                (mentions_any(hints, kBoilerplateHints) && !content_hint);
+  container.boilerplate = inherited || chrome;
+  containers_.push_back(std::move(container));
+}
+
+void HtmlTextExtractor::close_container(const std::string &name) {
+  for (std::size_t i = containers_.size(); i-- > 0;) {
+    if (containers_[i].name == name) {
+      containers_.resize(i); // Also closes anything left unclosed inside
+      return;
+    }
+  }
+}
+
+void HtmlTextExtractor::feed(std::string_view chunk) {
+  std::size_t i = 0;
+  const std::size_t n = chunk.size();
+
+  while (i < n) {
+    switch (state_) {
+    case State::Text: {
+      std::size_t next = find_either(chunk, i, '<', '&');
+      text_run(chunk.substr(i, next - i));
+      if (next < n) {
+        state_ = chunk[next] == '<' ? State::TagOpen : State::Entity;
+        entity_.clear();
+      }
+      i = next + 1;
+      break;
+    }
+    case State::Entity: {
+      char c = chunk[i];
+      if (c == ';') {
+        std::string decoded;
+        if (entity_ == "nbsp") {
+          decoded = " "; // Collapses like ordinary whitespace
+        } else if (!append_entity(entity_, decoded)) {
+          decoded = "&" + entity_ + ";";
+        }
+        text_run(decoded);
+        state_ = State::Text;
+        ++i;
+      } else if ((std::isalnum(static_cast<unsigned char>(c)) || c == '#') &&
+                 entity_.size() < kMaxEntityLength) {
+        entity_ += c;
+        ++i;
+      } else {
+        text_run("&" + entity_); // Not a reference; reprocess `c` as text
+        state_ = State::Text;
+      }
+      break;
+    }
+    case State::TagOpen: {
+      char c = chunk[i];
+      if (c == '/' || std::isalpha(static_cast<unsigned char>(c))) {
+        tag_.assign(1, c);
+        state_ = State::Tag;
+        ++i;
+      } else if (c == '!' || c == '?') {
+        tag_.assign(1, c);
+        state_ = State::Declaration;
+        ++i;
+      } else {
+        text_run("<"); // A literal '<' in text
+        state_ = State::Text;
+      }
+      break;
+    }
+    case State::Tag: {
+      std::size_t end = i;
+      while (end < n && chunk[end] != '>' && chunk[end] != '"' &&
+             chunk[end] != '\'') {
+        ++end;
+      }
+      if (tag_.size() < kMaxTagLength) {
+        tag_.append(chunk.substr(i, std::min(end - i,
+                                             kMaxTagLength - tag_.size())));
+      }
+      if (end == n) {
+        return;
+      }
+      if (chunk[end] == '>') {
+        state_ = State::Text;
+        handle_tag(); // May switch to RawText
+      } else {
+        quote_ = chunk[end];
+        state_ = State::TagQuote;
+        if (tag_.size() < kMaxTagLength) {
+          tag_ += quote_;
+        }
+      }
+      i = end + 1;
+      break;
+    }
+    case State::TagQuote: {
+      // Attribute values are kept (up to the cap) for class and id hints
+      std::size_t end = std::min(chunk.find(quote_, i), n);
+      if (tag_.size() < kMaxTagLength) {
+        tag_.append(chunk.substr(i, std::min(end - i,
+                                             kMaxTagLength - tag_.size())));
+      }
+      if (end == n) {
+        return;
+      }
+      if (tag_.size() < kMaxTagLength) {
+        tag_ += quote_;
+      }
+      state_ = State::Tag;
+      i = end + 1;
+      break;
+    }
+    case State::Declaration: {
+      char c = chunk[i++];
+      if (c == '>') {
+        state_ = State::Text;
+      } else if (tag_.size() < 3) {
+        tag_ += c;
+        if (tag_ == "!--") {
+          state_ = State::Comment;
+          comment_dashes_ = 0;
+        }
+      }
+      break;
+    }
+    case State::Comment: {
+      char c = chunk[i++];
+      if (c == '>' && comment_dashes_ >= 2) {
+        state_ = State::Text;
+      } else {
+        comment_dashes_ = c == '-' ? comment_dashes_ + 1 : 0;
+      }
+      break;
+    }
+    case State::RawText: {
+      if (raw_match_ == 0) {
+        i = find_either(chunk, i, '<', '<');
+        if (i == n) {
+          return;
+        }
+      }
+      char c = static_cast<char>(
+          std::tolower(static_cast<unsigned char>(chunk[i])));
+      if (c == raw_end_[raw_match_]) {
+        ++i;
+        if (++raw_match_ == raw_end_.size()) {
+          tag_ = raw_end_.substr(1); // Consume the rest of the end tag
+          state_ = State::Tag;
+        }
+      } else if (raw_match_ > 0) {
+        raw_match_ = 0; // Retry this character as a new '<'
+      } else {
+        ++i;
+      }
+      break;
+    }
+    }
+  }
+}
+
+void HtmlTextExtractor::finish() {
+  if (state_ == State::Entity) {
+    text_run("&" + entity_);
+  }
+  state_ = State::Text;
+  flush_block();
+}
+
+std::string HtmlTextExtractor::extract(std::string_view html) {
+  HtmlTextExtractor extractor;
+  extractor.feed(html);
+  extractor.finish();
+  return extractor.text_;
+}
+
+// Blocks shorter than this say little about where the content is
+static constexpr std::size_t kMinScoredLength = 25;
+// Above this share of link text a block is navigation, not prose
+static constexpr double kMaxLinkDensity = 0.5;
+// Siblings of the best container scoring at least this share are kept
+static constexpr double kSiblingScoreRatio = 0.2;
+// Less selected text than this falls back to all non-boilerplate text
+static constexpr std::size_t kMinSelectedLength = 200;
+
+static double link_density(const HtmlBlock &block) {
+  return block.text.empty() ? 0.0
+                            : static_cast<double>(block.link_chars) /
+                                  static_cast<double>(block.text.size());
+}
+
+static bool is_kept(const HtmlBlock &block) {
+  if (block.boilerplate) {
+    return false;
+  }
+  if (block.heading > 0 || block.preformatted) {
+    return true;
+  }
+  // Link lists ("Related: a | b | c") go; prose with some links stays
+  return link_density(block) <= kMaxLinkDensity;
+}
+
+MainContentExtractor::MainContentExtractor()
+    : extractor_([this](HtmlBlock &&block) {
+        blocks_.push_back(std::move(block));
+      }) {}
+
+void MainContentExtractor::finish() {
+  extractor_.finish();
+  text_.clear();
+
+  // Score each block's container fully and its parent by half
+  std::vector<double> scores;
+  for (const auto &block : blocks_) {
+    if (block.boilerplate || block.containers.empty() ||
+        block.text.size() < kMinScoredLength ||
+        link_density(block) > kMaxLinkDensity) {
+      continue;
+    }
+    double score =
+        1.0 +
+        static_cast<double>(
+            std::count(block.text.begin(), block.text.end(), ',')) +
+        std::min(static_cast<double>(block.text.size()) / 100.0, 3.0);
+    score *= 1.0 - link_density(block);
+
+    std::size_t depth = block.containers.size();
+    std::size_t parent = block.containers[depth - 1];
+    scores.resize(std::max(scores.size(), parent + 1), 0.0);
+    scores[parent] += score;
+    if (depth >= 2) {
+      scores[block.containers[depth - 2]] += score / 2.0;
+    }
+  }
+
+  std::size_t best = 0;
+  for (std::size_t id = 1; id < scores.size(); ++id) {
+    if (scores[id] > scores[best]) {
+      best = id;
+    }
+  }
+
+  // The best container plus strong siblings under the same parent
+  std::vector<bool> selected(scores.size(), false);
+  if (!scores.empty() && scores[best] > 0.0) {
+    selected[best] = true;
+    std::size_t best_parent = scores.size();
+    for (const auto &block : blocks_) {
+      auto at = std::find(block.containers.begin(), block.containers.end(),
+                          best);
+      if (at != block.containers.end()) {
+        if (at != block.containers.begin()) {
+          best_parent = *(at - 1);
+        }
+        break;
+      }
+    }
+    for (const auto &block : blocks_) {
+      std::size_t depth = block.containers.size();
+      if (depth < 2 || block.containers[depth - 2] != best_parent) {
+        continue;
+      }
+      // Containers opened after the last scored block have no score
+      std::size_t sibling = block.containers[depth - 1];
+      if (sibling < scores.size() &&
+          scores[sibling] >= scores[best] * kSiblingScoreRatio) {
+        selected[sibling] = true;
+      }
+    }
+  }
+
+  auto in_selection = [&](const HtmlBlock &block) {
+    for (std::size_t id : block.containers) {
+      if (id < selected.size() && selected[id]) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  bool last_list_item = false;
+  const HtmlBlock *title = nullptr; // Last top-level heading before content
+  bool started = false;
+  for (const auto &block : blocks_) {
+    if (!in_selection(block)) {
+      if (!started && block.heading == 1 && !block.boilerplate) {
+        title = &block;
+      }
+      continue;
+    }
+    if (!started && title != nullptr) {
+      render_block(*title, text_, last_list_item);
+    }
+    started = true;
+    if (is_kept(block)) {
+      render_block(block, text_, last_list_item);
+    }
+  }
+
+  if (text_.size() < kMinSelectedLength) {
+    text_.clear();
+    last_list_item = false;
+    for (const auto &block : blocks_) {
+      if (is_kept(block)) {
+        render_block(block, text_, last_list_item);
+      }
+    }
+  }
+  blocks_.clear();
+}
+
+std::string MainContentExtractor::extract(std::string_view html) {
+  MainContentExtractor extractor;
+  extractor.feed(html);
+  extractor.finish();
+  return extractor.text_;
+}
+
+} // namespace Utils
@@ -0,0 +1,647 @@
+#include "utils/json_stream.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <utility>
+
+namespace Utils {
+
+namespace {
+constexpr std::string_view kSseDataField = "data:";
+constexpr std::uint32_t kReplacementCharacter = 0xFFFD;
+
+bool is_whitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool is_literal_char(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+         (c >= 'A' && c <= 'Z') || c == '-' || c == '+' || c == '.';
+}
+
+// Length of the well-formed UTF-8 sequence starting at text[pos], or 0
+std::size_t utf8_sequence_length(std::string_view text, std::size_t pos) {
+  auto byte = [&](std::size_t i) {
+    return static_cast<unsigned char>(text[pos + i]);
+  };
+  auto continuation = [&](std::size_t i) {
+    return pos + i < text.size() && (byte(i) & 0xC0) == 0x80;
+  };
+
+  unsigned char lead = byte(0);
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    return continuation(1) ? 2 : 0;
+  }
+  if (lead >= 0xE0 && lead <= 0xEF) {
+    if (!continuation(1) || !continuation(2)) {
+      return 0;
+    }
+    // Reject overlong forms and UTF-16 surrogates
+    if ((lead == 0xE0 && byte(1) < 0xA0) || (lead == 0xED && byte(1) > 0x9F)) {
+      return 0;
+    }
+    return 3;
+  }
+  if (lead >= 0xF0 && lead <= 0xF4) {
+    if (!continuation(1) || !continuation(2) || !continuation(3)) {
+      return 0;
+    }
+    if ((lead == 0xF0 && byte(1) < 0x90) || (lead == 0xF4 && byte(1) > 0x8F)) {
+      return 0;
+    }
+    return 4;
+  }
+  return 0;
+}
+
+// Escape sequence for one byte needing it; returns its length (<= 6)
+std::size_t escape_byte(unsigned char c, char *out) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  out[0] = '\\';
+  switch (c) {
+  case '"':
+    out[1] = '"';
+    return 2;
+  case '\\':
+    out[1] = '\\';
+    return 2;
+  case '\b':
+    out[1] = 'b';
+    return 2;
+  case '\f':
+    out[1] = 'f';
+    return 2;
+  case '\n':
+    out[1] = 'n';
+    return 2;
+  case '\r':
+    out[1] = 'r';
+    return 2;
+  case '\t':
+    out[1] = 't';
+    return 2;
+  default:
+    std::memcpy(out + 1, "u00", 3);
+    out[4] = kHex[c >> 4];
+    out[5] = kHex[c & 0x0F];
+    return 6;
+  }
+}
+
+constexpr std::string_view kEscapedReplacement = "\\ufffd";
+
+bool is_plain_byte(unsigned char c) {
+  return c >= 0x20 && c < 0x80 && c != '"' && c != '\\';
+}
+
+// Serialized length of `text` once escaped
+std::size_t escaped_length(std::string_view text) {
+  std::size_t length = 0;
+  std::size_t pos = 0;
+  char scratch[8];
+  while (pos < text.size()) {
+    auto c = static_cast<unsigned char>(text[pos]);
+    if (is_plain_byte(c)) {
+      ++length;
+      ++pos;
+    } else if (c < 0x80) {
+      length += escape_byte(c, scratch);
+      ++pos;
+    } else if (std::size_t n = utf8_sequence_length(text, pos); n > 0) {
+      length += n;
+      pos += n;
+    } else {
+      length += kEscapedReplacement.size();
+      ++pos;
+    }
+  }
+  return length;
+}
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+} // namespace
+
+JsonFieldExtractor::JsonFieldExtractor(std::vector<std::string> paths,
+                                       ValueCallback on_value, Framing framing)
+    : paths_(std::move(paths)), on_value_(std::move(on_value)),
+      framing_(framing),
+      state_(framing == Framing::ServerSentEvents ? State::SseLineStart
+                                                  : State::Value) {
+  path_.reserve(64);
+  buffer_.reserve(256);
+}
+
+bool JsonFieldExtractor::is_target() const {
+  return std::find(paths_.begin(), paths_.end(), path_) != paths_.end();
+}
+
+JsonFieldExtractor::State JsonFieldExtractor::document_start_state() const {
+  // An SSE event carries one document; ignore anything after it on the line
+  return framing_ == Framing::ServerSentEvents ? State::SkipLine
+                                               : State::Value;
+}
+
+void JsonFieldExtractor::set_element_path(const Frame &frame) {
+  path_.resize(frame.path_length);
+  if (!path_.empty()) {
+    path_.push_back('.');
+  }
+  char digits[24];
+  auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), frame.index);
+  path_.append(digits, end);
+}
+
+void JsonFieldExtractor::begin_value(char c) {
+  capture_ = false;
+  switch (c) {
+  case '{':
+    stack_.push_back({false, path_.size(), 0});
+    state_ = State::ObjectFirstKey;
+    return;
+  case '[':
+    stack_.push_back({true, path_.size(), 0});
+    state_ = State::ArrayFirstValue;
+    return;
+  case '"':
+    in_key_ = false;
+    capture_ = is_target();
+    buffer_.clear();
+    state_ = State::String;
+    return;
+  default:
+    if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' ||
+        c == 'n') {
+      capture_ = is_target();
+      buffer_.clear();
+      if (capture_) {
+        buffer_.push_back(c);
+      }
+      state_ = State::Literal;
+      return;
+    }
+    fail();
+  }
+}
+
+void JsonFieldExtractor::end_value() {
+  if (stack_.empty()) {
+    path_.clear();
+    state_ = document_start_state();
+  } else {
+    state_ = State::AfterValue;
+  }
+}
+
+void JsonFieldExtractor::fail() {
+  malformed_++;
+  stack_.clear();
+  path_.clear();
+  in_key_ = false;
+  capture_ = false;
+  pending_high_surrogate_ = 0;
+  state_ = State::SkipLine;
+}
+
+void JsonFieldExtractor::append_code_point(std::uint32_t cp) {
+  if (cp < 0x80) {
+    buffer_.push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    buffer_.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+    buffer_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else if (cp < 0x10000) {
+    buffer_.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+    buffer_.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    buffer_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else {
+    buffer_.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+    buffer_.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+    buffer_.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    buffer_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  }
+}
+
+void JsonFieldExtractor::flush_pending_surrogate() {
+  if (pending_high_surrogate_ != 0) {
+    append_code_point(kReplacementCharacter);
+    pending_high_surrogate_ = 0;
+  }
+}
+
+std::size_t JsonFieldExtractor::scan_string(std::string_view chunk,
+                                            std::size_t pos) {
+  bool collect = in_key_ || capture_;
+  std::size_t end = chunk.find_first_of("\"\\", pos);
+  if (end == std::string_view::npos) {
+    end = chunk.size();
+  }
+
+  if (collect && end > pos) {
+    flush_pending_surrogate();
+    buffer_.append(chunk.data() + pos, end - pos);
+  }
+  if (end == chunk.size()) {
+    return end; // String continues in the next chunk
+  }
+
+  if (chunk[end] == '\\') {
+    state_ = State::StringEscape;
+    return end + 1;
+  }
+
+  // Closing quote
+  if (collect) {
+    flush_pending_surrogate();
+  }
+  if (in_key_) {
+    in_key_ = false;
+    state_ = State::Colon;
+  } else {
+    if (capture_) {
+      on_value_(path_, buffer_);
+    }
+    end_value();
+  }
+  return end + 1;
+}
+
+void JsonFieldExtractor::feed(std::string_view chunk) {
+  std::size_t pos = 0;
+
+  while (pos < chunk.size()) {
+    char c = chunk[pos];
+    bool collect = in_key_ || capture_;
+
+    // States that consume raw bytes rather than structural tokens
+    switch (state_) {
+    case State::String:
+      pos = scan_string(chunk, pos);
+      continue;
+
+    case State::StringEscape: {
+      char decoded = 0;
+      switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        decoded = c;
+        break;
+      case 'b':
+        decoded = '\b';
+        break;
+      case 'f':
+        decoded = '\f';
+        break;
+      case 'n':
+        decoded = '\n';
+        break;
+      case 'r':
+        decoded = '\r';
+        break;
+      case 't':
+        decoded = '\t';
+        break;
+      case 'u':
+        code_unit_ = 0;
+        hex_digits_ = 0;
+        state_ = State::StringUnicode;
+        ++pos;
+        continue;
+      default:
+        fail();
+        continue;
+      }
+      if (collect) {
+        flush_pending_surrogate();
+        buffer_.push_back(decoded);
+      }
+      state_ = State::String;
+      ++pos;
+      continue;
+    }
+
+    case State::StringUnicode: {
+      int value = hex_value(c);
+      if (value < 0) {
+        fail();
+        continue;
+      }
+      code_unit_ = (code_unit_ << 4) | static_cast<std::uint32_t>(value);
+      ++pos;
+      if (++hex_digits_ < 4) {
+        continue;
+      }
+      state_ = State::String;
+      if (!collect) {
+        continue;
+      }
+      if (code_unit_ >= 0xD800 && code_unit_ <= 0xDBFF) {
+        flush_pending_surrogate();
+        pending_high_surrogate_ = code_unit_;
+      } else if (code_unit_ >= 0xDC00 && code_unit_ <= 0xDFFF) {
+        if (pending_high_surrogate_ != 0) {
+          append_code_point(0x10000 +
+                            ((pending_high_surrogate_ - 0xD800) << 10) +
+                            (code_unit_ - 0xDC00));
+          pending_high_surrogate_ = 0;
+        } else {
+          append_code_point(kReplacementCharacter);
+        }
+      } else {
+        flush_pending_surrogate();
+        append_code_point(code_unit_);
+      }
+      continue;
+    }
+
+    case State::Literal:
+      if (is_literal_char(c)) {
+        if (capture_) {
+          buffer_.push_back(c);
+        }
+        ++pos;
+        continue;
+      }
+      if (capture_) {
+        on_value_(path_, buffer_);
+      }
+      end_value();
+      continue; // Reprocess the terminating character
+
+    case State::SkipLine: {
+      std::size_t newline = chunk.find('\n', pos);
+      if (newline == std::string_view::npos) {
+        return;
+      }
+      pos = newline + 1;
+      line_prefix_.clear();
+      state_ = framing_ == Framing::ServerSentEvents ? State::SseLineStart
+                                                     : State::Value;
+      continue;
+    }
+
+    case State::SseLineStart:
+      ++pos;
+      if (c == '\n' || c == '\r') {
+        line_prefix_.clear();
+        continue;
+      }
+      line_prefix_.push_back(c);
+      if (line_prefix_ == kSseDataField) {
+        line_prefix_.clear();
+        state_ = State::SseData;
+      } else if (kSseDataField.substr(0, line_prefix_.size()) !=
+                 line_prefix_) {
+        state_ = State::SkipLine; // event:, id:, comments, ...
+      }
+      continue;
+
+    case State::SseData:
+      if (c == ' ' || c == '\t') {
+        ++pos;
+      } else {
+        // Only object payloads are JSON events; "[DONE]" and others are not
+        state_ = c == '{' ? State::Value : State::SkipLine;
+      }
+      continue;
+
+    default:
+      break;
+    }
+
+    if (is_whitespace(c)) {
+      ++pos;
+      continue;
+    }
+
+    switch (state_) {
+    case State::Value:
+      begin_value(c);
+      ++pos;
+      break;
+
+    case State::ObjectFirstKey:
+    case State::ObjectKey:
+      if (c == '"') {
+        in_key_ = true;
+        buffer_.clear();
+        state_ = State::String;
+      } else if (c == '}' && state_ == State::ObjectFirstKey) {
+        path_.resize(stack_.back().path_length);
+        stack_.pop_back();
+        end_value();
+      } else {
+        fail();
+        continue;
+      }
+      ++pos;
+      break;
+
+    case State::Colon:
+      if (c != ':') {
+        fail();
+        continue;
+      }
+      path_.resize(stack_.back().path_length);
+      if (!path_.empty()) {
+        path_.push_back('.');
+      }
+      path_.append(buffer_);
+      state_ = State::Value;
+      ++pos;
+      break;
+
+    case State::ArrayFirstValue:
+      if (c == ']') {
+        path_.resize(stack_.back().path_length);
+        stack_.pop_back();
+        end_value();
+        ++pos;
+      } else {
+        set_element_path(stack_.back());
+        state_ = State::Value; // Reprocess as the first element
+      }
+      break;
+
+    case State::AfterValue: {
+      Frame &frame = stack_.back();
+      if (c == ',') {
+        if (frame.is_array) {
+          frame.index++;
+          set_element_path(frame);
+          state_ = State::Value;
+        } else {
+          state_ = State::ObjectKey;
+        }
+      } else if ((c == '}' && !frame.is_array) ||
+                 (c == ']' && frame.is_array)) {
+        path_.resize(frame.path_length);
+        stack_.pop_back();
+        end_value();
+      } else {
+        fail();
+        continue;
+      }
+      ++pos;
+      break;
+    }
+
+    default:
+      fail();
+      break;
+    }
+  }
+}
+
+JsonRope &JsonRope::raw(std::string_view json) {
+  if (!json.empty()) {
+    segments_.push_back({json, false});
+  }
+  return *this;
+}
+
+JsonRope &JsonRope::owned(std::string json) {
+  storage_.push_back(std::move(json));
+  return raw(storage_.back());
+}
+
+JsonRope &JsonRope::escaped(std::string_view text) {
+  if (!text.empty()) {
+    segments_.push_back({text, true});
+  }
+  return *this;
+}
+
+JsonRope &JsonRope::string(std::initializer_list<std::string_view> pieces) {
+  raw("\"");
+  for (std::string_view piece : pieces) {
+    escaped(piece);
+  }
+  return raw("\"");
+}
+
+std::size_t JsonRope::size() const {
+  std::size_t total = 0;
+  for (const auto &segment : segments_) {
+    total +=
+        segment.escape ? escaped_length(segment.text) : segment.text.size();
+  }
+  return total;
+}
+
+void JsonRope::rewind() {
+  segment_index_ = 0;
+  segment_offset_ = 0;
+  pending_size_ = 0;
+  pending_offset_ = 0;
+}
+
+std::size_t JsonRope::read(char *dest, std::size_t capacity) {
+  std::size_t written = 0;
+
+  auto drain_pending = [&] {
+    std::size_t n =
+        std::min(pending_size_ - pending_offset_, capacity - written);
+    std::memcpy(dest + written, pending_ + pending_offset_, n);
+    written += n;
+    pending_offset_ += n;
+    if (pending_offset_ == pending_size_) {
+      pending_size_ = pending_offset_ = 0;
+    }
+  };
+
+  // Emits an expansion, spilling into pending_ if it does not fit
+  auto emit = [&](const char *data, std::size_t length) {
+    if (capacity - written >= length) {
+      std::memcpy(dest + written, data, length);
+      written += length;
+      return;
+    }
+    std::memcpy(pending_, data, length);
+    pending_size_ = length;
+    pending_offset_ = 0;
+    drain_pending();
+  };
+
+  if (pending_size_ > 0) {
+    drain_pending();
+  }
+
+  while (written < capacity && pending_size_ == 0 &&
+         segment_index_ < segments_.size()) {
+    const Segment &segment = segments_[segment_index_];
+    std::string_view text = segment.text;
+
+    if (!segment.escape) {
+      std::size_t n =
+          std::min(text.size() - segment_offset_, capacity - written);
+      std::memcpy(dest + written, text.data() + segment_offset_, n);
+      written += n;
+      segment_offset_ += n;
+    } else {
+      while (written < capacity && pending_size_ == 0 &&
+             segment_offset_ < text.size()) {
+        // Copy runs of bytes that need no escaping in one go
+        std::size_t run = segment_offset_;
+        std::size_t limit = std::min(text.size(),
+                                     segment_offset_ + (capacity - written));
+        while (run < limit &&
+               is_plain_byte(static_cast<unsigned char>(text[run]))) {
+          ++run;
+        }
+        if (run > segment_offset_) {
+          std::memcpy(dest + written, text.data() + segment_offset_,
+                      run - segment_offset_);
+          written += run - segment_offset_;
+          segment_offset_ = run;
+          continue;
+        }
+
+        auto c = static_cast<unsigned char>(text[segment_offset_]);
+        if (c < 0x80) {
+          char escape[8];
+          emit(escape, escape_byte(c, escape));
+          ++segment_offset_;
+        } else if (std::size_t n = utf8_sequence_length(text, segment_offset_);
+                   n > 0) {
+          emit(text.data() + segment_offset_, n);
+          segment_offset_ += n;
+        } else {
+          emit(kEscapedReplacement.data(), kEscapedReplacement.size());
+          ++segment_offset_;
+        }
+      }
+    }
+
+    if (segment_offset_ == text.size()) {
+      ++segment_index_;
+      segment_offset_ = 0;
+    }
+  }
+  return written;
+}
+
+std::string JsonRope::to_string() const {
+  JsonRope cursor;
+  cursor.segments_ = segments_;
+
+  std::string out(size(), '\0');
+  std::size_t filled = 0;
+  while (filled < out.size()) {
+    std::size_t n = cursor.read(out.data() + filled, out.size() - filled);
+    if (n == 0) {
+      break;
+    }
+    filled += n;
+  }
+  return out;
+}
+
+} // namespace Utils
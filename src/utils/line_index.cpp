@@ -0,0 +1,116 @@
+#include "utils/line_index.h"
+#include <bit>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LLAMAWARE_LINE_INDEX_SSE2 1
+#endif
+
+namespace Utils {
+
+static constexpr std::size_t kBlock = 64;
+
+// Bit i set where block[i] is a newline, for the kBlock bytes at `block`
+static std::uint64_t newline_mask(const char *block) {
+#ifdef LLAMAWARE_LINE_INDEX_SSE2
+  const __m128i newline = _mm_set1_epi8('\n');
+  std::uint64_t mask = 0;
+  for (int i = 0; i < 4; ++i) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i));
+    auto bits = static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)));
+    mask |= static_cast<std::uint64_t>(bits) << (16 * i);
+  }
+  return mask;
+#else
+  // Written to be auto-vectorized where SSE2 is not available
+  std::uint64_t mask = 0;
+  for (std::size_t i = 0; i < kBlock; ++i) {
+    mask |= static_cast<std::uint64_t>(block[i] == '\n') << i;
+  }
+  return mask;
+#endif
+}
+
+std::size_t LineIndex::skip_lines(std::string_view text, std::size_t offset,
+                                  std::size_t count) {
+  if (count == 0) {
+    return offset;
+  }
+  std::size_t position = offset;
+  for (; position + kBlock <= text.size(); position += kBlock) {
+    std::uint64_t mask = newline_mask(text.data() + position);
+    auto found = static_cast<std::size_t>(std::popcount(mask));
+    if (found >= count) {
+      for (std::size_t i = 1; i < count; ++i) {
+        mask &= mask - 1; // Drop the lowest newline
+      }
+      return position + static_cast<std::size_t>(std::countr_zero(mask)) + 1;
+    }
+    count -= found;
+  }
+  for (; position < text.size(); ++position) {
+    if (text[position] == '\n' && --count == 0) {
+      return position + 1;
+    }
+  }
+  return npos;
+}
+
+std::size_t LineIndex::count_newlines(std::string_view text) {
+  std::size_t count = 0;
+  std::size_t position = 0;
+  for (; position + kBlock <= text.size(); position += kBlock) {
+    count += static_cast<std::size_t>(
+        std::popcount(newline_mask(text.data() + position)));
+  }
+  for (; position < text.size(); ++position) {
+    count += text[position] == '\n' ? 1 : 0;
+  }
+  return count;
+}
+
+void LineIndex::extend(std::string_view text, std::size_t checkpoints) {
+  for (; checkpoints_.size() < checkpoints && scanned_ + kBlock <= text.size();
+       scanned_ += kBlock) {
+    std::uint64_t mask = newline_mask(text.data() + scanned_);
+    auto found = static_cast<std::size_t>(std::popcount(mask));
+    if (found < kCheckpointInterval - newlines_ % kCheckpointInterval) {
+      newlines_ += found; // No checkpoint in this block
+      continue;
+    }
+    for (; mask != 0; mask &= mask - 1) {
+      if (++newlines_ % kCheckpointInterval == 0) {
+        checkpoints_.push_back(
+            scanned_ + static_cast<std::size_t>(std::countr_zero(mask)) + 1);
+      }
+    }
+  }
+  // The tail shorter than a block
+  for (; checkpoints_.size() < checkpoints && scanned_ < text.size();
+       ++scanned_) {
+    if (text[scanned_] == '\n' && ++newlines_ % kCheckpointInterval == 0) {
+      checkpoints_.push_back(scanned_ + 1);
+    }
+  }
+}
+
+std::size_t LineIndex::line_offset(std::string_view text, std::size_t line) {
+  std::size_t checkpoint = line / kCheckpointInterval;
+  extend(text, checkpoint + 1);
+  if (checkpoint >= checkpoints_.size()) {
+    return npos;
+  }
+  std::size_t offset = skip_lines(text, checkpoints_[checkpoint],
+                                  line % kCheckpointInterval);
+  return offset < text.size() ? offset : npos;
+}
+
+std::size_t LineIndex::line_count(std::string_view text) {
+  extend(text, npos);
+  return newlines_ + (!text.empty() && text.back() != '\n' ? 1 : 0);
+}
+
+} // namespace Utils
@@ -0,0 +1,267 @@
+#include "utils/literal_search.h"
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LLAMAWARE_LITERAL_SEARCH_SSE2 1
+#endif
+
+namespace Utils {
+
+static char lower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static char upper(char c) {
+  return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+// How often a byte shows up in source code and logs, roughly; the rarest
+// byte of a literal makes the fewest false candidates
+static int commonness(char c) {
+  static const char kCommon[] = " etaoinsrlcdhu_mpf()\n;,.=\"/gyb";
+  const char *found = std::strchr(kCommon, lower(c));
+  if (c == '\0' || found == nullptr) {
+    return 0;
+  }
+  return static_cast<int>(sizeof(kCommon) - (found - kCommon));
+}
+
+// First position in [begin, end) holding `a` or `b`, or npos
+static std::size_t find_either(const char *data, std::size_t begin,
+                               std::size_t end, char a, char b) {
+  std::size_t i = begin;
+#ifdef LLAMAWARE_LITERAL_SEARCH_SSE2
+  const __m128i first = _mm_set1_epi8(a);
+  const __m128i second = _mm_set1_epi8(b);
+  for (; i + 16 <= end; i += 16) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(bytes, first), _mm_cmpeq_epi8(bytes, second))));
+    if (mask != 0) {
+      return i + static_cast<std::size_t>(std::countr_zero(mask));
+    }
+  }
+#else
+  if (a == b) {
+    const void *found = begin < end ? std::memchr(data + begin, a, end - begin)
+                                    : nullptr;
+    return found == nullptr
+               ? LiteralSearch::npos
+               : static_cast<std::size_t>(static_cast<const char *>(found) -
+                                          data);
+  }
+#endif
+  for (; i < end; ++i) {
+    if (data[i] == a || data[i] == b) {
+      return i;
+    }
+  }
+  return LiteralSearch::npos;
+}
+
+LiteralSearch::LiteralSearch(std::vector<std::string> literals,
+                             bool case_sensitive)
+    : case_sensitive_(case_sensitive) {
+  for (auto &text : literals) {
+    if (text.empty()) {
+      continue;
+    }
+    std::size_t anchor = 0;
+    for (std::size_t i = 1; i < text.size(); ++i) {
+      if (commonness(text[i]) < commonness(text[anchor])) {
+        anchor = i;
+      }
+    }
+    literals_.push_back({std::move(text), anchor});
+  }
+  if (literals_.size() > 1) {
+    std::vector<std::string> patterns;
+    for (const auto &literal : literals_) {
+      patterns.push_back(literal.text);
+    }
+    automaton_.emplace(patterns, case_sensitive_);
+  }
+}
+
+std::size_t LiteralSearch::find_one(std::string_view text, std::size_t from,
+                                    const Literal &literal) const {
+  const std::size_t length = literal.text.size();
+  if (text.size() < length || from > text.size() - length) {
+    return npos;
+  }
+  const std::size_t last_start = text.size() - length;
+  const char anchor = literal.text[literal.anchor];
+  const char a = case_sensitive_ ? anchor : lower(anchor);
+  const char b = case_sensitive_ ? anchor : upper(anchor);
+
+  std::size_t position = from + literal.anchor;
+  const std::size_t end = last_start + literal.anchor + 1;
+  while ((position = find_either(text.data(), position, end, a, b)) != npos) {
+    std::size_t start = position - literal.anchor;
+    const char *candidate = text.data() + start;
+    bool equal = true;
+    if (case_sensitive_) {
+      equal = std::memcmp(candidate, literal.text.data(), length) == 0;
+    } else {
+      for (std::size_t i = 0; i < length && equal; ++i) {
+        equal = lower(candidate[i]) == lower(literal.text[i]);
+      }
+    }
+    if (equal) {
+      return start;
+    }
+    ++position;
+  }
+  return npos;
+}
+
+LiteralSearch::Match LiteralSearch::find(std::string_view text,
+                                         std::size_t from) const {
+  if (automaton_) {
+    AhoCorasick::Match match = automaton_->find(text, from);
+    return {match.position, match.length};
+  }
+  if (literals_.empty()) {
+    return {npos, 0};
+  }
+  std::size_t position = find_one(text, from, literals_.front());
+  return {position, position == npos ? 0 : literals_.front().text.size()};
+}
+
+// Length of the bracket expression or group starting at `pattern[start]`,
+// up to and including its closing `close`
+static std::size_t span_of(const std::string &pattern, std::size_t start,
+                           char open, char close) {
+  int depth = 0;
+  for (std::size_t i = start; i < pattern.size(); ++i) {
+    if (pattern[i] == '\\') {
+      ++i;
+    } else if (open == '[' && i == start + 1 && pattern[i] == ']') {
+      // "[]...]": a leading ']' is a member of the set
+    } else if (pattern[i] == '[' && open != '[') {
+      i += span_of(pattern, i, '[', ']') - 1;
+    } else if (pattern[i] == open && (open != '[' || i == start)) {
+      ++depth;
+    } else if (pattern[i] == close && --depth == 0) {
+      return i - start + 1;
+    }
+  }
+  return pattern.size() - start;
+}
+
+// Length of the escape sequence at `pattern[start]` ('\\')
+static std::size_t escape_length(const std::string &pattern,
+                                 std::size_t start) {
+  std::size_t length = 2;
+  char c = start + 1 < pattern.size() ? pattern[start + 1] : '\0';
+  if (c == 'x') {
+    length = 4; // \xHH
+  } else if (c == 'u') {
+    length = 6; // \uHHHH
+  } else if (c == 'c') {
+    length = 3; // \cX
+  } else if (std::isdigit(static_cast<unsigned char>(c))) {
+    while (start + length < pattern.size() &&
+           std::isdigit(static_cast<unsigned char>(pattern[start + length]))) {
+      ++length; // \0 or a backreference
+    }
+  }
+  return std::min(length, pattern.size() - start);
+}
+
+// Longest literal that every match of `alternative` contains; `exact` is
+// cleared unless the alternative is just that literal
+static std::string required_literal(const std::string &alternative,
+                                    bool &exact) {
+  std::string best;
+  std::string run;
+  auto end_run = [&] {
+    if (run.size() > best.size()) {
+      best = run;
+    }
+    run.clear();
+    exact = false;
+  };
+
+  for (std::size_t i = 0; i < alternative.size();) {
+    char c = alternative[i];
+    bool literal = false;
+    if (c == '\\' && i + 1 < alternative.size()) {
+      char escaped = alternative[i + 1];
+      // \d, \w, \b, \1, \n... are classes, anchors, references or codes
+      literal = !std::isalnum(static_cast<unsigned char>(escaped));
+      c = escaped;
+      i += escape_length(alternative, i);
+    } else if (c == '[') {
+      i += span_of(alternative, i, '[', ']');
+    } else if (c == '(') {
+      i += span_of(alternative, i, '(', ')');
+    } else {
+      literal = std::strchr(".^$)]*+?{}|\n", c) == nullptr;
+      ++i;
+    }
+
+    char quantifier = i < alternative.size() ? alternative[i] : '\0';
+    if (quantifier == '*' || quantifier == '?' || quantifier == '{') {
+      // Possibly absent: ends the run without the quantified atom
+      i += quantifier == '{' ? span_of(alternative, i, '{', '}') : 1;
+      end_run();
+    } else if (!literal) {
+      end_run();
+    } else {
+      run += c;
+      if (quantifier == '+') {
+        ++i;
+        end_run(); // Present, but what follows may come after repeats
+      }
+    }
+    if (i < alternative.size() && alternative[i] == '?') {
+      ++i; // Lazy quantifier
+    }
+  }
+  if (run.size() > best.size()) {
+    best = run;
+  }
+  return best;
+}
+
+std::vector<std::string>
+LiteralSearch::required_literals(const std::string &regex, bool &exact) {
+  // Split at top-level '|'
+  std::vector<std::string> alternatives(1);
+  for (std::size_t i = 0; i < regex.size(); ++i) {
+    char c = regex[i];
+    std::size_t length = 1;
+    if (c == '\\') {
+      length = escape_length(regex, i);
+    } else if (c == '[') {
+      length = span_of(regex, i, '[', ']');
+    } else if (c == '(') {
+      length = span_of(regex, i, '(', ')');
+    } else if (c == '|') {
+      alternatives.emplace_back();
+      continue;
+    }
+    alternatives.back() += regex.substr(i, length);
+    i += length - 1;
+  }
+
+  exact = true;
+  std::vector<std::string> literals;
+  for (const auto &alternative : alternatives) {
+    std::string literal = required_literal(alternative, exact);
+    if (literal.empty()) {
+      exact = false;
+      return {};
+    }
+    literals.push_back(std::move(literal));
+  }
+  return literals;
+}
+
+} // namespace Utils
@@ -0,0 +1,145 @@
+#include "utils/mapped_file.h"
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Utils {
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+  *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    close();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    identity_ = std::exchange(other.identity_, {});
+#ifdef _WIN32
+    mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+  }
+  return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &path) {
+  close();
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  BY_HANDLE_FILE_INFORMATION info;
+  if (!GetFileInformationByHandle(file, &info)) {
+    CloseHandle(file);
+    return false;
+  }
+  identity_.device = info.dwVolumeSerialNumber;
+  identity_.inode = (static_cast<std::uint64_t>(info.nFileIndexHigh) << 32) |
+                    info.nFileIndexLow;
+  // FILETIME counts 100ns intervals
+  identity_.modified =
+      static_cast<std::int64_t>(
+          (static_cast<std::uint64_t>(info.ftLastWriteTime.dwHighDateTime)
+           << 32) |
+          info.ftLastWriteTime.dwLowDateTime) *
+      100;
+  identity_.size = (static_cast<std::uint64_t>(info.nFileSizeHigh) << 32) |
+                   info.nFileSizeLow;
+
+  bool ok = true;
+  if (identity_.size > 0) {
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void *view = mapping_ != nullptr
+                     ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)
+                     : nullptr;
+    ok = view != nullptr;
+    data_ = static_cast<const char *>(view);
+    size_ = ok ? static_cast<std::size_t>(identity_.size) : 0;
+  }
+  CloseHandle(file); // The mapping keeps the file open
+  if (!ok) {
+    close();
+  }
+  return ok;
+}
+
+void MappedFile::close() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+  }
+  data_ = nullptr;
+  mapping_ = nullptr;
+  size_ = 0;
+  identity_ = {};
+}
+
+#else
+
+bool MappedFile::open(const std::string &path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+  identity_.device = static_cast<std::uint64_t>(info.st_dev);
+  identity_.inode = static_cast<std::uint64_t>(info.st_ino);
+#ifdef __APPLE__
+  const struct timespec &modified = info.st_mtimespec;
+#else
+  const struct timespec &modified = info.st_mtim;
+#endif
+  identity_.modified =
+      static_cast<std::int64_t>(modified.tv_sec) * 1000000000 +
+      modified.tv_nsec;
+  identity_.size = static_cast<std::uint64_t>(info.st_size);
+
+  bool ok = true;
+  if (identity_.size > 0) {
+    size_ = static_cast<std::size_t>(identity_.size);
+    void *view = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ok = view != MAP_FAILED;
+    data_ = ok ? static_cast<const char *>(view) : nullptr;
+  }
+  ::close(fd); // The mapping keeps the file open
+  if (!ok) {
+    size_ = 0;
+    identity_ = {};
+  }
+  return ok;
+}
+
+void MappedFile::close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  identity_ = {};
+}
+
+#endif
+
+} // namespace Utils
@@ -0,0 +1,153 @@
+#include "utils/parallel_walk.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Utils {
+
+static constexpr std::size_t kMaxWalkThreads = 8;
+
+namespace {
+
+// A directory to list or a file to visit
+struct WalkItem {
+  std::filesystem::path path;
+  bool is_directory;
+};
+
+struct WalkQueue {
+  std::mutex mutex;
+  std::deque<WalkItem> items;
+};
+
+} // namespace
+
+// Runs `work(i)` on threads 1..count-1 and on the caller as thread 0
+template <typename Work>
+static void run_on_threads(std::size_t count, Work &&work) {
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < count; ++i) {
+    threads.emplace_back(work, i);
+  }
+  work(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+std::size_t walk_threads() {
+  return std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1,
+                                 kMaxWalkThreads);
+}
+
+void walk_files(const std::filesystem::path &root, std::size_t threads,
+                const FileFilter &accept, const FileVisitor &visit) {
+  threads = std::max<std::size_t>(threads, 1);
+  std::vector<WalkQueue> queues(threads);
+  std::atomic<std::size_t> pending{1}; // Queued or in progress
+  std::atomic<long> queued{1};         // Waiting in a queue
+  std::atomic<bool> stopped{false};
+  queues[0].items.push_back({root, true});
+
+  // Threads with nothing to take sleep until work is queued or it is over
+  std::mutex idle_mutex;
+  std::condition_variable idle;
+  auto wake = [&](auto &&change) {
+    {
+      std::lock_guard<std::mutex> lock(idle_mutex);
+      change();
+    }
+    idle.notify_all();
+  };
+  auto finish_one = [&] {
+    if (--pending == 0) {
+      wake([] {});
+    }
+  };
+
+  auto take = [&](std::size_t self, WalkItem &item) {
+    for (std::size_t k = 0; k < threads; ++k) {
+      WalkQueue &queue = queues[(self + k) % threads];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (!queue.items.empty()) {
+        if (k == 0) {
+          item = std::move(queue.items.back());
+          queue.items.pop_back();
+        } else {
+          item = std::move(queue.items.front());
+          queue.items.pop_front();
+        }
+        --queued;
+        return true;
+      }
+    }
+    return false;
+  };
+
+  run_on_threads(threads, [&](std::size_t self) {
+    WalkItem item;
+    while (!stopped) {
+      if (!take(self, item)) {
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        idle.wait(lock,
+                  [&] { return queued > 0 || pending == 0 || stopped; });
+        if (pending == 0) {
+          break;
+        }
+        continue;
+      }
+      if (!item.is_directory) {
+        if (!visit(item.path)) {
+          wake([&] { stopped = true; });
+        }
+        finish_one();
+        continue;
+      }
+
+      std::vector<WalkItem> found;
+      std::error_code error;
+      for (std::filesystem::directory_iterator it(item.path, error), end;
+           !error && it != end; it.increment(error)) {
+        std::error_code type_error;
+        if (it->is_directory(type_error) && !it->is_symlink(type_error)) {
+          found.push_back({it->path(), true});
+        } else if (it->is_regular_file(type_error) && accept(it->path())) {
+          found.push_back({it->path(), false});
+        }
+      }
+      pending += found.size();
+      {
+        std::lock_guard<std::mutex> lock(queues[self].mutex);
+        for (auto &entry : found) {
+          queues[self].items.push_back(std::move(entry));
+        }
+      }
+      if (!found.empty()) {
+        wake([&] { queued += static_cast<long>(found.size()); });
+      }
+      finish_one();
+    }
+  });
+}
+
+void parallel_for(std::size_t count, std::size_t threads,
+                  const std::function<bool(std::size_t)> &body) {
+  if (count == 0) {
+    return;
+  }
+  std::atomic<std::size_t> next{0};
+  std::atomic<bool> stopped{false};
+  run_on_threads(std::clamp<std::size_t>(threads, 1, count), [&](std::size_t) {
+    for (std::size_t i = next++; i < count && !stopped; i = next++) {
+      if (!body(i)) {
+        stopped = true;
+      }
+    }
+  });
+}
+
+} // namespace Utils
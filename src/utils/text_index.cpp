@@ -0,0 +1,189 @@
+#include "utils/text_index.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Utils {
+
+// Usual BM25 parameters: term frequency saturation and length normalization
+static constexpr double kK1 = 1.2;
+static constexpr double kB = 0.75;
+
+static bool is_word_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9');
+}
+
+// Template core of tokenize(), so indexing avoids a std::function call
+// per word; `word` is reused between words
+template <typename OnWord>
+static void for_each_word(std::string_view text, std::string &word,
+                          OnWord &&on_word) {
+  std::size_t i = 0;
+  while (i < text.size()) {
+    while (i < text.size() && !is_word_char(text[i])) {
+      ++i;
+    }
+    std::size_t start = i;
+    while (i < text.size() && is_word_char(text[i])) {
+      ++i;
+    }
+    if (i - start < 2) {
+      continue;
+    }
+    word.assign(text.substr(start, i - start));
+    for (char &c : word) {
+      if (c >= 'A' && c <= 'Z') {
+        c = static_cast<char>(c - 'A' + 'a');
+      }
+    }
+    on_word(std::string_view(word));
+  }
+}
+
+void TextIndex::tokenize(
+    std::string_view text,
+    const std::function<void(std::string_view)> &on_word) {
+  std::string word;
+  for_each_word(text, word, on_word);
+}
+
+void TextIndex::add(std::uint32_t id, std::string_view text) {
+  remove(id);
+  if (id >= documents_.size()) {
+    documents_.resize(static_cast<std::size_t>(id) + 1);
+  }
+
+  // Term ids of every word, then counted by sorting
+  std::vector<std::uint32_t> words;
+  std::string buffer;
+  for_each_word(text, buffer, [&](std::string_view word) {
+    auto it = term_ids_.find(word);
+    if (it == term_ids_.end()) {
+      auto term = static_cast<std::uint32_t>(postings_.size());
+      it = term_ids_.emplace(std::string(word), term).first;
+      postings_.emplace_back();
+      document_frequency_.push_back(0);
+    }
+    words.push_back(it->second);
+  });
+  std::sort(words.begin(), words.end());
+
+  Document &document = documents_[id];
+  document.live = true;
+  ++document.generation;
+  document.length = static_cast<std::uint32_t>(words.size());
+  document.terms.clear();
+  for (std::size_t i = 0; i < words.size();) {
+    std::size_t run = i;
+    while (run < words.size() && words[run] == words[i]) {
+      ++run;
+    }
+    std::uint32_t term = words[i];
+    postings_[term].push_back({id, document.generation,
+                               static_cast<std::uint32_t>(run - i)});
+    ++document_frequency_[term];
+    document.terms.push_back(term);
+    i = run;
+  }
+  ++live_documents_;
+  total_length_ += document.length;
+  live_postings_ += document.terms.size();
+}
+
+void TextIndex::remove(std::uint32_t id) {
+  if (id >= documents_.size() || !documents_[id].live) {
+    return;
+  }
+  Document &document = documents_[id];
+  for (std::uint32_t term : document.terms) {
+    --document_frequency_[term];
+  }
+  document.live = false;
+  --live_documents_;
+  total_length_ -= document.length;
+  live_postings_ -= document.terms.size();
+  stale_postings_ += document.terms.size();
+  document.terms.clear();
+  document.terms.shrink_to_fit();
+
+  if (stale_postings_ > live_postings_) {
+    sweep();
+  }
+}
+
+bool TextIndex::is_current(const Posting &posting) const {
+  const Document &document = documents_[posting.id];
+  return document.live && document.generation == posting.generation;
+}
+
+void TextIndex::sweep() {
+  for (auto &list : postings_) {
+    list.erase(std::remove_if(list.begin(), list.end(),
+                              [this](const Posting &posting) {
+                                return !is_current(posting);
+                              }),
+               list.end());
+  }
+  stale_postings_ = 0;
+}
+
+std::vector<TextIndex::Hit> TextIndex::search(std::string_view query,
+                                              std::size_t limit) const {
+  std::vector<Hit> hits;
+  if (live_documents_ == 0 || limit == 0) {
+    return hits;
+  }
+
+  std::vector<std::uint32_t> terms;
+  std::string buffer;
+  for_each_word(query, buffer, [&](std::string_view word) {
+    auto it = term_ids_.find(word);
+    if (it != term_ids_.end() &&
+        std::find(terms.begin(), terms.end(), it->second) == terms.end()) {
+      terms.push_back(it->second);
+    }
+  });
+
+  const double count = static_cast<double>(live_documents_);
+  const double average_length =
+      std::max(1.0, static_cast<double>(total_length_) / count);
+  std::vector<double> scores(documents_.size(), 0.0);
+  std::vector<std::uint32_t> matched;
+  for (std::uint32_t term : terms) {
+    const double frequency_in_corpus = document_frequency_[term];
+    const double idf = std::log(1.0 + (count - frequency_in_corpus + 0.5) /
+                                          (frequency_in_corpus + 0.5));
+    for (const Posting &posting : postings_[term]) {
+      if (!is_current(posting)) {
+        continue;
+      }
+      const double length = documents_[posting.id].length;
+      const double tf = posting.frequency;
+      if (scores[posting.id] == 0.0) {
+        matched.push_back(posting.id);
+      }
+      scores[posting.id] +=
+          idf * tf * (kK1 + 1.0) /
+          (tf + kK1 * (1.0 - kB + kB * length / average_length));
+    }
+  }
+
+  hits.reserve(matched.size());
+  for (std::uint32_t id : matched) {
+    hits.emplace_back(id, scores[id]);
+  }
+  auto better = [](const Hit &a, const Hit &b) {
+    return a.second != b.second ? a.second > b.second : a.first > b.first;
+  };
+  if (hits.size() > limit) {
+    std::partial_sort(hits.begin(),
+                      hits.begin() + static_cast<std::ptrdiff_t>(limit),
+                      hits.end(), better);
+    hits.resize(limit);
+  } else {
+    std::sort(hits.begin(), hits.end(), better);
+  }
+  return hits;
+}
+
+} // namespace Utils
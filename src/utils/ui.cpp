@@ -62,6 +62,8 @@ void UI::print_help() {
             << "   - Write file\n";
   std::cout << Color::CYAN << "  replace:<file>:<old>:<new>" << Color::RESET
             << " - Replace text\n";
+  std::cout << Color::CYAN << "  replace_all:<glob>:<old>:<new>" << Color::RESET
+            << " - Replace in files\n";
   std::cout << Color::CYAN << "  grep:<pattern>[:dir[:filter]]" << Color::RESET
             << " - Search text\n";
 
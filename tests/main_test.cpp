@@ -1,5 +1,35 @@
+#include "core/tool_executor.h"
+#include "services/http_cache.h"
+#include "services/code_index.h"
+#include "services/file_service.h"
+#include "services/github_service.h"
+#include "services/http_cassette.h"
+#include "services/issue_mirror.h"
+#include "services/rate_limiter.h"
+#include "services/retry_scheduler.h"
+#include "services/summary_service.h"
+#include "services/web_service.h"
+#include "utils/aho_corasick.h"
+#include "utils/histogram.h"
+#include "utils/html_text.h"
+#include "utils/json_stream.h"
+#include "utils/literal_search.h"
 #include "version.h"
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <regex>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <csignal>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 // Basic test to verify the testing framework works
 TEST(BasicTest, SanityCheck) { EXPECT_EQ(1 + 1, 2); }
@@ -10,6 +40,753 @@ TEST(VersionTest, VersionCommand) {
   EXPECT_STREQ(version, llamaware_version_string);
 }
 
+// Test for latency histogram percentiles
+TEST(HistogramTest, PercentilesWithinPrecision) {
+  Utils::Histogram histogram(1000.0);
+  for (int i = 1; i <= 1000; ++i) {
+    histogram.record(static_cast<double>(i));
+  }
+  EXPECT_EQ(histogram.count(), 1000u);
+  EXPECT_DOUBLE_EQ(histogram.min(), 1.0);
+  EXPECT_DOUBLE_EQ(histogram.max(), 1000.0);
+  EXPECT_NEAR(histogram.percentile(50.0), 500.0, 500.0 * 0.01);
+  EXPECT_NEAR(histogram.percentile(99.0), 990.0, 990.0 * 0.01);
+}
+
+// Test for streaming field extraction across arbitrary chunk boundaries
+TEST(JsonStreamTest, ExtractsServerSentEventDeltas) {
+  const std::string stream =
+      "data: {\"choices\":[{\"delta\":{\"content\":\"Hel\"}}]}\n\n"
+      "data: {\"choices\":[{\"delta\":{\"content\":\"lo \\u00e9\"}}],"
+      "\"usage\":{\"completion_tokens\":2}}\n\n"
+      "data: [DONE]\n\n";
+
+  for (size_t step = 1; step <= stream.size(); ++step) {
+    std::string content;
+    std::string tokens;
+    Utils::JsonFieldExtractor extractor(
+        {"choices.0.delta.content", "usage.completion_tokens"},
+        [&](std::string_view path, std::string_view value) {
+          if (path == "usage.completion_tokens") {
+            tokens = value;
+          } else {
+            content.append(value);
+          }
+        },
+        Utils::JsonFieldExtractor::Framing::ServerSentEvents);
+    for (size_t i = 0; i < stream.size(); i += step) {
+      extractor.feed(std::string_view(stream).substr(i, step));
+    }
+    EXPECT_EQ(content, "Hello \xc3\xa9");
+    EXPECT_EQ(tokens, "2");
+    EXPECT_EQ(extractor.malformed_documents(), 0u);
+  }
+}
+
+// Test for request bodies serialized in pieces of any size
+TEST(JsonStreamTest, RopeEscapesAcrossReadBoundaries) {
+  const std::string context = "line \"one\"\n\ttab\x01 caf\xc3\xa9 bad\xff";
+  const std::string expected =
+      "{\"content\":\"line \\\"one\\\"\\n\\ttab\\u0001 caf\xc3\xa9 "
+      "bad\\ufffd!\"}";
+
+  Utils::JsonRope body;
+  body.raw("{\"content\":").string({context, "!"}).raw("}");
+  ASSERT_EQ(body.size(), expected.size());
+  EXPECT_EQ(body.to_string(), expected);
+
+  for (size_t capacity = 1; capacity <= expected.size(); ++capacity) {
+    std::string out;
+    char buffer[64];
+    body.rewind();
+    while (size_t n = body.read(buffer, capacity)) {
+      out.append(buffer, n);
+    }
+    EXPECT_EQ(out, expected);
+  }
+}
+
+// Test for server-directed retry delays and retry on 429
+TEST(RetrySchedulerTest, HonoursServerDelayAndRetries) {
+  using std::chrono::milliseconds;
+  using Services::WebResponse;
+  const std::string hour_away = std::to_string(std::time(nullptr) + 3600);
+  WebResponse limited{429, "", "", {}, false, ""};
+  limited.headers = {{"Retry-After", "2"},
+                     {"x-ratelimit-reset", hour_away},
+                     {"x-ratelimit-remaining", "0"}};
+  EXPECT_EQ(Services::RetryScheduler::server_delay(limited),
+            milliseconds(2000));
+  limited.headers = {{"x-ratelimit-reset-requests", "1m2.5s"},
+                     {"x-ratelimit-remaining-requests", "0"},
+                     {"x-ratelimit-reset-tokens", "5m"},
+                     {"x-ratelimit-remaining-tokens", "900"}};
+  EXPECT_EQ(Services::RetryScheduler::server_delay(limited),
+            milliseconds(62500));
+  EXPECT_FALSE(Services::RetryScheduler::server_delay({}).has_value());
+
+  Services::RetryScheduler::reset();
+  Services::RetryPolicy policy;
+  policy.base_delay = milliseconds(1);
+  int calls = 0;
+  Services::WebResponse response = Services::RetryScheduler::execute(
+      "http://example.test/v1",
+      [&] {
+        ++calls;
+        Services::WebResponse reply{calls == 1 ? 429 : 200, "", "", {},
+                                    calls != 1, ""};
+        if (calls == 1) {
+          reply.headers["Retry-After"] = "0";
+        }
+        return reply;
+      },
+      policy);
+  EXPECT_EQ(calls, 2);
+  EXPECT_TRUE(response.success);
+
+  // A 503 is retried even though reset headers of a live quota come with it
+  calls = 0;
+  response = Services::RetryScheduler::execute(
+      "http://example.test/v1",
+      [&] {
+        ++calls;
+        WebResponse reply{calls == 1 ? 503 : 200, "", "", {}, calls != 1, ""};
+        reply.headers["x-ratelimit-reset"] = hour_away;
+        reply.headers["x-ratelimit-remaining"] = "4999";
+        return reply;
+      },
+      policy);
+  EXPECT_EQ(calls, 2);
+  EXPECT_TRUE(response.success);
+}
+
+// Test that a drained token bucket makes the next request wait for refill
+TEST(RateLimiterTest, QueuesWhenTokenBudgetIsSpent) {
+  Services::RateLimiter::configure_host("limiter.test", {0.0, 0.0, 60.0});
+  const std::string url = "https://limiter.test/v1/chat";
+
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(Services::RateLimiter::acquire(url, {}, 60.0)); // No wait
+  EXPECT_FALSE(Services::RateLimiter::acquire(url, {}, 0.2)); // 1 token/s
+  auto waited = std::chrono::steady_clock::now() - start;
+
+  EXPECT_GE(waited, std::chrono::milliseconds(150));
+  EXPECT_LT(waited, std::chrono::seconds(2));
+
+  // A wait beyond the caller's limit is refused at once, like a 429
+  start = std::chrono::steady_clock::now();
+  auto refused = Services::RateLimiter::acquire(
+      url, {}, 30.0, std::chrono::milliseconds(100));
+  ASSERT_TRUE(refused.has_value());
+  EXPECT_EQ(refused->status_code, 429);
+  EXPECT_EQ(refused->headers["Retry-After"], "30");
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(100));
+}
+
+// Test that tool lines split across stream chunks are recognized once
+// complete, and that results come back in the order they were requested
+TEST(ToolExecutorTest, SchedulesStreamedInvocationsInOrder) {
+  EXPECT_EQ(Core::ToolExecutor::parse_invocation("  - `git:status`  "),
+            "git:status");
+  EXPECT_FALSE(Core::ToolExecutor::parse_invocation("Let me check git."));
+  EXPECT_TRUE(Core::ToolExecutor::is_read_only("github:issues:a/b"));
+  EXPECT_FALSE(Core::ToolExecutor::is_read_only("github:sync:a/b"));
+  EXPECT_TRUE(Core::ToolExecutor::is_read_only("read:src/main.cpp:1:5"));
+  EXPECT_FALSE(Core::ToolExecutor::is_read_only("read:/etc/hosts"));
+  EXPECT_FALSE(Core::ToolExecutor::is_read_only("read:../secrets.txt"));
+  EXPECT_FALSE(Core::ToolExecutor::is_read_only("grep:key:/etc"));
+  EXPECT_FALSE(Core::ToolExecutor::is_read_only("tree:.."));
+
+  Core::ToolScheduler scheduler;
+  Core::SpeculativeToolRunner runner(scheduler);
+  runner.feed("First I'll look:\ngit:sta");
+  runner.feed("tus\nwrite:notes.txt hello\ngit:status\nread:missing_file.t");
+  runner.finish();
+  runner.feed("xt\n"); // After finish(), a fresh line
+
+  ASSERT_EQ(scheduler.side_effects().size(), 1U);
+  EXPECT_EQ(scheduler.side_effects()[0], "write:notes.txt hello");
+
+  auto results = scheduler.collect(false);
+  ASSERT_EQ(results.size(), 4U);
+  EXPECT_EQ(results[0].invocation, "git:status");
+  EXPECT_EQ(results[1].output.rfind("Not run", 0), 0U);
+  EXPECT_EQ(results[2].invocation, "git:status"); // Re-read after a write
+  EXPECT_EQ(results[3].invocation, "read:missing_file.t");
+  EXPECT_EQ(results[3].output.rfind("Error:", 0), 0U);
+  EXPECT_TRUE(scheduler.empty());
+}
+
+// Test that map-reduce chunks break at paragraph boundaries and lose nothing
+TEST(SummaryServiceTest, SplitsAtNaturalBoundaries) {
+  std::string text = std::string(60, 'a') + "\n\n" + std::string(20, 'b') +
+                     " " + std::string(50, 'c');
+  auto chunks = Services::SummaryService::split_chunks(text, 80);
+
+  ASSERT_EQ(chunks.size(), 2U);
+  EXPECT_EQ(chunks[0], std::string(60, 'a') + "\n\n");
+  std::string rejoined;
+  for (auto chunk : chunks) {
+    EXPECT_LE(chunk.size(), 80U);
+    rejoined.append(chunk);
+  }
+  EXPECT_EQ(rejoined, text);
+}
+
+// Test that a recorded exchange replays without touching the network
+TEST(HttpCassetteTest, ReplaysRecordedResponsesInOrder) {
+  using Services::HttpCassette;
+  const std::string path = "cassette_test.jsonl";
+  const std::string url = "https://cassette.test/search?q=x&api_key=secret";
+
+  ASSERT_TRUE(HttpCassette::configure(Services::CassetteMode::Record, path));
+  int status = 429;
+  for (int i = 0; i < 2; ++i) {
+    HttpCassette::exchange("GET", url, "", [&] {
+      return Services::WebResponse{status++, "body", "", {}, true, ""};
+    });
+  }
+
+  ASSERT_TRUE(HttpCassette::configure(Services::CassetteMode::Replay, path,
+                                      Services::ReplayLatency::Zero));
+  auto fail = [] {
+    ADD_FAILURE() << "replay reached the network";
+    return Services::WebResponse{};
+  };
+  EXPECT_EQ(HttpCassette::exchange("GET", url, "", fail).status_code, 429);
+  EXPECT_EQ(HttpCassette::exchange("GET", url, "", fail).status_code, 430);
+  EXPECT_EQ(HttpCassette::exchange("GET", url, "", fail).status_code, 430);
+  EXPECT_FALSE(HttpCassette::exchange("POST", url, "{}", fail).success);
+
+  std::ifstream cassette(path);
+  std::string contents((std::istreambuf_iterator<char>(cassette)), {});
+  EXPECT_EQ(contents.find("secret"), std::string::npos);
+
+  HttpCassette::configure(Services::CassetteMode::Off, "");
+  std::remove(path.c_str());
+}
+
+// Test that concurrent identical GETs share one (replayed) transfer
+TEST(WebServiceTest, CoalescesConcurrentIdenticalRequests) {
+  using Services::HttpCassette;
+  const std::string path = "single_flight_test.jsonl";
+  const std::string url = "https://coalesce.test/page";
+
+  // Two distinct responses for the same request; each transfer takes one
+  ASSERT_TRUE(HttpCassette::configure(Services::CassetteMode::Record, path));
+  for (int status : {201, 202}) {
+    HttpCassette::exchange("GET", url, "", [status] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+      return Services::WebResponse{status, "", "", {}, true, ""};
+    });
+  }
+  ASSERT_TRUE(HttpCassette::configure(Services::CassetteMode::Replay, path));
+
+  std::vector<int> statuses(4);
+  std::vector<std::thread> threads;
+  for (auto &status : statuses) {
+    threads.emplace_back([&status, &url] {
+      status = Services::WebService::fetch_url(url).status_code;
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(statuses, std::vector<int>(4, 201));
+  EXPECT_EQ(Services::WebService::fetch_url(url).status_code, 202);
+
+  HttpCassette::configure(Services::CassetteMode::Off, "");
+  std::remove(path.c_str());
+}
+
+#ifndef _WIN32
+// Test that a streamed page is extracted even when the origin sends an
+// X-Cache header of its own (CDNs do) and the download stops early
+TEST(WebServiceTest, ExtractsStreamedPageDespiteOriginXCache) {
+  std::string paragraph = "<p>Streaming extraction keeps going, page after "
+                          "page, until enough text is in hand.</p>";
+  std::string body = "<html><body><article>";
+  for (int i = 0; i < 200; ++i) {
+    body += paragraph;
+  }
+  body += "</article></body></html>";
+  const std::string reply =
+      "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n"
+      "X-Cache: Miss from cloudfront\r\nCache-Control: max-age=60\r\n"
+      "Content-Length: " + std::to_string(body.size()) +
+      "\r\nConnection: close\r\n\r\n" + body;
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(listener, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr *>(&address), length),
+            0);
+  ASSERT_EQ(listen(listener, 1), 0);
+  getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length);
+  std::signal(SIGPIPE, SIG_IGN); // The client hangs up once it has enough
+  std::thread server([&] {
+    int client = accept(listener, nullptr, nullptr);
+    char request[4096];
+    (void)recv(client, request, sizeof(request), 0);
+    (void)send(client, reply.data(), reply.size(), 0);
+    close(client);
+  });
+
+  const std::string directory = "xcache_test_cache";
+  Services::HttpCache::configure(directory);
+  std::string text = Services::WebService::fetch_text(
+      "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/",
+      200);
+  server.join();
+  close(listener);
+  Services::HttpCache::configure(directory, false);
+  std::filesystem::remove_all(directory);
+
+  EXPECT_EQ(text.rfind("Streaming extraction keeps going", 0), 0U) << text;
+}
+#endif
+
+// Test that stored responses are reused and revalidated with their ETag
+TEST(HttpCacheTest, RevalidatesStaleEntries) {
+  using Services::HttpCache;
+  using Services::WebResponse;
+  const std::string directory = "http_cache_test";
+  const std::string url = "https://cache.test/repos/a/b/issues";
+  HttpCache::configure(directory);
+
+  std::vector<HeaderMap> sent;
+  auto origin = [&](int status, const std::string &cache_control) {
+    return [&sent, status, cache_control](const HeaderMap &headers) {
+      sent.push_back(headers);
+      HeaderMap response_headers = {{"ETag", "\"v1\""},
+                                    {"Cache-Control", cache_control}};
+      return WebResponse{status, status == 200 ? "[1, 2]" : "", "",
+                         response_headers, status == 200, ""};
+    };
+  };
+
+  EXPECT_EQ(HttpCache::fetch(url, {}, origin(200, "no-cache")).content,
+            "[1, 2]");
+  WebResponse revalidated =
+      HttpCache::fetch(url, {}, origin(304, "max-age=60"));
+  ASSERT_EQ(sent.size(), 2U);
+  EXPECT_EQ(sent[1]["If-None-Match"], "\"v1\"");
+  EXPECT_EQ(revalidated.status_code, 200);
+  EXPECT_EQ(revalidated.content, "[1, 2]");
+  EXPECT_EQ(revalidated.headers["X-Cache"], "REVALIDATED");
+  EXPECT_TRUE(revalidated.from_cache);
+
+  // Fresh now, so the origin is not asked again
+  WebResponse hit = HttpCache::fetch(url, {}, origin(500, ""));
+  EXPECT_EQ(sent.size(), 2U);
+  EXPECT_EQ(hit.headers["X-Cache"], "HIT");
+  EXPECT_TRUE(hit.from_cache);
+  EXPECT_EQ(hit.content, "[1, 2]");
+
+  HttpCache::configure(directory, false);
+  std::filesystem::remove_all(directory);
+}
+
+// Test that the issue mirror persists updates and ranks by relevance
+TEST(IssueMirrorTest, RanksRelatedIssuesAcrossReloads) {
+  using Services::GitHubIssue;
+  const std::string root = "issue_mirror_test";
+  auto issue = [](int number, const std::string &title,
+                  const std::string &updated_at) {
+    GitHubIssue result;
+    result.number = number;
+    result.title = title;
+    result.body = "Reported against version 2.";
+    result.state = "open";
+    result.updated_at = updated_at;
+    return result;
+  };
+
+  {
+    Services::IssueMirror mirror("octo", "repo", root);
+    EXPECT_FALSE(mirror.load());
+    mirror.apply({issue(1, "Crash when streaming big replies", "2024-01-01"),
+                  issue(2, "Typo in README", "2024-01-02"),
+                  issue(3, "Streaming stalls behind a proxy", "2024-01-03")});
+    mirror.apply({issue(2, "Streaming docs are outdated", "2024-02-01")});
+  }
+
+  Services::IssueMirror mirror("octo", "repo", root);
+  ASSERT_TRUE(mirror.load());
+  EXPECT_EQ(mirror.size(), 3U);
+  EXPECT_EQ(mirror.last_updated(), "2024-02-01");
+  auto related = mirror.related("crash while streaming", 2);
+  ASSERT_EQ(related.size(), 2U);
+  EXPECT_EQ(related[0]->number, 1);
+  EXPECT_TRUE(mirror.related("readme typo", 5).empty());
+  EXPECT_FALSE(Services::IssueMirror::is_valid_name(".."));
+
+  std::filesystem::remove_all(root);
+}
+
+// Test that line ranges match the file across index checkpoints
+TEST(FileServiceTest, ReadsLineRangesThroughIndex) {
+  using Services::FileService;
+  const std::string path = "line_index_test.txt";
+  auto line = [](int i) {
+    return "line " + std::to_string(i) + std::string(i % 97, 'x');
+  };
+  {
+    std::ofstream file(path, std::ios::binary);
+    for (int i = 0; i < 3000; ++i) {
+      file << line(i) << (i < 2999 ? "\n" : "");
+    }
+  }
+
+  EXPECT_EQ(FileService::read_file_range(path, 0, 1), line(0));
+  EXPECT_EQ(FileService::read_file_range(path, 1023, 3),
+            line(1023) + "\n" + line(1024) + "\n" + line(1025));
+  EXPECT_EQ(FileService::read_file_range(path, 2998), line(2998) + "\n" +
+                                                          line(2999));
+  EXPECT_EQ(FileService::read_file_range(path, 2999, 50), line(2999));
+  EXPECT_EQ(FileService::read_file_range(path, 5, 0), "");
+  EXPECT_EQ(FileService::read_file_range(path, 3000),
+            "Error: Start line out of range");
+
+  // A rewritten file is indexed afresh
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << "first\n\nthird\n";
+  }
+  EXPECT_EQ(FileService::read_file_range(path, 1, 2), "\nthird");
+  EXPECT_EQ(FileService::read_file_range(path, 3),
+            "Error: Start line out of range");
+
+  std::filesystem::remove(path);
+}
+
+// Test that replacements stream past the read limit and commit atomically
+TEST(FileServiceTest, ReplacesAtomicallyInOnePass) {
+  using Services::FileService;
+  const std::string dir = "atomic_replace_test";
+  const std::string path = dir + "/big.txt";
+  std::filesystem::create_directories(dir);
+  std::string content;
+  std::string expected;
+  int count = 0;
+  for (int i = 0; i < 200000; ++i) {
+    std::string line = "value_" + std::to_string(i) + std::string(16, '.');
+    bool hit = i % 3 == 0;
+    content += line + (hit ? " old\n" : "\n");
+    expected += line + (hit ? " newer\n" : "\n");
+    count += hit ? 1 : 0;
+  }
+  ASSERT_GT(content.size(), 5u * 1024 * 1024);
+  EXPECT_NE(FileService::write_file(path, "small").rfind("Error", 0), 0u);
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << content;
+  }
+  std::filesystem::permissions(path, std::filesystem::perms::owner_read |
+                                         std::filesystem::perms::owner_write);
+
+  // A wrong count leaves the file as it was
+  auto refused = FileService::replace_text_in_file(path, "old", "newer", 1);
+  EXPECT_FALSE(refused.success);
+  auto result = FileService::replace_text_in_file(path, "old", "newer", count);
+  EXPECT_TRUE(result.success) << result.message;
+  EXPECT_EQ(result.replacements_made, count);
+
+  std::ifstream file(path, std::ios::binary);
+  std::string written((std::istreambuf_iterator<char>(file)),
+                      std::istreambuf_iterator<char>());
+  EXPECT_TRUE(written == expected);
+  // No temporary files are left behind and the mode is kept
+  EXPECT_EQ(std::distance(std::filesystem::directory_iterator(dir),
+                          std::filesystem::directory_iterator()),
+            1);
+  EXPECT_EQ(std::filesystem::status(path).permissions(),
+            std::filesystem::perms::owner_read |
+                std::filesystem::perms::owner_write);
+  EXPECT_FALSE(FileService::replace_text_in_file(path, "", "x", 0).success);
+
+  std::filesystem::remove_all(dir);
+}
+
+// Test that a batch replacement previews, refuses or lands as a whole
+TEST(FileServiceTest, ReplacesAcrossFilesAllOrNothing) {
+  using Services::FileService;
+  namespace fs = std::filesystem;
+  const std::string dir = "batch_replace_test";
+  fs::create_directories(dir + "/a/b");
+  auto put = [](const std::string &path, const std::string &text) {
+    std::ofstream(path, std::ios::binary) << text;
+  };
+  auto get = [](const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)),
+                       std::istreambuf_iterator<char>());
+  };
+  put(dir + "/a/x.cpp", "int foo;\nfoo(foo);\n");
+  put(dir + "/a/b/y.cpp", "foo\n");
+  put(dir + "/z.txt", "foo\n");
+  FileService::configure_code_index("", false);
+  const std::string glob = dir + "/**/*.cpp";
+
+  Services::ReplaceOptions preview;
+  preview.dry_run = true;
+  auto planned = FileService::replace_in_files(glob, "foo", "bar", preview);
+  EXPECT_TRUE(planned.success) << planned.message;
+  EXPECT_EQ(planned.replacements_made, 4);
+  ASSERT_EQ(planned.files.size(), 2u);
+  EXPECT_EQ(planned.files[0].file_path, dir + "/a/b/y.cpp");
+  EXPECT_EQ(planned.files[1].preview, "  1: int bar;\n  2: bar(bar);\n");
+  EXPECT_EQ(get(dir + "/a/x.cpp"), "int foo;\nfoo(foo);\n");
+
+  // One wrong count stops every file from changing
+  Services::ReplaceOptions counted;
+  counted.expected_counts[dir + "/a/x.cpp"] = 2;
+  EXPECT_FALSE(FileService::replace_in_files(glob, "foo", "bar", counted)
+                   .success);
+  EXPECT_EQ(get(dir + "/a/b/y.cpp"), "foo\n");
+
+  counted.expected_counts[dir + "/a/x.cpp"] = 3;
+  auto applied = FileService::replace_in_files(glob, "foo", "bar", counted);
+  EXPECT_TRUE(applied.success) << applied.message;
+  EXPECT_EQ(get(dir + "/a/x.cpp"), "int bar;\nbar(bar);\n");
+  EXPECT_EQ(get(dir + "/a/b/y.cpp"), "bar\n");
+  EXPECT_EQ(get(dir + "/z.txt"), "foo\n");
+  EXPECT_FALSE(
+      FileService::replace_in_files(dir + "/*.cpp", "bar", "foo").success);
+  std::size_t entries = 0;
+  for (const auto &entry : fs::recursive_directory_iterator(dir)) {
+    entries += entry.is_regular_file() ? 1 : 0;
+  }
+  EXPECT_EQ(entries, 3u); // No temporary files left behind
+
+  fs::remove_all(dir);
+}
+
+// Test that the automaton agrees with the equivalent alternation regex
+TEST(AhoCorasickTest, MatchesLikeAlternationRegex) {
+  const std::vector<std::string> words = {"he", "she", "his", "hers", "del /"};
+  Utils::AhoCorasick plain(words);
+  Utils::AhoCorasick folded(words, false);
+  Utils::AhoCorasick whole(words, true, true);
+  std::regex plain_regex("he|she|his|hers|del /");
+  std::regex folded_regex("he|she|his|hers|del /", std::regex::icase);
+  std::regex whole_regex("\\b(?:he|she|his|hers|del /)\\b");
+
+  auto match = plain.find("ushers");
+  EXPECT_EQ(match.position, 1U); // "she" ends before "hers"
+  EXPECT_EQ(match.length, 3U);
+  EXPECT_TRUE(whole.contains("run del /q"));
+  EXPECT_FALSE(whole.contains("run del / q"));
+
+  std::srand(7);
+  const std::string alphabet = "hesirHS d/_";
+  for (int round = 0; round < 2000; ++round) {
+    std::string text;
+    for (int i = std::rand() % 12; i > 0; --i) {
+      text += alphabet[static_cast<std::size_t>(std::rand()) % alphabet.size()];
+    }
+    EXPECT_EQ(plain.contains(text), std::regex_search(text, plain_regex))
+        << text;
+    EXPECT_EQ(folded.contains(text), std::regex_search(text, folded_regex))
+        << text;
+    EXPECT_EQ(whole.contains(text), std::regex_search(text, whole_regex))
+        << text;
+  }
+}
+
+// Test that the prefiltered parallel search finds what a line-by-line
+// regex finds
+TEST(FileServiceTest, SearchesDirectoriesLikeLineRegex) {
+  using Services::FileService;
+  bool exact = false;
+  EXPECT_EQ(Utils::LiteralSearch::required_literals("TODO|FIXME", exact),
+            (std::vector<std::string>{"TODO", "FIXME"}));
+  EXPECT_TRUE(exact);
+  EXPECT_EQ(Utils::LiteralSearch::required_literals("err(or)?\\s+co?de\\.x",
+                                                    exact),
+            (std::vector<std::string>{"de.x"}));
+  EXPECT_FALSE(exact);
+  EXPECT_TRUE(Utils::LiteralSearch::required_literals("a|\\d+", exact).empty());
+
+  const std::string root = "search_test";
+  FileService::configure_code_index(root + "_index");
+  std::filesystem::create_directories(root + "/a/b");
+  std::vector<std::string> lines;
+  for (int i = 0; i < 400; ++i) {
+    lines.push_back(i % 7 == 0   ? "// todo: item " + std::to_string(i)
+                    : i % 5 == 0 ? "Error   code 5" + std::to_string(i)
+                                 : "plain line " + std::to_string(i));
+  }
+  for (const char *name : {"/one.txt", "/a/two.cpp", "/a/b/three.md"}) {
+    std::ofstream file(root + name);
+    for (const auto &line : lines) {
+      file << line << "\n";
+    }
+  }
+
+  for (const std::string pattern : {"TODO|FIXME", "error\\s+code \\d+0$"}) {
+    std::regex regex(pattern, std::regex::icase);
+    std::size_t expected = 0;
+    for (const auto &line : lines) {
+      expected += std::regex_search(line, regex) ? 1 : 0;
+    }
+    auto matches = FileService::search_in_directory(root, pattern);
+    ASSERT_EQ(matches.size(), 3 * expected) << pattern;
+    for (const auto &match : matches) {
+      EXPECT_EQ(match.line_content, lines[match.line_number - 1]);
+    }
+  }
+
+  int seen = 0;
+  EXPECT_TRUE(FileService::search_in_directory(
+      root, "plain", "*", false, [&seen](const Services::FileSearchResult &) {
+        return ++seen < 5;
+      }));
+  EXPECT_EQ(seen, 5);
+  EXPECT_FALSE(FileService::search_in_directory(
+      root, "(", "*", false,
+      [](const Services::FileSearchResult &) { return true; }));
+
+  // A subdirectory is searched through the index of the tree around it
+  auto all = FileService::search_in_directory(root, "TODO|FIXME");
+  auto nested = FileService::search_in_directory(root + "/a", "TODO|FIXME");
+  EXPECT_EQ(nested.size(), all.size() / 3 * 2);
+  for (const auto &match : nested) {
+    EXPECT_EQ(match.file_path.rfind(root + "/a/", 0), 0U) << match.file_path;
+  }
+  EXPECT_EQ(std::distance(std::filesystem::directory_iterator(root + "_index"),
+                          std::filesystem::directory_iterator()),
+            1);
+
+  FileService::configure_code_index("", false);
+  std::filesystem::remove_all(root);
+  std::filesystem::remove_all(root + "_index");
+}
+
+// Test that the trigram index narrows searches and follows file changes
+TEST(CodeIndexTest, NarrowsAndFollowsChanges) {
+  using Services::CodeIndex;
+  const std::string root = "code_index_test";
+  const std::string index_path = root + "_data/test.trigrams";
+  std::filesystem::create_directories(root + "/src");
+  auto write = [&root](const std::string &name, const std::string &text) {
+    std::ofstream(root + "/" + name, std::ios::trunc) << text;
+  };
+  write("src/a.cpp", "int parse_config() { return 0; }\n");
+  write("src/b.cpp", "void render_frame();\n// TODO: cache\n");
+  write("notes.md", "Parse the CONFIG later\n");
+
+  auto sorted = [](std::optional<std::vector<std::string>> paths) {
+    EXPECT_TRUE(paths.has_value());
+    auto result = paths.value_or(std::vector<std::string>{});
+    std::sort(result.begin(), result.end());
+    return result;
+  };
+
+  CodeIndex index(root, index_path);
+  EXPECT_FALSE(index.load());
+  EXPECT_TRUE(index.refresh());
+  EXPECT_EQ(index.size(), 3U);
+  EXPECT_EQ(sorted(index.candidates("parse.config")),
+            (std::vector<std::string>{"notes.md", "src/a.cpp"}));
+  EXPECT_EQ(sorted(index.candidates("todo|render_\\w+")),
+            (std::vector<std::string>{"src/b.cpp"}));
+  EXPECT_FALSE(index.candidates("a|\\d+").has_value());
+  EXPECT_TRUE(index.save());
+
+  write("src/b.cpp", "void parse_configuration();\n");
+  std::filesystem::remove(root + "/notes.md");
+  CodeIndex reloaded(root, index_path);
+  ASSERT_TRUE(reloaded.load());
+  EXPECT_TRUE(reloaded.refresh());
+  EXPECT_FALSE(reloaded.refresh());
+  EXPECT_EQ(sorted(reloaded.candidates("parse_config")),
+            (std::vector<std::string>{"src/a.cpp", "src/b.cpp"}));
+  EXPECT_TRUE(sorted(reloaded.candidates("render")).empty());
+
+  // Refreshing a subtree leaves files outside it alone
+  write("notes.md", "render later\n");
+  std::filesystem::remove(root + "/src/a.cpp");
+  EXPECT_TRUE(reloaded.refresh("src"));
+  EXPECT_EQ(sorted(reloaded.candidates("parse_config")),
+            (std::vector<std::string>{"src/b.cpp"}));
+  EXPECT_TRUE(sorted(reloaded.candidates("render")).empty());
+
+  std::filesystem::remove_all(root);
+  std::filesystem::remove_all(root + "_data");
+}
+
+// Test that the page count is read from the rel="last" link
+TEST(GitHubServiceTest, ReadsLastPageFromLinkHeader) {
+  using Services::GitHubService;
+  const std::string link =
+      "<https://api.github.com/repositories/1/issues?per_page=100&page=2>; "
+      "rel=\"next\", "
+      "<https://api.github.com/repositories/1/issues?per_page=100&page=37>; "
+      "rel=\"last\"";
+  EXPECT_EQ(GitHubService::last_page(link), 37);
+  EXPECT_EQ(GitHubService::last_page("<https://x/?page=3>; rel=\"next\""), 1);
+  EXPECT_EQ(GitHubService::last_page(""), 1);
+}
+
+// Test that HTML split at every byte gives the same text as one pass
+TEST(HtmlTextTest, ExtractsTextIncrementally) {
+  const std::string html =
+      "<html><head><style>p{}</style><script>if (a<b) x='</p>';</script>"
+      "</head><body><!-- <p>hidden</p> --><h1>Caf&eacute; &amp; Bar</h1>"
+      "<p>One   <b>two</b>\n three&nbsp;&#x1F600; &bogus; &lt;</p>"
+      "<ul><li>a</li><li>b</li></ul><pre>x  = 1;\n</pre></body></html>";
+  const std::string expected = "# Caf\xC3\xA9 & Bar\n\nOne two three "
+                               "\xF0\x9F\x98\x80 &bogus; <\n\n- a\n- b\n\n"
+                               "```\nx  = 1;\n```";
+
+  EXPECT_EQ(Utils::HtmlTextExtractor::extract(html), expected);
+
+  Utils::HtmlTextExtractor extractor;
+  for (char c : html) {
+    extractor.feed(std::string_view(&c, 1));
+  }
+  extractor.finish();
+  EXPECT_EQ(extractor.text(), expected);
+}
+
+// Test that navigation, sidebars and link lists are dropped from a page
+TEST(HtmlTextTest, KeepsMainContent) {
+  const std::string paragraph =
+      "<p>The scheduler runs read-only tools in parallel, keeps side effects "
+      "in order, and returns results in the order they were requested.</p>";
+  const std::string html =
+      "<body><nav><ul><li><a href='/'>Home</a></li><li><a href='/docs'>Docs"
+      "</a></li></ul></nav><div class=\"sidebar\"><p>Subscribe to our "
+      "newsletter for weekly updates, tips and tricks.</p></div>"
+      "<h1>Tool scheduling</h1><div id=\"post-body\">" +
+      paragraph + paragraph + "<pre>submit(cmd);</pre></div>"
+      "<footer><p>Copyright 2024, all rights reserved, Example Inc.</p>"
+      "</footer></body>";
+
+  std::string text = Utils::MainContentExtractor::extract(html);
+  EXPECT_EQ(text.rfind("# Tool scheduling\n\nThe scheduler", 0), 0U);
+  EXPECT_NE(text.find("```\nsubmit(cmd);\n```"), std::string::npos);
+  EXPECT_EQ(text.find("Home"), std::string::npos);
+  EXPECT_EQ(text.find("newsletter"), std::string::npos);
+  EXPECT_EQ(text.find("Copyright"), std::string::npos);
+}
+
+// Test that containers opened after the last scored block are not scored
+TEST(HtmlTextTest, IgnoresUnscoredLaterContainers) {
+  const std::string html =
+      "<div><div class=\"content\"><p>This is a long paragraph of prose, "
+      "with commas, and more.</p></div><div><p>x</p></div><div><div><div>"
+      "<p>later</p></div></div></div></div>";
+
+  std::string text = Utils::MainContentExtractor::extract(html);
+  EXPECT_NE(text.find("This is a long paragraph"), std::string::npos);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();